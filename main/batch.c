@@ -0,0 +1,40 @@
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "batch.h"
+
+static const char *TAG = "batch";
+
+static RTC_DATA_ATTR sample_t samples[BATCH_SIZE_MAX];
+static RTC_DATA_ATTR uint8_t head = 0;
+static RTC_DATA_ATTR uint8_t count = 0;
+
+void batch_push(const sample_t *sample)
+{
+    if (count == BATCH_SIZE_MAX) {
+        ESP_LOGW(TAG, "Full, dropping oldest sample");
+        batch_drop(1);
+    }
+
+    samples[(head + count) % BATCH_SIZE_MAX] = *sample;
+    count++;
+}
+
+uint8_t batch_count()
+{
+    return count;
+}
+
+const sample_t* batch_get(uint8_t index)
+{
+    return &samples[(head + index) % BATCH_SIZE_MAX];
+}
+
+void batch_drop(uint8_t n)
+{
+    if (n > count) {
+        n = count;
+    }
+    head = (head + n) % BATCH_SIZE_MAX;
+    count -= n;
+}
@@ -0,0 +1,24 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdint.h>
+
+#define BATCH_SIZE_MAX  16
+
+typedef struct
+{
+    uint16_t humidity;          // 0.01 %
+    int16_t temperature;        // 0.01 °C
+    uint8_t battery;            // %
+    uint16_t battery_voltage;   // mV
+} sample_t;
+
+void batch_push(const sample_t *sample);
+
+uint8_t batch_count();
+
+const sample_t* batch_get(uint8_t index);
+
+void batch_drop(uint8_t count);
+
+#endif /* BATCH_H_ */
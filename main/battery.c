@@ -1,40 +1,117 @@
-#include <math.h>
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp32/clk.h"
 #include "driver/adc.h"
 #include "esp_adc_cal.h"
 
 #include "battery.h"
 #include "peripherals.h"
+#include "soc.h"
 
-#define ADC_ATTEN   ADC_ATTEN_DB_11
-#define ADC_WIDTH   ADC_WIDTH_BIT_12
-#define MAX_VCC     4200
-#define MIN_VCC     1650
+#define ADC_ATTEN           ADC_ATTEN_DB_11
+#define ADC_WIDTH           ADC_WIDTH_BIT_12
+#define ADC_OVERSAMPLE      64      // single reads averaged
+#define ADC_OVERSAMPLE_TX   16      // fewer reads so sampling ends well within the shortest TX
+#define TX_SAMPLE_DELAY     5000    // us after TX begin, PA current has settled
+#define VBAT_DIVIDER        2
 
 static const char *TAG = "battery";
 
 static esp_adc_cal_characteristics_t adc_char;
 
+static RTC_DATA_ATTR soc_state_t soc_state = { 0 };
+static RTC_DATA_ATTR uint16_t rest_voltage = 0;     // mV, last reading before TX
+static RTC_DATA_ATTR uint64_t consumed = 0;         // nC (mA * us)
+static RTC_DATA_ATTR uint64_t sleep_start = 0;      // RTC time, us
+
+static uint32_t tx_time = 0;
+static esp_timer_handle_t tx_sample_timer = NULL;
+static volatile uint16_t loaded_voltage = 0;        // mV, sampled during TX
+
+static uint16_t read_voltage(int oversample)
+{
+    // ADC noise is several LSB, oversampling averages it out
+    uint32_t sum = 0;
+    for (int i = 0; i < oversample; i++) {
+        sum += adc1_get_raw(VBAT_ADC1_CHN);
+    }
+    return VBAT_DIVIDER * esp_adc_cal_raw_to_voltage(sum / oversample, &adc_char);
+}
+
+static void tx_sample(void *arg)
+{
+    loaded_voltage = read_voltage(ADC_OVERSAMPLE_TX);
+}
+
 void battery_measure_init()
 {
     adc1_config_width(ADC_WIDTH);
     adc1_config_channel_atten(VBAT_ADC1_CHN, ADC_ATTEN);
 
     esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN, ADC_WIDTH, 1100, &adc_char);
+
+// @formatter:off
+    esp_timer_create_args_t timer_args = {
+            .callback = &tx_sample,
+            .name = "tx_sample"
+    };
+// @formatter:on
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &tx_sample_timer));
+
+    if (sleep_start) {
+        uint64_t sleep_time = esp_clk_rtc_time() - sleep_start;
+        consumed += sleep_time * BATTERY_CURRENT_SLEEP / 1000;
+        sleep_start = 0;
+    }
 }
 
 void battery_measure(uint8_t *battery, float *battery_voltage)
 {
-    int adc_reading = adc1_get_raw(VBAT_ADC1_CHN);
-    uint32_t vcc = 2 * esp_adc_cal_raw_to_voltage(adc_reading, &adc_char);
+    // battery rested during deep sleep, the only load is the CPU
+    rest_voltage = read_voltage(ADC_OVERSAMPLE);
+    uint16_t soc = soc_update(&soc_state, rest_voltage, BATTERY_CURRENT_ACTIVE);
+
+    *battery_voltage = rest_voltage / 1000.0f;
+    *battery = soc / 100;
+
+    ESP_LOGI(TAG, "Measure %d%% (%dmV, %d mOhm, %llu uAh used)", *battery, rest_voltage, soc_state.resistance, battery_consumed());
+}
+
+void battery_tx_begin()
+{
+    // the cell recovers within milliseconds after TX, the sag has to be sampled while transmitting
+    loaded_voltage = 0;
+    if (!tx_sample_timer) {
+        return;
+    }
+    esp_timer_stop(tx_sample_timer);
+    esp_timer_start_once(tx_sample_timer, TX_SAMPLE_DELAY);
+}
 
-    float v = ((vcc > MAX_VCC ? MAX_VCC : vcc) - MIN_VCC);
-    if (v < 0) {
-        v = 0;
+void battery_tx_done(uint32_t duration)
+{
+    if (tx_sample_timer) {
+        esp_timer_stop(tx_sample_timer);
     }
+    uint16_t loaded = loaded_voltage;
+    if (rest_voltage && loaded) {
+        // rest voltage was read with the CPU load, the sag is caused by the radio only
+        soc_update_resistance(&soc_state, rest_voltage, loaded, BATTERY_CURRENT_TX - BATTERY_CURRENT_ACTIVE);
+    }
+    tx_time += duration;
+
+    ESP_LOGI(TAG, "During TX %dmV (rest %dmV)", loaded, rest_voltage);
+}
 
-    *battery_voltage = vcc / 1000.0f;
-    *battery = v / (float) (MAX_VCC - MIN_VCC) * 100;
+void battery_sleep()
+{
+    uint64_t awake_time = esp_timer_get_time();
+    consumed += awake_time * BATTERY_CURRENT_ACTIVE + (uint64_t) tx_time * (BATTERY_CURRENT_TX - BATTERY_CURRENT_ACTIVE);
+    sleep_start = esp_clk_rtc_time();
+}
 
-    ESP_LOGI(TAG, "Measure %d%% (%dmV)", *battery, vcc);
+uint64_t battery_consumed()
+{
+    return consumed / 3600000ULL;
 }
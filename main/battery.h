@@ -3,8 +3,20 @@
 
 #include <stdint.h>
 
+#define BATTERY_CURRENT_ACTIVE  40      // mA, CPU running, radio idle
+#define BATTERY_CURRENT_TX      120     // mA, CPU and radio transmitting
+#define BATTERY_CURRENT_SLEEP   150     // uA, deep sleep incl. sensor and regulator
+
 void battery_measure_init();
 
 void battery_measure(uint8_t *battery, float *battery_voltage);
 
+void battery_tx_begin();
+
+void battery_tx_done(uint32_t duration);
+
+void battery_sleep();
+
+uint64_t battery_consumed(); // uAh since power on
+
 #endif /* BATTERY_H_ */
@@ -1,6 +1,7 @@
 #ifndef BLE_H_
 #define BLE_H_
 
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 
@@ -21,4 +22,8 @@ void ble_set_battery(uint8_t battery);
 
 void ble_set_enviromental(float humidity, float temperature);
 
+#ifdef CONFIG_BLE_BEACON
+void ble_beacon(float humidity, float temperature, uint8_t battery);
+#endif /* CONFIG_BLE_BEACON */
+
 #endif /* BLE_H_ */
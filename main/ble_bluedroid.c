@@ -1,5 +1,9 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_BT_BLUEDROID_ENABLED
 #include <string.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_bt.h"
 #include "esp_gap_ble_api.h"
@@ -10,7 +14,10 @@
 #include "nvs.h"
 
 #include "ble.h"
-#include "storage_key.h"
+#include "ble_gatt.h"
+#include "settings.h"
+#include "profiler.h"
+#include "budget.h"
 
 static const char *TAG = "ble";
 
@@ -20,9 +27,13 @@ static const char *TAG = "ble";
 #define ADV_CONFIG_FLAG (1 << 0)
 #define SCAN_RSP_CONFIG_FLAG (1 << 1)
 
+#define BEACON_INTERVAL 0x0020  // 20 ms
+#define BEACON_START_TIMEOUT 1000 // ms, stack and controller bring-up until advertising runs
+
 static uint8_t adv_config_done = 0;
 
-QueueHandle_t ble_event_queue;
+static SemaphoreHandle_t beacon_started_sem = NULL;
+static bool beacon_started;
 
 // @formatter:off
 static uint8_t service_uuid[48] = {
@@ -72,6 +83,15 @@ static esp_ble_adv_params_t adv_params = {
         .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
 };
 
+static esp_ble_adv_params_t beacon_params = {
+        .adv_int_min = BEACON_INTERVAL,
+        .adv_int_max = BEACON_INTERVAL,
+        .adv_type = ADV_TYPE_NONCONN_IND,
+        .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
+        .channel_map = ADV_CHNL_ALL,
+        .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+};
+
 enum
 {
     LORA_IDX_SVC,
@@ -104,6 +124,33 @@ enum
     LORA_IDX_CHAR_VAL_CONFM,
     LORA_IDX_CHAR_CFG_CONFM,
 
+    LORA_IDX_CHAR_BATCH,
+    LORA_IDX_CHAR_VAL_BATCH,
+    LORA_IDX_CHAR_CFG_BATCH,
+
+    LORA_IDX_CHAR_DEADBAND,
+    LORA_IDX_CHAR_VAL_DEADBAND,
+    LORA_IDX_CHAR_CFG_DEADBAND,
+
+    LORA_IDX_CHAR_BAT_PERIOD,
+    LORA_IDX_CHAR_VAL_BAT_PERIOD,
+    LORA_IDX_CHAR_CFG_BAT_PERIOD,
+
+    LORA_IDX_CHAR_LINK_ADAPT,
+    LORA_IDX_CHAR_VAL_LINK_ADAPT,
+    LORA_IDX_CHAR_CFG_LINK_ADAPT,
+
+    LORA_IDX_CHAR_BUDGET,
+    LORA_IDX_CHAR_VAL_BUDGET,
+    LORA_IDX_CHAR_CFG_BUDGET,
+
+    LORA_IDX_CHAR_PROFILER,
+    LORA_IDX_CHAR_VAL_PROFILER,
+
+    LORA_IDX_CHAR_HISTORY,
+    LORA_IDX_CHAR_VAL_HISTORY,
+    LORA_IDX_CHAR_CFG_HISTORY,
+
     LORA_IDX_NB
 };
 
@@ -143,6 +190,13 @@ static const uint16_t GATTS_CHAR_UUID_APP_KEY       = 0xC904;
 static const uint16_t GATTS_CHAR_UUID_NWK_KEY       = 0xC905;
 static const uint16_t GATTS_CHAR_UUID_PAYL_FMT      = 0xC907;
 static const uint16_t GATTS_CHAR_UUID_CONFM         = 0xC908;
+static const uint16_t GATTS_CHAR_UUID_PROFILER      = 0xC909;
+static const uint16_t GATTS_CHAR_UUID_BATCH         = 0xC90A;
+static const uint16_t GATTS_CHAR_UUID_DEADBAND      = 0xC90B;
+static const uint16_t GATTS_CHAR_UUID_BAT_PERIOD    = 0xC90C;
+static const uint16_t GATTS_CHAR_UUID_LINK_ADAPT    = 0xC90D;
+static const uint16_t GATTS_CHAR_UUID_BUDGET        = 0xC90E;
+static const uint16_t GATTS_CHAR_UUID_HISTORY       = 0xC90F;
 static const uint16_t GATTS_CHAR_UUID_HUM           = 0x2A6F;
 static const uint16_t GATTS_CHAR_UUID_TEMP          = 0x2A6E;
 static const uint16_t GATTS_CHAR_UUID_BAT_LVL       = 0x2A19;
@@ -153,6 +207,7 @@ static const uint16_t character_client_config_uuid = ESP_GATT_UUID_CHAR_CLIENT_C
 static const uint8_t char_prop_read = ESP_GATT_CHAR_PROP_BIT_READ;
 static const uint8_t char_prop_read_write = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE;
 static const uint8_t char_prop_read_notify = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+static const uint8_t char_prop_read_write_notify = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
 
 static uint8_t period_ccc[2] = {0x00, 0x00};
 
@@ -166,6 +221,18 @@ static uint8_t payl_fmt_ccc[2] = {0x00, 0x00};
 
 static uint8_t confm_ccc[2] = {0x00, 0x00};
 
+static uint8_t batch_ccc[2] = {0x00, 0x00};
+
+static uint8_t deadband_ccc[2] = {0x00, 0x00};
+
+static uint8_t bat_period_ccc[2] = {0x00, 0x00};
+
+static uint8_t link_adapt_ccc[2] = {0x00, 0x00};
+
+static uint8_t budget_ccc[2] = {0x00, 0x00};
+
+static uint8_t history_ccc[2] = {0x00, 0x00};
+
 static uint8_t bat_lvl_val = 0;
 static uint8_t bat_lvl_ccc[2] = {0x00, 0x00};
 
@@ -224,10 +291,57 @@ static const esp_gatts_attr_db_t gatt_lora_db[LORA_IDX_NB] = {
     [LORA_IDX_CHAR_CONFM] =
          {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&char_prop_read_write}},
     [LORA_IDX_CHAR_VAL_CONFM] =
-         {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&GATTS_CHAR_UUID_CONFM, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, sizeof(uint8_t), 0, NULL}},
+         {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&GATTS_CHAR_UUID_CONFM, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 2 * sizeof(uint8_t), 0, NULL}},
     [LORA_IDX_CHAR_CFG_CONFM] =
          {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 2 * sizeof(uint8_t), 2 * sizeof(uint8_t), (uint8_t *)confm_ccc}},
 
+    [LORA_IDX_CHAR_BATCH] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&char_prop_read_write}},
+    [LORA_IDX_CHAR_VAL_BATCH] =
+         {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&GATTS_CHAR_UUID_BATCH, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, sizeof(uint8_t), 0, NULL}},
+    [LORA_IDX_CHAR_CFG_BATCH] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 2 * sizeof(uint8_t), 2 * sizeof(uint8_t), (uint8_t *)batch_ccc}},
+
+    [LORA_IDX_CHAR_DEADBAND] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&char_prop_read_write}},
+    [LORA_IDX_CHAR_VAL_DEADBAND] =
+         {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&GATTS_CHAR_UUID_DEADBAND, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 3 * sizeof(uint16_t), 0, NULL}},
+    [LORA_IDX_CHAR_CFG_DEADBAND] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 2 * sizeof(uint8_t), 2 * sizeof(uint8_t), (uint8_t *)deadband_ccc}},
+
+    [LORA_IDX_CHAR_BAT_PERIOD] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&char_prop_read_write}},
+    [LORA_IDX_CHAR_VAL_BAT_PERIOD] =
+         {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&GATTS_CHAR_UUID_BAT_PERIOD, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, PERIOD_BREAKPOINTS * sizeof(period_breakpoint_t), 0, NULL}},
+    [LORA_IDX_CHAR_CFG_BAT_PERIOD] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 2 * sizeof(uint8_t), 2 * sizeof(uint8_t), (uint8_t *)bat_period_ccc}},
+
+    [LORA_IDX_CHAR_LINK_ADAPT] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&char_prop_read_write}},
+    [LORA_IDX_CHAR_VAL_LINK_ADAPT] =
+         {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&GATTS_CHAR_UUID_LINK_ADAPT, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, sizeof(uint8_t), 0, NULL}},
+    [LORA_IDX_CHAR_CFG_LINK_ADAPT] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 2 * sizeof(uint8_t), 2 * sizeof(uint8_t), (uint8_t *)link_adapt_ccc}},
+
+    [LORA_IDX_CHAR_BUDGET] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&char_prop_read_write}},
+    [LORA_IDX_CHAR_VAL_BUDGET] =
+         {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&GATTS_CHAR_UUID_BUDGET, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 2 * sizeof(uint16_t) + sizeof(budget_status_t), 0, NULL}},
+    [LORA_IDX_CHAR_CFG_BUDGET] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 2 * sizeof(uint8_t), 2 * sizeof(uint8_t), (uint8_t *)budget_ccc}},
+
+    [LORA_IDX_CHAR_PROFILER] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&char_prop_read}},
+    [LORA_IDX_CHAR_VAL_PROFILER] =
+         {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&GATTS_CHAR_UUID_PROFILER, ESP_GATT_PERM_READ, PROFILER_PHASE_NB * sizeof(profiler_stats_t), 0, NULL}},
+
+    [LORA_IDX_CHAR_HISTORY] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&char_prop_read_write_notify}},
+    [LORA_IDX_CHAR_VAL_HISTORY] =
+         {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&GATTS_CHAR_UUID_HISTORY, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, BLE_HISTORY_CHUNK_MAX, 0, NULL}},
+    [LORA_IDX_CHAR_CFG_HISTORY] =
+         {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, 2 * sizeof(uint8_t), 2 * sizeof(uint8_t), (uint8_t *)history_ccc}},
+
 };
 
 static const esp_gatts_attr_db_t gatt_env_sens_db[ENV_SENS_IDX_NB] = {
@@ -269,76 +383,87 @@ uint16_t env_sens_handle_table[ENV_SENS_IDX_NB];
 static esp_gatt_if_t ble_gatts_if = 0;
 static uint16_t ble_connection_id = 0;
 static bool ble_has_connection;
+static bool advertising = false; // connectable advertising requested or running, data updates must not restart it
+static uint16_t ble_mtu = 23;
+
+static uint8_t history_in_flight = 0;
+static bool history_congested = false;
+
+// value attribute of every characteristic in the LoRa service table
+// @formatter:off
+static const uint8_t lora_char_idx[BLE_CHAR_NB] = {
+    [BLE_CHAR_PERIOD]       = LORA_IDX_CHAR_VAL_PERIOD,
+    [BLE_CHAR_JOIN_EUI]     = LORA_IDX_CHAR_VAL_JOIN_EUI,
+    [BLE_CHAR_DEV_EUI]      = LORA_IDX_CHAR_VAL_DEV_EUI,
+    [BLE_CHAR_APP_KEY]      = LORA_IDX_CHAR_VAL_APP_KEY,
+    [BLE_CHAR_NWK_KEY]      = LORA_IDX_CHAR_VAL_NWK_KEY,
+    [BLE_CHAR_PAYL_FMT]     = LORA_IDX_CHAR_VAL_PAYL_FMT,
+    [BLE_CHAR_CONFM]        = LORA_IDX_CHAR_VAL_CONFM,
+    [BLE_CHAR_BATCH]        = LORA_IDX_CHAR_VAL_BATCH,
+    [BLE_CHAR_DEADBAND]     = LORA_IDX_CHAR_VAL_DEADBAND,
+    [BLE_CHAR_BAT_PERIOD]   = LORA_IDX_CHAR_VAL_BAT_PERIOD,
+    [BLE_CHAR_LINK_ADAPT]   = LORA_IDX_CHAR_VAL_LINK_ADAPT,
+    [BLE_CHAR_BUDGET]       = LORA_IDX_CHAR_VAL_BUDGET,
+    [BLE_CHAR_PROFILER]     = LORA_IDX_CHAR_VAL_PROFILER,
+    [BLE_CHAR_HISTORY]      = LORA_IDX_CHAR_VAL_HISTORY,
+};
+// @formatter:on
+
+static int lora_char_find(uint16_t handle)
+{
+    for (int chr = 0; chr < BLE_CHAR_NB; chr++) {
+        if (lora_char_idx[chr] != LORA_IDX_SVC && lora_handle_table[lora_char_idx[chr]] == handle) {
+            return chr;
+        }
+    }
+    return -1;
+}
+
+static void history_pump()
+{
+    uint8_t value[BLE_HISTORY_CHUNK_MAX];
+    uint16_t len, records;
+
+    while (!history_congested && history_in_flight < BLE_HISTORY_WINDOW
+            && (len = ble_gatt_history_chunk(value, ble_mtu - 3, &records)) > 0) {
+        if (esp_ble_gatts_send_indicate(ble_gatts_if, ble_connection_id, lora_handle_table[LORA_IDX_CHAR_VAL_HISTORY], len,
+                value, false) != ESP_OK) {
+            break;
+        }
+        ble_gatt_history_sent(records);
+        history_in_flight++;
+    }
+}
 
 void gatts_read(esp_gatt_if_t gatts_if, struct gatts_read_evt_param read)
 {
-    esp_gatt_rsp_t rsp;
-    rsp.attr_value.handle = read.handle;
-    size_t length = 0;
-    rsp.attr_value.len = 0;
-    memset(rsp.attr_value.value, 0, sizeof(uint8_t) * 32); // no attribute longer than 32
-
-    if (read.handle == lora_handle_table[LORA_IDX_CHAR_VAL_PERIOD]) {
-        rsp.attr_value.len = sizeof(uint16_t);
-        nvs_get_u16(storage, STORAGE_KEY_PERIOD, (uint16_t*) rsp.attr_value.value);
-    } else if (read.handle == lora_handle_table[LORA_IDX_CHAR_VAL_JOIN_EUI]) {
-        rsp.attr_value.len = length = sizeof(uint8_t) * 8;
-        nvs_get_blob(storage, STORAGE_KEY_LORA_JOIN_EUI, (void*) rsp.attr_value.value, &length);
-    } else if (read.handle == lora_handle_table[LORA_IDX_CHAR_VAL_DEV_EUI]) {
-        rsp.attr_value.len = length = sizeof(uint8_t) * 8;
-        nvs_get_blob(storage, STORAGE_KEY_LORA_DEV_EUI, (void*) rsp.attr_value.value, &length);
-    } else if (read.handle == lora_handle_table[LORA_IDX_CHAR_VAL_APP_KEY]) {
-        rsp.attr_value.len = length = sizeof(uint8_t) * 16;
-        nvs_get_blob(storage, STORAGE_KEY_LORA_APP_KEY, (void*) rsp.attr_value.value, &length);
-    } else if (read.handle == lora_handle_table[LORA_IDX_CHAR_VAL_NWK_KEY]) {
-        rsp.attr_value.len = length = sizeof(uint8_t) * 16;
-        nvs_get_blob(storage, STORAGE_KEY_LORA_NWK_KEY, (void*) rsp.attr_value.value, &length);
-    } else if (read.handle == lora_handle_table[LORA_IDX_CHAR_VAL_PAYL_FMT]) {
-        rsp.attr_value.len = sizeof(uint8_t);
-        nvs_get_u8(storage, STORAGE_KEY_PAYL_FMT, (uint8_t*) rsp.attr_value.value);
-    } else if (read.handle == lora_handle_table[LORA_IDX_CHAR_VAL_CONFM]) {
-        rsp.attr_value.len = sizeof(uint8_t);
-        nvs_get_u8(storage, STORAGE_KEY_CONFM, (uint8_t*) rsp.attr_value.value);
+    int chr = lora_char_find(read.handle);
+    if (chr < 0) {
+        return;
     }
 
-    if (rsp.attr_value.len > 0) {
-        esp_ble_gatts_send_response(gatts_if, read.conn_id, read.trans_id, ESP_GATT_OK, &rsp);
+    uint8_t value[BLE_GATT_VALUE_MAX];
+    uint16_t len = ble_gatt_read(chr, value);
+
+    esp_gatt_rsp_t rsp;
+    memset(&rsp, 0, sizeof(rsp));
+    rsp.attr_value.handle = read.handle;
+    if (read.offset > len) {
+        esp_ble_gatts_send_response(gatts_if, read.conn_id, read.trans_id, ESP_GATT_INVALID_OFFSET, NULL);
+        return;
     }
+    rsp.attr_value.offset = read.offset;
+    rsp.attr_value.len = len - read.offset;
+    memcpy(rsp.attr_value.value, &value[read.offset], rsp.attr_value.len);
+    esp_ble_gatts_send_response(gatts_if, read.conn_id, read.trans_id, ESP_GATT_OK, &rsp);
 }
 
 void gatts_write(esp_gatt_if_t gatts_if, struct gatts_write_evt_param write)
 {
-    ble_event_t ble_event;
-    if (write.handle == lora_handle_table[LORA_IDX_CHAR_VAL_PERIOD]) {
-        uint16_t val;
-        memcpy(&val, write.value, sizeof(uint16_t));
-        nvs_set_u16(storage, STORAGE_KEY_PERIOD, val);
-        ble_event = BLE_EVENT_PERIOD_UPDATE;
-        xQueueSend(ble_event_queue, &ble_event, 0);
-    } else if (write.handle == lora_handle_table[LORA_IDX_CHAR_VAL_JOIN_EUI]) {
-        nvs_set_blob(storage, STORAGE_KEY_LORA_JOIN_EUI, write.value, 8 * sizeof(uint8_t));
-        ble_event = BLE_EVENT_LORA_UPDATED;
-        xQueueSend(ble_event_queue, &ble_event, 0);
-    } else if (write.handle == lora_handle_table[LORA_IDX_CHAR_VAL_DEV_EUI]) {
-        nvs_set_blob(storage, STORAGE_KEY_LORA_DEV_EUI, write.value, 8 * sizeof(uint8_t));
-        ble_event = BLE_EVENT_LORA_UPDATED;
-        xQueueSend(ble_event_queue, &ble_event, 0);
-    } else if (write.handle == lora_handle_table[LORA_IDX_CHAR_VAL_APP_KEY]) {
-        nvs_set_blob(storage, STORAGE_KEY_LORA_APP_KEY, write.value, 16 * sizeof(uint8_t));
-        ble_event = BLE_EVENT_LORA_UPDATED;
-        xQueueSend(ble_event_queue, &ble_event, 0);
-    } else if (write.handle == lora_handle_table[LORA_IDX_CHAR_VAL_NWK_KEY]) {
-        nvs_set_blob(storage, STORAGE_KEY_LORA_NWK_KEY, write.value, 16 * sizeof(uint8_t));
-        ble_event = BLE_EVENT_LORA_UPDATED;
-        xQueueSend(ble_event_queue, &ble_event, 0);
-    } else if (write.handle == lora_handle_table[LORA_IDX_CHAR_VAL_PAYL_FMT]) {
-        uint8_t val;
-        memcpy(&val, write.value, sizeof(uint8_t));
-        nvs_set_u8(storage, STORAGE_KEY_PAYL_FMT, val);
-    } else if (write.handle == lora_handle_table[LORA_IDX_CHAR_VAL_CONFM]) {
-        uint8_t val;
-        memcpy(&val, write.value, sizeof(uint8_t));
-        nvs_set_u8(storage, STORAGE_KEY_CONFM, val);
+    esp_gatt_status_t status = ESP_GATT_OK;
+    int chr = lora_char_find(write.handle);
+    if (chr >= 0 && !ble_gatt_write(chr, write.value, write.len)) {
+        status = ESP_GATT_INVALID_ATTR_LEN;
     }
 
     if (write.need_rsp) {
@@ -349,11 +474,23 @@ void gatts_write(esp_gatt_if_t gatts_if, struct gatts_write_evt_param write)
             gatt_rsp.attr_value.offset = write.offset;
             memcpy(gatt_rsp.attr_value.value, write.value, write.len);
             gatt_rsp.attr_value.auth_req = ESP_GATT_AUTH_REQ_NONE;
-            esp_ble_gatts_send_response(gatts_if, write.conn_id, write.trans_id, ESP_GATT_OK, &gatt_rsp);
+            esp_ble_gatts_send_response(gatts_if, write.conn_id, write.trans_id, status, &gatt_rsp);
         } else {
-            esp_ble_gatts_send_response(gatts_if, write.conn_id, write.trans_id, ESP_GATT_OK, NULL);
+            esp_ble_gatts_send_response(gatts_if, write.conn_id, write.trans_id, status, NULL);
         }
     }
+
+    if (chr == BLE_CHAR_HISTORY && status == ESP_GATT_OK) {
+        history_pump();
+    }
+}
+
+static void start_advertising()
+{
+    if (!advertising) {
+        advertising = true;
+        esp_ble_gap_start_advertising(&adv_params);
+    }
 }
 
 void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param)
@@ -365,6 +502,8 @@ void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp
             ble_gatts_if = gatts_if;
             esp_ble_gap_set_device_name(DEVICE_NAME);
 
+            adv_data.manufacturer_len = BLE_BEACON_DATA_LEN;
+            adv_data.p_manufacturer_data = ble_gatt_beacon_data();
             esp_ble_gap_config_adv_data(&adv_data);
             adv_config_done |= ADV_CONFIG_FLAG;
 
@@ -392,15 +531,34 @@ void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp
         case ESP_GATTS_CONNECT_EVT:
             ble_connection_id = param->connect.conn_id;
             ble_has_connection = true;
+            advertising = false; // stopped by the connection
             ble_event = BLE_EVENT_CONNECT;
             xQueueSend(ble_event_queue, &ble_event, 0);
             break;
         case ESP_GATTS_DISCONNECT_EVT:
             ble_has_connection = false;
-            esp_ble_gap_start_advertising(&adv_params);
+            ble_mtu = 23;
+            ble_gatt_history_stop();
+            history_in_flight = 0;
+            history_congested = false;
+            start_advertising();
             ble_event = BLE_EVENT_DISCONNECT;
             xQueueSend(ble_event_queue, &ble_event, 0);
             break;
+        case ESP_GATTS_MTU_EVT:
+            ble_mtu = param->mtu.mtu;
+            break;
+        case ESP_GATTS_CONF_EVT:
+            // notification handed to the link layer
+            if (param->conf.handle == lora_handle_table[LORA_IDX_CHAR_VAL_HISTORY] && history_in_flight > 0) {
+                history_in_flight--;
+                history_pump();
+            }
+            break;
+        case ESP_GATTS_CONGEST_EVT:
+            history_congested = param->congest.congested;
+            history_pump();
+            break;
         case ESP_GATTS_READ_EVT:
             gatts_read(gatts_if, param->read);
             break;
@@ -419,13 +577,35 @@ void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
         case ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT:
             adv_config_done &= (~SCAN_RSP_CONFIG_FLAG);
             if (adv_config_done == 0) {
-                esp_ble_gap_start_advertising(&adv_params);
+                start_advertising();
             }
             break;
         case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
             adv_config_done &= (~ADV_CONFIG_FLAG);
             if (adv_config_done == 0) {
-                esp_ble_gap_start_advertising(&adv_params);
+                start_advertising();
+            }
+            break;
+        case ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT:
+            if (param->adv_data_raw_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(TAG, "Beacon data not set, status %d", param->adv_data_raw_cmpl.status);
+                beacon_started = false;
+                xSemaphoreGive(beacon_started_sem);
+                break;
+            }
+            esp_ble_gap_start_advertising(&beacon_params);
+            break;
+        case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
+            if (param->adv_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(TAG, "Advertising not started, status %d", param->adv_start_cmpl.status);
+            }
+            if (beacon_started_sem) {
+                beacon_started = param->adv_start_cmpl.status == ESP_BT_STATUS_SUCCESS;
+                xSemaphoreGive(beacon_started_sem);
+            } else if (param->adv_start_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+                ble_gatt_init_done("Bluedroid");
+            } else {
+                advertising = false;
             }
             break;
         default:
@@ -433,10 +613,8 @@ void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
     }
 }
 
-void ble_init()
+static void stack_start()
 {
-    ble_event_queue = xQueueCreate(5, sizeof(ble_event_t));
-
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
 
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT()
@@ -448,6 +626,26 @@ void ble_init()
 
     ESP_ERROR_CHECK(esp_bluedroid_init());
     ESP_ERROR_CHECK(esp_bluedroid_enable());
+}
+
+static void stack_stop()
+{
+    ESP_ERROR_CHECK(esp_bluedroid_disable());
+    ESP_ERROR_CHECK(esp_bluedroid_deinit());
+
+    ESP_ERROR_CHECK(esp_bt_controller_disable());
+
+    ESP_ERROR_CHECK(esp_bt_controller_deinit());
+
+//    ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_IDLE));
+}
+
+void ble_init()
+{
+    ble_gatt_init_begin();
+    ble_event_queue = xQueueCreate(5, sizeof(ble_event_t));
+
+    stack_start();
 
     ESP_ERROR_CHECK(esp_ble_gatts_register_callback(gatts_event_handler));
     ESP_ERROR_CHECK(esp_ble_gap_register_callback(gap_event_handler));
@@ -467,15 +665,9 @@ void ble_deinit()
 {
     ESP_ERROR_CHECK(esp_ble_gatts_app_unregister(ble_gatts_if));
     ble_gatts_if = 0;
+    advertising = false;
 
-    ESP_ERROR_CHECK(esp_bluedroid_disable());
-    ESP_ERROR_CHECK(esp_bluedroid_deinit());
-
-    ESP_ERROR_CHECK(esp_bt_controller_disable());
-
-    ESP_ERROR_CHECK(esp_bt_controller_deinit());
-
-//    ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_IDLE));
+    stack_stop();
 
     vQueueDelete(ble_event_queue);
 }
@@ -511,4 +703,49 @@ void ble_set_enviromental(float humidity, float temperature)
         esp_ble_gatts_send_indicate(ble_gatts_if, ble_connection_id, env_sens_handle_table[ENV_SENS_IDX_CHAR_VAL_TEMP],
                 sizeof(int16_t), (uint8_t*) &temp_val, false);
     }
+
+    // latest values in manufacturer data, the controller takes new data while advertising
+    ble_gatt_beacon_update(humidity, temperature, bat_lvl_val);
+    if (ble_has_context() && !ble_has_connection) {
+        esp_ble_gap_config_adv_data(&adv_data);
+    }
 }
+
+#ifdef CONFIG_BLE_BEACON
+void ble_beacon(float humidity, float temperature, uint8_t battery)
+{
+    // no name and services, non-connectable beacon carries only the measurement
+    uint8_t raw_data[5 + BLE_BEACON_DATA_LEN] = {
+            2, ESP_BLE_AD_TYPE_FLAG, ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT,
+            BLE_BEACON_DATA_LEN + 1, ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE
+    };
+    ble_gatt_beacon_update(humidity, temperature, battery);
+    memcpy(&raw_data[5], ble_gatt_beacon_data(), BLE_BEACON_DATA_LEN);
+
+    beacon_started_sem = xSemaphoreCreateBinary();
+
+    stack_start();
+    ESP_ERROR_CHECK(esp_ble_gap_register_callback(gap_event_handler));
+    ESP_ERROR_CHECK(esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_DEFAULT, ESP_PWR_LVL_N12));
+    ESP_ERROR_CHECK(esp_ble_gap_config_adv_data_raw(raw_data, sizeof(raw_data)));
+
+    if (!xSemaphoreTake(beacon_started_sem, BEACON_START_TIMEOUT / portTICK_PERIOD_MS)) {
+        ESP_LOGE(TAG, "Beacon not started in %d ms", BEACON_START_TIMEOUT);
+        beacon_started = false;
+    }
+    if (beacon_started) {
+        vTaskDelay(CONFIG_BLE_BEACON_DURATION / portTICK_PERIOD_MS);
+        ESP_ERROR_CHECK(esp_ble_gap_stop_advertising());
+    }
+
+    stack_stop();
+
+    vSemaphoreDelete(beacon_started_sem);
+    beacon_started_sem = NULL;
+    if (beacon_started) {
+        ESP_LOGI(TAG, "Beacon sent");
+    }
+}
+#endif /* CONFIG_BLE_BEACON */
+
+#endif /* CONFIG_BT_BLUEDROID_ENABLED */
@@ -0,0 +1,291 @@
+#include <string.h>
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "ble.h"
+#include "ble_gatt.h"
+#include "settings.h"
+#include "budget.h"
+#include "history.h"
+
+static const char *TAG = "ble_gatt";
+
+QueueHandle_t ble_event_queue;
+
+static RTC_DATA_ATTR uint16_t beacon_seq = 0;
+static RTC_DATA_ATTR uint8_t beacon_data[BLE_BEACON_DATA_LEN] = { BLE_BEACON_COMPANY_ID & 0xFF, BLE_BEACON_COMPANY_ID >> 8 };
+
+static bool history_active = false;
+static uint32_t history_next;
+
+static int64_t init_begin_time;
+static uint32_t init_begin_heap;
+
+static uint16_t write_len(ble_char_t chr)
+{
+    switch (chr) {
+        case BLE_CHAR_PERIOD:
+            return sizeof(uint16_t);
+        case BLE_CHAR_JOIN_EUI:
+        case BLE_CHAR_DEV_EUI:
+            return SETTINGS_EUI_LEN;
+        case BLE_CHAR_APP_KEY:
+        case BLE_CHAR_NWK_KEY:
+            return SETTINGS_KEY_LEN;
+        case BLE_CHAR_PAYL_FMT:
+        case BLE_CHAR_CONFM:
+        case BLE_CHAR_BATCH:
+        case BLE_CHAR_BAT_PERIOD:
+        case BLE_CHAR_LINK_ADAPT:
+            return sizeof(uint8_t);
+        case BLE_CHAR_DEADBAND:
+            return 3 * sizeof(uint16_t);
+        case BLE_CHAR_BUDGET:
+            return 2 * sizeof(uint16_t);
+        case BLE_CHAR_HISTORY:
+            return sizeof(uint32_t);
+        default:
+            return UINT16_MAX;  // read only
+    }
+}
+
+uint16_t ble_gatt_read(ble_char_t chr, uint8_t value[BLE_GATT_VALUE_MAX])
+{
+    const settings_t *settings = settings_get();
+
+    switch (chr) {
+        case BLE_CHAR_PERIOD:
+            memcpy(value, &settings->period, sizeof(uint16_t));
+            return sizeof(uint16_t);
+        case BLE_CHAR_JOIN_EUI:
+            memcpy(value, settings->join_eui, SETTINGS_EUI_LEN);
+            return SETTINGS_EUI_LEN;
+        case BLE_CHAR_DEV_EUI:
+            memcpy(value, settings->dev_eui, SETTINGS_EUI_LEN);
+            return SETTINGS_EUI_LEN;
+        case BLE_CHAR_APP_KEY:
+            memcpy(value, settings->app_key, SETTINGS_KEY_LEN);
+            return SETTINGS_KEY_LEN;
+        case BLE_CHAR_NWK_KEY:
+            memcpy(value, settings->nwk_key, SETTINGS_KEY_LEN);
+            return SETTINGS_KEY_LEN;
+        case BLE_CHAR_PAYL_FMT:
+            value[0] = settings->payl_fmt;
+            return sizeof(uint8_t);
+        case BLE_CHAR_CONFM:
+            value[0] = settings->confm;
+            value[1] = settings->confm_param;
+            return 2 * sizeof(uint8_t);
+        case BLE_CHAR_BATCH:
+            value[0] = settings->batch;
+            return sizeof(uint8_t);
+        case BLE_CHAR_DEADBAND:
+            memcpy(&value[0], &settings->deadband_hum, sizeof(uint16_t));
+            memcpy(&value[2], &settings->deadband_temp, sizeof(uint16_t));
+            memcpy(&value[4], &settings->heartbeat, sizeof(uint16_t));
+            return 3 * sizeof(uint16_t);
+        case BLE_CHAR_BAT_PERIOD:
+            memcpy(value, settings->period_breakpoints, sizeof(settings->period_breakpoints));
+            return sizeof(settings->period_breakpoints);
+        case BLE_CHAR_LINK_ADAPT:
+            value[0] = settings->link_adapt;
+            return sizeof(uint8_t);
+        case BLE_CHAR_BUDGET:
+            // capacity and lifetime settings followed by the current decision
+            memcpy(&value[0], &settings->capacity, sizeof(uint16_t));
+            memcpy(&value[2], &settings->lifetime, sizeof(uint16_t));
+            memcpy(&value[4], budget_get(), sizeof(budget_status_t));
+            return 2 * sizeof(uint16_t) + sizeof(budget_status_t);
+        case BLE_CHAR_PROFILER:
+            profiler_get_stats((profiler_stats_t*) value);
+            return PROFILER_PHASE_NB * sizeof(profiler_stats_t);
+        case BLE_CHAR_HISTORY: {
+            // first available and next record index, current RTC time, record size
+            uint32_t first = history_first();
+            uint32_t count = history_count();
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            uint32_t time = now.tv_sec;
+            memcpy(&value[0], &first, sizeof(uint32_t));
+            memcpy(&value[4], &count, sizeof(uint32_t));
+            memcpy(&value[8], &time, sizeof(uint32_t));
+            value[12] = sizeof(history_record_t);
+            return 3 * sizeof(uint32_t) + sizeof(uint8_t);
+        }
+        default:
+            return 0;
+    }
+}
+
+bool ble_gatt_write(ble_char_t chr, const uint8_t *value, uint16_t len)
+{
+    ble_event_t ble_event;
+
+    if (len < write_len(chr)) {
+        ESP_LOGW(TAG, "Invalid write length %d of characteristic %d", len, chr);
+        return false;
+    }
+
+    switch (chr) {
+        case BLE_CHAR_PERIOD: {
+            uint16_t val;
+            memcpy(&val, value, sizeof(uint16_t));
+            if (!settings_period_valid(val)) {
+                return false;
+            }
+            settings_set_period(val);
+            ble_event = BLE_EVENT_PERIOD_UPDATE;
+            xQueueSend(ble_event_queue, &ble_event, 0);
+            break;
+        }
+        case BLE_CHAR_JOIN_EUI:
+            settings_set_join_eui(value);
+            ble_event = BLE_EVENT_LORA_UPDATED;
+            xQueueSend(ble_event_queue, &ble_event, 0);
+            break;
+        case BLE_CHAR_DEV_EUI:
+            settings_set_dev_eui(value);
+            ble_event = BLE_EVENT_LORA_UPDATED;
+            xQueueSend(ble_event_queue, &ble_event, 0);
+            break;
+        case BLE_CHAR_APP_KEY:
+            settings_set_app_key(value);
+            ble_event = BLE_EVENT_LORA_UPDATED;
+            xQueueSend(ble_event_queue, &ble_event, 0);
+            break;
+        case BLE_CHAR_NWK_KEY:
+            settings_set_nwk_key(value);
+            ble_event = BLE_EVENT_LORA_UPDATED;
+            xQueueSend(ble_event_queue, &ble_event, 0);
+            break;
+        case BLE_CHAR_PAYL_FMT:
+            if (!settings_payl_fmt_valid(value[0])) {
+                return false;
+            }
+            settings_set_payl_fmt(value[0]);
+            break;
+        case BLE_CHAR_CONFM:
+            // policy, optionally followed by its parameter
+            if (!settings_confm_valid(value[0])) {
+                return false;
+            }
+            settings_set_confm(value[0], len > 1 ? value[1] : 0);
+            break;
+        case BLE_CHAR_BATCH:
+            if (!settings_batch_valid(value[0])) {
+                return false;
+            }
+            settings_set_batch(value[0]);
+            break;
+        case BLE_CHAR_DEADBAND: {
+            uint16_t val[3];
+            memcpy(val, value, 3 * sizeof(uint16_t));
+            settings_set_deadband(val[0], val[1], val[2]);
+            break;
+        }
+        case BLE_CHAR_BAT_PERIOD: {
+            period_breakpoint_t val[PERIOD_BREAKPOINTS] = { 0 };
+            memcpy(val, value, len < sizeof(val) ? len : sizeof(val));
+            if (!period_breakpoints_valid(val)) {
+                return false;
+            }
+            settings_set_period_breakpoints(val);
+            break;
+        }
+        case BLE_CHAR_LINK_ADAPT:
+            if (!settings_link_adapt_valid(value[0])) {
+                return false;
+            }
+            settings_set_link_adapt(value[0]);
+            break;
+        case BLE_CHAR_BUDGET: {
+            uint16_t val[2];
+            memcpy(val, value, 2 * sizeof(uint16_t));
+            if (!budget_set(val[0], val[1])) {
+                return false;
+            }
+            // budget may have stretched the period, the timer has to follow
+            ble_event = BLE_EVENT_PERIOD_UPDATE;
+            xQueueSend(ble_event_queue, &ble_event, 0);
+            break;
+        }
+        case BLE_CHAR_HISTORY: {
+            // (re)start the stream from the requested record, older than stored starts from the first one
+            uint32_t first = history_first();
+            memcpy(&history_next, value, sizeof(uint32_t));
+            if (history_next < first) {
+                history_next = first;
+            }
+            history_active = true;
+            ESP_LOGI(TAG, "History from %d to %d", history_next, history_count());
+            break;
+        }
+        default:
+            return false;
+    }
+    return true;
+}
+
+uint16_t ble_gatt_history_chunk(uint8_t value[BLE_HISTORY_CHUNK_MAX], uint16_t max, uint16_t *records)
+{
+    if (!history_active) {
+        return 0;
+    }
+
+    if (max > BLE_HISTORY_CHUNK_MAX) {
+        max = BLE_HISTORY_CHUNK_MAX;
+    }
+    memcpy(value, &history_next, sizeof(uint32_t));
+    *records = history_read(history_next, (history_record_t*) &value[4], (max - sizeof(uint32_t)) / sizeof(history_record_t));
+    return sizeof(uint32_t) + *records * sizeof(history_record_t);
+}
+
+void ble_gatt_history_sent(uint16_t records)
+{
+    if (records == 0) {
+        history_active = false; // end of stream sent
+        ESP_LOGI(TAG, "History done at %d", history_next);
+    }
+    history_next += records;
+}
+
+void ble_gatt_history_stop()
+{
+    history_active = false;
+}
+
+void ble_gatt_beacon_update(float humidity, float temperature, uint8_t battery)
+{
+    uint16_t hum = humidity * 100;
+    int16_t temp = temperature * 100;
+
+    beacon_seq++;
+    memcpy(&beacon_data[2], &beacon_seq, sizeof(uint16_t));
+    memcpy(&beacon_data[4], &hum, sizeof(uint16_t));
+    memcpy(&beacon_data[6], &temp, sizeof(int16_t));
+    beacon_data[8] = battery;
+}
+
+uint8_t* ble_gatt_beacon_data()
+{
+    return beacon_data;
+}
+
+void ble_gatt_init_begin()
+{
+    init_begin_time = esp_timer_get_time();
+    init_begin_heap = esp_get_free_heap_size();
+}
+
+void ble_gatt_init_done(const char *stack)
+{
+    if (init_begin_time == 0) {
+        return; // advertising restarted after disconnect
+    }
+    ESP_LOGI(TAG, "%s ready in %lld ms, heap used %d B", stack, (esp_timer_get_time() - init_begin_time) / 1000,
+            (int) (init_begin_heap - esp_get_free_heap_size()));
+    init_begin_time = 0;
+}
@@ -0,0 +1,58 @@
+#ifndef BLE_GATT_H_
+#define BLE_GATT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "profiler.h"
+
+// LoRa service characteristics, common for both BLE stacks
+typedef enum
+{
+    BLE_CHAR_PERIOD,
+    BLE_CHAR_JOIN_EUI,
+    BLE_CHAR_DEV_EUI,
+    BLE_CHAR_APP_KEY,
+    BLE_CHAR_NWK_KEY,
+    BLE_CHAR_PAYL_FMT,
+    BLE_CHAR_CONFM,
+    BLE_CHAR_BATCH,
+    BLE_CHAR_DEADBAND,
+    BLE_CHAR_BAT_PERIOD,
+    BLE_CHAR_LINK_ADAPT,
+    BLE_CHAR_BUDGET,
+    BLE_CHAR_PROFILER,
+    BLE_CHAR_HISTORY,
+    BLE_CHAR_NB
+} ble_char_t;
+
+// longest characteristic value (profiler)
+#define BLE_GATT_VALUE_MAX  (PROFILER_PHASE_NB * sizeof(profiler_stats_t))
+
+// history stream notification: index of first record uint32 followed by records, index alone ends the stream
+#define BLE_HISTORY_CHUNK_MAX   497 // local MTU - 3
+#define BLE_HISTORY_WINDOW      4   // notifications handed to the stack and not yet sent
+
+// manufacturer specific advertising data: company id, sequence, humidity, temperature, battery
+#define BLE_BEACON_COMPANY_ID   0xFFFF  // reserved for testing, no company identifier assigned
+#define BLE_BEACON_DATA_LEN     9
+
+uint16_t ble_gatt_read(ble_char_t chr, uint8_t value[BLE_GATT_VALUE_MAX]);
+
+bool ble_gatt_write(ble_char_t chr, const uint8_t *value, uint16_t len);
+
+uint16_t ble_gatt_history_chunk(uint8_t value[BLE_HISTORY_CHUNK_MAX], uint16_t max, uint16_t *records);
+
+void ble_gatt_history_sent(uint16_t records);
+
+void ble_gatt_history_stop();
+
+void ble_gatt_beacon_update(float humidity, float temperature, uint8_t battery);
+
+uint8_t* ble_gatt_beacon_data();
+
+void ble_gatt_init_begin();
+
+void ble_gatt_init_done(const char *stack);
+
+#endif /* BLE_GATT_H_ */
@@ -0,0 +1,386 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_BT_NIMBLE_ENABLED
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_bt.h"
+#include "esp_nimble_hci.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+#include "host/ble_hs.h"
+#include "services/gap/ble_svc_gap.h"
+#include "services/gatt/ble_svc_gatt.h"
+
+#include "ble.h"
+#include "ble_gatt.h"
+
+static const char *TAG = "ble";
+
+#define DEVICE_NAME "ESP32 LoRa Sensor"
+
+#define ADV_INTERVAL    0x0800  // 1.28 s
+#define BEACON_INTERVAL 0x0020  // 20 ms
+#define BEACON_START_TIMEOUT 1000 // ms, host sync until advertising runs
+
+static uint8_t own_addr_type;
+static bool ble_synced = false;
+#ifdef CONFIG_BLE_BEACON
+static SemaphoreHandle_t beacon_done_sem;
+static bool beacon_started;
+#endif /* CONFIG_BLE_BEACON */
+
+static uint8_t bat_lvl_val = 0;
+static uint16_t bat_lvl_handle;
+
+static uint16_t hum_val = 0;
+static uint16_t hum_handle;
+
+static int16_t temp_val = 0;
+static uint16_t temp_handle;
+
+static uint16_t history_handle;
+static uint16_t history_conn_handle;
+static uint8_t history_in_flight = 0;
+
+static void history_pump()
+{
+    uint8_t value[BLE_HISTORY_CHUNK_MAX];
+    uint16_t len, records;
+
+    while (history_in_flight < BLE_HISTORY_WINDOW
+            && (len = ble_gatt_history_chunk(value, ble_att_mtu(history_conn_handle) - 3, &records)) > 0) {
+        struct os_mbuf *om = ble_hs_mbuf_from_flat(value, len);
+        if (om == NULL || ble_gattc_notify_custom(history_conn_handle, history_handle, om) != 0) {
+            break; // out of buffers, continues when some notification is sent
+        }
+        ble_gatt_history_sent(records);
+        history_in_flight++;
+    }
+}
+
+static int lora_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    ble_char_t chr = (ble_char_t) arg;
+    uint8_t value[BLE_GATT_VALUE_MAX];
+    uint16_t len;
+
+    switch (ctxt->op) {
+        case BLE_GATT_ACCESS_OP_READ_CHR:
+            // long reads are split by the host, whole value is appended every time
+            len = ble_gatt_read(chr, value);
+            return os_mbuf_append(ctxt->om, value, len) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+        case BLE_GATT_ACCESS_OP_WRITE_CHR:
+            if (ble_hs_mbuf_to_flat(ctxt->om, value, sizeof(value), &len) != 0) {
+                return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            }
+            if (!ble_gatt_write(chr, value, len)) {
+                return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            }
+            if (chr == BLE_CHAR_HISTORY) {
+                history_conn_handle = conn_handle;
+                history_pump();
+            }
+            return 0;
+        default:
+            return BLE_ATT_ERR_UNLIKELY;
+    }
+}
+
+static int value_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    uint16_t len = attr_handle == bat_lvl_handle ? sizeof(uint8_t) : sizeof(uint16_t);
+    return os_mbuf_append(ctxt->om, arg, len) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+#define LORA_CHAR(uuid16, chr, chr_flags) { .uuid = BLE_UUID16_DECLARE(uuid16), .access_cb = lora_access, .arg = (void*) (chr), .flags = chr_flags }
+
+// @formatter:off
+static const struct ble_gatt_chr_def lora_chars[] = {
+        LORA_CHAR(0xC901, BLE_CHAR_PERIOD,      BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC902, BLE_CHAR_JOIN_EUI,    BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC903, BLE_CHAR_DEV_EUI,     BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC904, BLE_CHAR_APP_KEY,     BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC905, BLE_CHAR_NWK_KEY,     BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC907, BLE_CHAR_PAYL_FMT,    BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC908, BLE_CHAR_CONFM,       BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC909, BLE_CHAR_PROFILER,    BLE_GATT_CHR_F_READ),
+        LORA_CHAR(0xC90A, BLE_CHAR_BATCH,       BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC90B, BLE_CHAR_DEADBAND,    BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC90C, BLE_CHAR_BAT_PERIOD,  BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC90D, BLE_CHAR_LINK_ADAPT,  BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        LORA_CHAR(0xC90E, BLE_CHAR_BUDGET,      BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE),
+        { .uuid = BLE_UUID16_DECLARE(0xC90F), .access_cb = lora_access, .arg = (void*) BLE_CHAR_HISTORY, .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_NOTIFY, .val_handle = &history_handle },
+        { 0 }
+};
+
+static const struct ble_gatt_chr_def env_sens_chars[] = {
+        { .uuid = BLE_UUID16_DECLARE(0x2A6F), .access_cb = value_access, .arg = &hum_val, .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY, .val_handle = &hum_handle },
+        { .uuid = BLE_UUID16_DECLARE(0x2A6E), .access_cb = value_access, .arg = &temp_val, .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY, .val_handle = &temp_handle },
+        { 0 }
+};
+
+static const struct ble_gatt_chr_def bat_serv_chars[] = {
+        { .uuid = BLE_UUID16_DECLARE(0x2A19), .access_cb = value_access, .arg = &bat_lvl_val, .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY, .val_handle = &bat_lvl_handle },
+        { 0 }
+};
+
+static const struct ble_gatt_svc_def services[] = {
+        { .type = BLE_GATT_SVC_TYPE_PRIMARY, .uuid = BLE_UUID16_DECLARE(0xC800), .characteristics = lora_chars },
+        { .type = BLE_GATT_SVC_TYPE_PRIMARY, .uuid = BLE_UUID16_DECLARE(0x181A), .characteristics = env_sens_chars },
+        { .type = BLE_GATT_SVC_TYPE_PRIMARY, .uuid = BLE_UUID16_DECLARE(0x180F), .characteristics = bat_serv_chars },
+        { 0 }
+};
+
+static ble_uuid16_t service_uuids[] = {
+        BLE_UUID16_INIT(0xC800), BLE_UUID16_INIT(0x181A), BLE_UUID16_INIT(0x180F)
+};
+
+static const struct ble_gap_adv_params adv_params = {
+        .conn_mode = BLE_GAP_CONN_MODE_UND,
+        .disc_mode = BLE_GAP_DISC_MODE_GEN,
+        .itvl_min = ADV_INTERVAL,
+        .itvl_max = ADV_INTERVAL,
+};
+
+#ifdef CONFIG_BLE_BEACON
+static const struct ble_gap_adv_params beacon_params = {
+        .conn_mode = BLE_GAP_CONN_MODE_NON,
+        .disc_mode = BLE_GAP_DISC_MODE_GEN,
+        .itvl_min = BEACON_INTERVAL,
+        .itvl_max = BEACON_INTERVAL,
+};
+#endif /* CONFIG_BLE_BEACON */
+// @formatter:on
+
+_Static_assert(sizeof(lora_chars) / sizeof(lora_chars[0]) == BLE_CHAR_NB + 1, "LoRa service does not match characteristics");
+
+static int gap_event_handler(struct ble_gap_event *event, void *arg);
+
+static int adv_fields_set()
+{
+    struct ble_hs_adv_fields fields;
+    memset(&fields, 0, sizeof(fields));
+    fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
+    fields.tx_pwr_lvl_is_present = 1;
+    fields.tx_pwr_lvl = BLE_HS_ADV_TX_PWR_LVL_AUTO;
+    fields.uuids16 = service_uuids;
+    fields.num_uuids16 = sizeof(service_uuids) / sizeof(service_uuids[0]);
+    fields.uuids16_is_complete = 1;
+    fields.mfg_data = ble_gatt_beacon_data();
+    fields.mfg_data_len = BLE_BEACON_DATA_LEN;
+    return ble_gap_adv_set_fields(&fields);
+}
+
+static void advertise()
+{
+    // name does not fit together with services to advertising data
+    struct ble_hs_adv_fields rsp_fields;
+    memset(&rsp_fields, 0, sizeof(rsp_fields));
+    rsp_fields.name = (uint8_t*) DEVICE_NAME;
+    rsp_fields.name_len = strlen(DEVICE_NAME);
+    rsp_fields.name_is_complete = 1;
+
+    // NimBLE return codes are not esp_err_t, a failed start leaves the node without GATT until the connection timeout
+    int rc = adv_fields_set();
+    if (rc == 0) {
+        rc = ble_gap_adv_rsp_set_fields(&rsp_fields);
+    }
+    if (rc == 0) {
+        rc = ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER, &adv_params, gap_event_handler, NULL);
+    }
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Advertising not started, error %d", rc);
+    }
+}
+
+static int gap_event_handler(struct ble_gap_event *event, void *arg)
+{
+    ESP_LOGD(TAG, "Gap event handler [event: %d]", event->type);
+    ble_event_t ble_event;
+    switch (event->type) {
+        case BLE_GAP_EVENT_CONNECT:
+            if (event->connect.status == 0) {
+                ble_event = BLE_EVENT_CONNECT;
+                xQueueSend(ble_event_queue, &ble_event, 0);
+            } else {
+                advertise();
+            }
+            break;
+        case BLE_GAP_EVENT_DISCONNECT:
+            ble_gatt_history_stop();
+            history_in_flight = 0;
+            advertise();
+            ble_event = BLE_EVENT_DISCONNECT;
+            xQueueSend(ble_event_queue, &ble_event, 0);
+            break;
+        case BLE_GAP_EVENT_ADV_COMPLETE:
+            advertise();
+            break;
+        case BLE_GAP_EVENT_NOTIFY_TX:
+            if (event->notify_tx.attr_handle == history_handle && history_in_flight > 0) {
+                history_in_flight--;
+                history_pump();
+            }
+            break;
+        case BLE_GAP_EVENT_MTU:
+            ESP_LOGI(TAG, "MTU %d", event->mtu.value);
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+static void on_sync()
+{
+    ESP_ERROR_CHECK(ble_hs_id_infer_auto(0, &own_addr_type));
+    advertise();
+    ble_synced = true;
+    ble_gatt_init_done("NimBLE");
+}
+
+static void on_reset(int reason)
+{
+    ESP_LOGW(TAG, "Host reset [reason: %d]", reason);
+}
+
+#ifdef CONFIG_BLE_BEACON
+static int beacon_event_handler(struct ble_gap_event *event, void *arg)
+{
+    if (event->type == BLE_GAP_EVENT_ADV_COMPLETE) {
+        xSemaphoreGive(beacon_done_sem);
+    }
+    return 0;
+}
+
+static void on_beacon_sync()
+{
+    // no name and services, non-connectable beacon carries only the measurement
+    struct ble_hs_adv_fields fields;
+    memset(&fields, 0, sizeof(fields));
+    fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
+    fields.mfg_data = ble_gatt_beacon_data();
+    fields.mfg_data_len = BLE_BEACON_DATA_LEN;
+
+    int rc = ble_hs_id_infer_auto(0, &own_addr_type);
+    if (rc == 0) {
+        rc = ble_gap_adv_set_fields(&fields);
+    }
+    if (rc == 0) {
+        rc = ble_gap_adv_start(own_addr_type, NULL, CONFIG_BLE_BEACON_DURATION, &beacon_params, beacon_event_handler, NULL);
+    }
+    beacon_started = rc == 0;
+    if (!beacon_started) {
+        // no completion event follows, the waiting task is released right away
+        ESP_LOGE(TAG, "Beacon not started, error %d", rc);
+        xSemaphoreGive(beacon_done_sem);
+    }
+}
+#endif /* CONFIG_BLE_BEACON */
+
+static void host_task_func(void *param)
+{
+    nimble_port_run();
+    nimble_port_freertos_deinit();
+}
+
+static void host_start(void (*sync_cb)())
+{
+    ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
+    ESP_ERROR_CHECK(esp_nimble_hci_and_controller_init());
+    nimble_port_init();
+
+    ble_hs_cfg.sync_cb = sync_cb;
+    ble_hs_cfg.reset_cb = on_reset;
+}
+
+static void host_stop()
+{
+    ESP_ERROR_CHECK(nimble_port_stop());
+    nimble_port_deinit();
+    ESP_ERROR_CHECK(esp_nimble_hci_and_controller_deinit());
+}
+
+void ble_init()
+{
+    ble_gatt_init_begin();
+    ble_event_queue = xQueueCreate(5, sizeof(ble_event_t));
+
+    host_start(on_sync);
+
+    ble_svc_gap_init();
+    ble_svc_gatt_init();
+    ESP_ERROR_CHECK(ble_gatts_count_cfg(services));
+    ESP_ERROR_CHECK(ble_gatts_add_svcs(services));
+    ESP_ERROR_CHECK(ble_svc_gap_device_name_set(DEVICE_NAME));
+    ESP_ERROR_CHECK(ble_att_set_preferred_mtu(500));
+
+    nimble_port_freertos_init(host_task_func);
+
+    ESP_ERROR_CHECK(esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_DEFAULT, ESP_PWR_LVL_N12));
+}
+
+bool ble_has_context()
+{
+    return ble_synced;
+}
+
+void ble_deinit()
+{
+    ble_synced = false;
+
+    host_stop();
+
+    vQueueDelete(ble_event_queue);
+}
+
+void ble_set_battery(uint8_t battery)
+{
+    bat_lvl_val = battery;
+    ble_gatts_chr_updated(bat_lvl_handle);
+}
+
+void ble_set_enviromental(float humidity, float temperature)
+{
+    hum_val = humidity * 100;
+    temp_val = temperature * 100;
+    ble_gatts_chr_updated(hum_handle);
+    ble_gatts_chr_updated(temp_handle);
+
+    // latest values in manufacturer data, updated also while advertising
+    ble_gatt_beacon_update(humidity, temperature, bat_lvl_val);
+    if (ble_synced) {
+        adv_fields_set();
+    }
+}
+
+#ifdef CONFIG_BLE_BEACON
+void ble_beacon(float humidity, float temperature, uint8_t battery)
+{
+    ble_gatt_beacon_update(humidity, temperature, battery);
+    beacon_done_sem = xSemaphoreCreateBinary();
+    beacon_started = false;
+
+    host_start(on_beacon_sync);
+    nimble_port_freertos_init(host_task_func);
+    ESP_ERROR_CHECK(esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_DEFAULT, ESP_PWR_LVL_N12));
+
+    // completion event may never come, the node has to get to deep sleep anyway
+    if (!xSemaphoreTake(beacon_done_sem, (CONFIG_BLE_BEACON_DURATION + BEACON_START_TIMEOUT) / portTICK_PERIOD_MS)) {
+        ESP_LOGE(TAG, "Beacon not completed in %d ms", CONFIG_BLE_BEACON_DURATION + BEACON_START_TIMEOUT);
+        if (ble_gap_adv_active()) {
+            ble_gap_adv_stop();
+        }
+        beacon_started = false;
+    }
+    host_stop();
+
+    vSemaphoreDelete(beacon_done_sem);
+    if (beacon_started) {
+        ESP_LOGI(TAG, "Beacon sent");
+    }
+}
+#endif /* CONFIG_BLE_BEACON */
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
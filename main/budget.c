@@ -0,0 +1,174 @@
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp32/clk.h"
+
+#include "budget.h"
+#include "battery.h"
+#include "profiler.h"
+#include "settings.h"
+#include "batch.h"
+#include "period.h"
+
+#define BUDGET_BATCH_MAX        8       // more samples rarely fit one uplink
+#define BUDGET_CONFIRM_MAX      16      // confirm at least every Nth uplink before dropping confirmation
+#define BUDGET_PERIOD_MAX       PERIOD_MAX
+
+#define DEFAULT_MEASURE_TIME    300000  // us, until profiler has data
+#define DEFAULT_TX_TIME         100000  // us
+#define DEFAULT_RX_TIME         2000000 // us
+
+#define S_PER_DAY               86400
+#define SAVE_INTERVAL           (6 * 3600) // s, usage lost on power loss is at most this long
+
+static const char *TAG = "budget";
+
+static RTC_DATA_ATTR budget_status_t status = { 0 };
+static RTC_DATA_ATTR uint32_t confirmations = 0;
+
+// usage since the budget was set is kept as a base from NVS plus what was counted since the base was
+// taken; RTC memory is lost on a reset while the RTC time keeps running, so counting starts from the RTC
+// time at which the base was taken, not from power on
+typedef struct
+{
+    bool loaded;
+    uint32_t elapsed_base;      // s
+    uint64_t consumed_base;     // uAh
+    uint32_t rtc_offset;        // s, RTC time when the base was taken
+    uint64_t consumed_offset;   // uAh, charge counter when the base was taken
+    uint32_t saved_elapsed;     // s, last NVS write
+} usage_t;
+
+static RTC_DATA_ATTR usage_t usage = { 0 };
+
+static uint32_t usage_elapsed()
+{
+    return usage.elapsed_base + (uint32_t) (esp_clk_rtc_time() / 1000000) - usage.rtc_offset;
+}
+
+static uint64_t usage_consumed()
+{
+    return usage.consumed_base + battery_consumed() - usage.consumed_offset;
+}
+
+static void usage_load()
+{
+    if (usage.loaded) {
+        return;
+    }
+    memset(&usage, 0, sizeof(usage_t));
+    settings_load_budget_usage(&usage.elapsed_base, &usage.consumed_base);
+    usage.rtc_offset = esp_clk_rtc_time() / 1000000;
+    usage.consumed_offset = battery_consumed();
+    usage.saved_elapsed = usage.elapsed_base;
+    usage.loaded = true;
+}
+
+static void usage_save()
+{
+    uint32_t elapsed = usage_elapsed();
+    if (elapsed - usage.saved_elapsed >= SAVE_INTERVAL) {
+        settings_save_budget_usage(elapsed, usage_consumed());
+        usage.saved_elapsed = elapsed;
+    }
+}
+
+static uint32_t phase_avg(const profiler_stats_t *stats, profiler_phase_t phase, uint32_t fallback)
+{
+    return stats[phase].count ? stats[phase].avg : fallback;
+}
+
+// average current in uA for given decision, energies in nC (mA * us)
+static uint32_t expected_current(uint64_t measure, uint64_t uplink, uint32_t period, uint8_t batch, uint8_t confirm_every)
+{
+    // confirmed uplink waits for the ACK and is occasionally retransmitted, half an uplink extra
+    uint64_t confirm = confirm_every ? uplink / 2 / confirm_every : 0;
+    uint64_t wake = measure + (uplink + confirm) / batch;
+    return BATTERY_CURRENT_SLEEP + wake / period / 1000; // nC / s = nA
+}
+
+void budget_update()
+{
+    const settings_t *settings = settings_get();
+
+    // period is a floor for the effective period, without a budget there is none
+    status.period = 0;
+    status.batch = settings->batch;
+    status.confirm_every = settings->confm != CONFM_NONE ? 1 : 0;
+    status.remaining = 0;
+    status.remaining_days = 0;
+    status.allowed = 0;
+    status.expected = 0;
+
+    if (!settings->capacity || !settings->lifetime) {
+        return;
+    }
+    status.period = settings->period;
+
+    usage_load();
+    usage_save();
+    uint32_t elapsed_days = usage_elapsed() / S_PER_DAY;
+    uint64_t capacity = settings->capacity * 1000ULL;
+    uint64_t consumed = usage_consumed();
+
+    status.remaining = consumed < capacity ? capacity - consumed : 0;
+    status.remaining_days = elapsed_days < settings->lifetime ? settings->lifetime - elapsed_days : 1;
+    uint32_t allowed = status.remaining / (status.remaining_days * 24);
+    status.allowed = allowed > UINT16_MAX ? UINT16_MAX : allowed;
+
+    // per phase energy from measured wake durations
+    profiler_stats_t stats[PROFILER_PHASE_NB];
+    profiler_get_stats(stats);
+    uint64_t measure = (uint64_t) (phase_avg(stats, PROFILER_PHASE_PERIPHERALS_INIT, DEFAULT_MEASURE_TIME)
+            + phase_avg(stats, PROFILER_PHASE_SENSOR_READ, 0)) * BATTERY_CURRENT_ACTIVE;
+    uint64_t uplink = (uint64_t) phase_avg(stats, PROFILER_PHASE_LORA_TX, DEFAULT_TX_TIME) * BATTERY_CURRENT_TX
+            + (uint64_t) phase_avg(stats, PROFILER_PHASE_LORA_RX, DEFAULT_RX_TIME) * BATTERY_CURRENT_ACTIVE;
+
+    // cheapest first: batch more samples, then confirm less often, then stretch the period
+    while (expected_current(measure, uplink, status.period, status.batch, status.confirm_every) > allowed && status.batch < BUDGET_BATCH_MAX) {
+        status.batch++;
+    }
+    while (expected_current(measure, uplink, status.period, status.batch, status.confirm_every) > allowed && status.confirm_every) {
+        status.confirm_every = status.confirm_every < BUDGET_CONFIRM_MAX ? status.confirm_every * 2 : 0;
+    }
+    if (expected_current(measure, uplink, status.period, status.batch, status.confirm_every) > allowed) {
+        uint64_t wake = measure + uplink / status.batch;
+        uint64_t period = allowed > BATTERY_CURRENT_SLEEP ? wake / ((allowed - BATTERY_CURRENT_SLEEP) * 1000ULL) + 1 : BUDGET_PERIOD_MAX;
+        status.period = period > BUDGET_PERIOD_MAX ? BUDGET_PERIOD_MAX : period;
+    }
+    status.expected = expected_current(measure, uplink, status.period, status.batch, status.confirm_every);
+
+    ESP_LOGI(TAG, "Remaining %d uAh for %d days, allowed %d uA, expected %d uA", status.remaining, status.remaining_days, status.allowed, status.expected);
+    ESP_LOGI(TAG, "Period %d s, batch %d, confirm every %d", status.period, status.batch, status.confirm_every);
+}
+
+bool budget_set(uint16_t capacity, uint16_t lifetime)
+{
+    // both zero disables the budget, a capacity without lifetime would divide by zero days
+    if (!capacity != !lifetime) {
+        ESP_LOGW(TAG, "Invalid budget %d mAh for %d days", capacity, lifetime);
+        return false;
+    }
+
+    // a new budget is set for a fresh battery, usage counts from now
+    settings_set_budget(capacity, lifetime);
+    memset(&usage, 0, sizeof(usage_t));
+    usage.loaded = true;
+    usage.rtc_offset = esp_clk_rtc_time() / 1000000;
+    usage.consumed_offset = battery_consumed();
+    settings_save_budget_usage(0, 0);
+
+    ESP_LOGI(TAG, "Budget set to %d mAh for %d days", capacity, lifetime);
+    budget_update();
+    return true;
+}
+
+const budget_status_t* budget_get()
+{
+    return &status;
+}
+
+bool budget_confirm_due()
+{
+    return status.confirm_every && (confirmations++ % status.confirm_every) == 0;
+}
@@ -0,0 +1,26 @@
+#ifndef BUDGET_H_
+#define BUDGET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint16_t period;            // s
+    uint8_t batch;              // samples per uplink
+    uint8_t confirm_every;      // every Nth confirmation asked by the policy is sent, 0 = never
+    uint32_t remaining;         // uAh, 0 when budget is disabled
+    uint16_t remaining_days;
+    uint16_t allowed;           // uA, average current that fits the budget
+    uint16_t expected;          // uA, average current of the decision
+} __attribute__((packed)) budget_status_t;
+
+void budget_update();
+
+bool budget_set(uint16_t capacity, uint16_t lifetime);
+
+const budget_status_t* budget_get();
+
+bool budget_confirm_due();
+
+#endif /* BUDGET_H_ */
@@ -0,0 +1,116 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/i2s.h"
+
+#include "burst.h"
+
+#define BURST_I2S_NUM           I2S_NUM_0
+#define BURST_SAMPLE_RATE       20000   // Hz
+#define BURST_BLOCK_LEN         64      // samples per settling check
+#define BURST_WINDOW_LEN        256     // samples of the settled value
+#define BURST_SETTLE_WINDOW     50      // ms, block mean must not move over this span
+#define BURST_SETTLE_DELTA      8       // raw, max difference of the first and last block mean of the span
+#define BURST_SETTLE_BLOCKS     ((BURST_SETTLE_WINDOW * BURST_SAMPLE_RATE / 1000 + BURST_BLOCK_LEN - 1) / BURST_BLOCK_LEN + 1)
+#define BURST_SETTLE_TIMEOUT    500     // ms
+#define BURST_TRIM              4       // quarter of the window is dropped from each end
+
+static const char *TAG = "burst";
+
+static int compare_u16(const void *a, const void *b)
+{
+    return *(const uint16_t*) a - *(const uint16_t*) b;
+}
+
+static void read_samples(uint16_t *buf, size_t len)
+{
+    size_t read = 0;
+    ESP_ERROR_CHECK(i2s_read(BURST_I2S_NUM, buf, len * sizeof(uint16_t), &read, portMAX_DELAY));
+    for (size_t i = 0; i < len; i++) {
+        buf[i] &= 0x0fff; // upper bits carry the channel number
+    }
+}
+
+static uint32_t block_mean(const uint16_t *buf, size_t len)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < len; i++) {
+        sum += buf[i];
+    }
+    return sum / len;
+}
+
+void burst_read(adc1_channel_t channel, burst_result_t *result)
+{
+    int64_t start = esp_timer_get_time();
+
+// @formatter:off
+    i2s_config_t i2s_config = {
+            .mode = I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN,
+            .sample_rate = BURST_SAMPLE_RATE,
+            .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+            .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+            .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+            .intr_alloc_flags = 0,
+            .dma_buf_count = 4,
+            .dma_buf_len = BURST_BLOCK_LEN,
+            .use_apll = false
+    };
+// @formatter:on
+    ESP_ERROR_CHECK(i2s_driver_install(BURST_I2S_NUM, &i2s_config, 0, NULL));
+    ESP_ERROR_CHECK(i2s_set_adc_mode(ADC_UNIT_1, channel));
+    ESP_ERROR_CHECK(i2s_adc_enable(BURST_I2S_NUM));
+
+    static uint16_t window[BURST_WINDOW_LEN];
+    memset(result, 0, sizeof(burst_result_t));
+
+    // probe output rises after power on, wait until the block mean stops moving over the whole span,
+    // consecutive blocks alone differ too little to catch a slow exponential rise
+    static uint32_t means[BURST_SETTLE_BLOCKS];
+    int blocks = 0;
+    while (!result->settled) {
+        if (esp_timer_get_time() - start > BURST_SETTLE_TIMEOUT * 1000) {
+            break;
+        }
+        read_samples(window, BURST_BLOCK_LEN);
+        result->samples += BURST_BLOCK_LEN;
+
+        means[blocks % BURST_SETTLE_BLOCKS] = block_mean(window, BURST_BLOCK_LEN);
+        blocks++;
+        if (blocks >= BURST_SETTLE_BLOCKS) {
+            uint32_t first = means[blocks % BURST_SETTLE_BLOCKS];
+            uint32_t last = means[(blocks - 1) % BURST_SETTLE_BLOCKS];
+            result->settled = abs((int32_t) last - (int32_t) first) <= BURST_SETTLE_DELTA;
+        }
+    }
+
+    read_samples(window, BURST_WINDOW_LEN);
+    result->samples += BURST_WINDOW_LEN;
+
+    i2s_adc_disable(BURST_I2S_NUM);
+    i2s_driver_uninstall(BURST_I2S_NUM);
+
+    // trimmed mean rejects spikes, deviation of the kept samples is the noise
+    qsort(window, BURST_WINDOW_LEN, sizeof(uint16_t), compare_u16);
+    const uint16_t *kept = &window[BURST_WINDOW_LEN / BURST_TRIM];
+    size_t kept_len = BURST_WINDOW_LEN - 2 * (BURST_WINDOW_LEN / BURST_TRIM);
+    uint32_t mean = block_mean(kept, kept_len);
+
+    uint32_t var = 0;
+    for (size_t i = 0; i < kept_len; i++) {
+        int32_t d = kept[i] - (int32_t) mean;
+        var += d * d;
+    }
+
+    result->value = mean;
+    result->noise = sqrtf((float) var / kept_len);
+    result->time = esp_timer_get_time() - start;
+
+    if (!result->settled) {
+        ESP_LOGW(TAG, "Not settled in %d ms", BURST_SETTLE_TIMEOUT);
+    }
+    ESP_LOGI(TAG, "Value %d noise %d (%d samples, %d us)", result->value, result->noise, result->samples, result->time);
+}
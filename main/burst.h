@@ -0,0 +1,19 @@
+#ifndef BURST_H_
+#define BURST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/adc.h"
+
+typedef struct
+{
+    uint16_t value;     // raw, trimmed mean of the settled window
+    uint16_t noise;     // raw, standard deviation of the settled window
+    uint16_t samples;   // samples taken including the settling
+    uint32_t time;      // us, from start until the value is ready
+    bool settled;       // false when the settling timeout expired
+} burst_result_t;
+
+void burst_read(adc1_channel_t channel, burst_result_t *result);
+
+#endif /* BURST_H_ */
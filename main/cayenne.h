@@ -14,4 +14,14 @@
 #define CAYENNE_LPP_GYROMETER                (134U) /* 2 bytes per axis, 0.01 °/s */
 #define CAYENNE_LPP_GPS                      (136U) /* 3 byte lon/lat 0.0001 °, 3 bytes alt 0.01 meter */
 
+#define CAYENNE_LPP_DIGITAL_INPUT_SIZE       1
+#define CAYENNE_LPP_DIGITAL_OUTPUT_SIZE      1
+#define CAYENNE_LPP_ANALOG_INPUT_SIZE        2
+#define CAYENNE_LPP_ANALOG_OUTPUT_SIZE       2
+#define CAYENNE_LPP_LUMINOSITY_SIZE          2
+#define CAYENNE_LPP_PRESENCE_SIZE            1
+#define CAYENNE_LPP_TEMPERATURE_SIZE         2
+#define CAYENNE_LPP_RELATIVE_HUMIDITY_SIZE   1
+#define CAYENNE_LPP_BAROMETRIC_PRESSURE_SIZE 2
+
 #endif /* CAYENE_H_ */
@@ -0,0 +1,71 @@
+#include "codec.h"
+
+static uint32_t zigzag(int32_t val)
+{
+    return ((uint32_t) val << 1) ^ (uint32_t) (val >> 31);
+}
+
+static size_t varint_len(uint32_t val)
+{
+    size_t len = 1;
+    while (val >= 0x80) {
+        val >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static size_t varint_put(uint8_t *buf, uint32_t val)
+{
+    size_t len = 0;
+    while (val >= 0x80) {
+        buf[len++] = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    buf[len++] = val;
+    return len;
+}
+
+void codec_delta_init(codec_delta_t *codec, uint8_t *buf, size_t size)
+{
+    codec->buf = buf;
+    codec->size = size;
+    codec->len = CODEC_DELTA_HEADER_LEN;
+    codec->count = 0;
+}
+
+bool codec_delta_add(codec_delta_t *codec, const sample_t *sample)
+{
+    uint8_t *p = &codec->buf[codec->len];
+
+    if (codec->count == 0) {
+        if (codec->len + CODEC_DELTA_BASE_LEN > codec->size) {
+            return false;
+        }
+        p[0] = sample->humidity;
+        p[1] = sample->humidity >> 8;
+        p[2] = sample->temperature;
+        p[3] = sample->temperature >> 8;
+        p[4] = sample->battery;
+        codec->len += CODEC_DELTA_BASE_LEN;
+    } else {
+        uint32_t d_humidity = zigzag((int32_t) sample->humidity - codec->last.humidity);
+        uint32_t d_temperature = zigzag((int32_t) sample->temperature - codec->last.temperature);
+        uint32_t d_battery = zigzag((int32_t) sample->battery - codec->last.battery);
+
+        size_t len = varint_len(d_humidity) + varint_len(d_temperature) + varint_len(d_battery);
+        if (codec->len + len > codec->size) {
+            return false;
+        }
+        p += varint_put(p, d_humidity);
+        p += varint_put(p, d_temperature);
+        varint_put(p, d_battery);
+        codec->len += len;
+    }
+
+    codec->last = *sample;
+    codec->count++;
+    codec->buf[0] = codec->count;
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef CODEC_H_
+#define CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "batch.h"
+
+/*
+ * Delta compressed time series:
+ *   [count:u8] [humidity:u16] [temperature:i16] [battery:u8]
+ * followed by count - 1 records of zigzag varint deltas against the previous
+ * sample: [d humidity] [d temperature] [d battery], little endian everywhere.
+ */
+
+#define CODEC_DELTA_HEADER_LEN      1
+#define CODEC_DELTA_BASE_LEN        5
+#define CODEC_DELTA_SAMPLE_MAX_LEN  8 // 3 + 3 + 2 bytes of varint
+
+typedef struct
+{
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    uint8_t count;
+    sample_t last;
+} codec_delta_t;
+
+void codec_delta_init(codec_delta_t *codec, uint8_t *buf, size_t size);
+
+bool codec_delta_add(codec_delta_t *codec, const sample_t *sample);
+
+#endif /* CODEC_H_ */
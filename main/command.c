@@ -0,0 +1,139 @@
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "command.h"
+#include "settings.h"
+#include "budget.h"
+
+static const char *TAG = "command";
+
+static RTC_DATA_ATTR bool ack_pending = false;
+static RTC_DATA_ATTR uint8_t ack_seq;
+static RTC_DATA_ATTR uint8_t ack_status;   // 0 = all applied, otherwise index of the first rejected command + 1
+
+static uint16_t get_u16(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static uint8_t command_len(uint8_t id)
+{
+    switch (id) {
+        case COMMAND_PERIOD:
+            return sizeof(uint16_t);
+        case COMMAND_PAYL_FMT:
+        case COMMAND_BATCH:
+        case COMMAND_LINK_ADAPT:
+            return sizeof(uint8_t);
+        case COMMAND_CONFM:
+            return 2 * sizeof(uint8_t);
+        case COMMAND_DEADBAND:
+            return 3 * sizeof(uint16_t);
+        case COMMAND_BAT_PERIOD:
+            return PERIOD_BREAKPOINTS * sizeof(period_breakpoint_t);
+        case COMMAND_BUDGET:
+            return 2 * sizeof(uint16_t);
+        default:
+            return 0;
+    }
+}
+
+static bool command_valid(uint8_t id, const uint8_t *data)
+{
+    switch (id) {
+        case COMMAND_PERIOD:
+            return settings_period_valid(get_u16(data));
+        case COMMAND_PAYL_FMT:
+            return settings_payl_fmt_valid(data[0]);
+        case COMMAND_CONFM:
+            return settings_confm_valid(data[0]);
+        case COMMAND_BATCH:
+            return settings_batch_valid(data[0]);
+        case COMMAND_BAT_PERIOD: {
+            period_breakpoint_t breakpoints[PERIOD_BREAKPOINTS];
+            memcpy(breakpoints, data, sizeof(breakpoints));
+            return period_breakpoints_valid(breakpoints);
+        }
+        case COMMAND_LINK_ADAPT:
+            return settings_link_adapt_valid(data[0]);
+        case COMMAND_BUDGET:
+            // capacity and lifetime are both set or both zero (disabled)
+            return !get_u16(&data[0]) == !get_u16(&data[2]);
+        default:
+            return true;
+    }
+}
+
+static void command_apply(uint8_t id, const uint8_t *data)
+{
+    period_breakpoint_t breakpoints[PERIOD_BREAKPOINTS];
+
+    switch (id) {
+        case COMMAND_PERIOD:
+            settings_set_period(get_u16(data));
+            break;
+        case COMMAND_PAYL_FMT:
+            settings_set_payl_fmt(data[0]);
+            break;
+        case COMMAND_CONFM:
+            settings_set_confm(data[0], data[1]);
+            break;
+        case COMMAND_BATCH:
+            settings_set_batch(data[0]);
+            break;
+        case COMMAND_DEADBAND:
+            settings_set_deadband(get_u16(&data[0]), get_u16(&data[2]), get_u16(&data[4]));
+            break;
+        case COMMAND_BAT_PERIOD:
+            memcpy(breakpoints, data, sizeof(breakpoints));
+            settings_set_period_breakpoints(breakpoints);
+            break;
+        case COMMAND_LINK_ADAPT:
+            settings_set_link_adapt(data[0]);
+            break;
+        case COMMAND_BUDGET:
+            budget_set(get_u16(&data[0]), get_u16(&data[2]));
+            break;
+    }
+}
+
+void command_process(const uint8_t *data, uint8_t len)
+{
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, data, len, ESP_LOG_INFO);
+
+    if (len < 1) {
+        return;
+    }
+
+    // [seq] followed by [id][value] commands, applied in order until the first invalid one
+    ack_seq = data[0];
+    ack_status = 0;
+    uint8_t pos = 1;
+    for (uint8_t index = 1; pos < len; index++) {
+        uint8_t id = data[pos++];
+        uint8_t value_len = command_len(id);
+        if (value_len == 0 || pos + value_len > len || !command_valid(id, &data[pos])) {
+            ESP_LOGW(TAG, "Invalid command %d 0x%02x", index, id);
+            ack_status = index;
+            break;
+        }
+        command_apply(id, &data[pos]);
+        pos += value_len;
+    }
+    ack_pending = true;
+
+    ESP_LOGI(TAG, "Processed seq %d, status %d", ack_seq, ack_status);
+}
+
+bool command_ack_pending()
+{
+    return ack_pending;
+}
+
+void command_ack(uint8_t ack[COMMAND_ACK_LEN])
+{
+    ack[0] = ack_seq;
+    ack[1] = ack_status;
+    ack_pending = false;
+}
@@ -0,0 +1,28 @@
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define COMMAND_PORT        10
+#define COMMAND_ACK_LEN     2
+
+typedef enum
+{
+    COMMAND_PERIOD = 0x01,      // uint16 s
+    COMMAND_PAYL_FMT = 0x02,    // uint8
+    COMMAND_CONFM = 0x03,       // uint8 policy, uint8 parameter
+    COMMAND_BATCH = 0x04,       // uint8
+    COMMAND_DEADBAND = 0x05,    // uint16 humidity, uint16 temperature, uint16 heartbeat
+    COMMAND_BAT_PERIOD = 0x06,  // battery period breakpoints
+    COMMAND_LINK_ADAPT = 0x07,  // uint8
+    COMMAND_BUDGET = 0x08,      // uint16 capacity, uint16 lifetime
+} command_id_t;
+
+void command_process(const uint8_t *data, uint8_t len);
+
+bool command_ack_pending();
+
+void command_ack(uint8_t ack[COMMAND_ACK_LEN]);
+
+#endif /* COMMAND_H_ */
@@ -0,0 +1,49 @@
+#include <string.h>
+
+#include "dht.h"
+
+#define RESPONSE_MIN    60  // us, sensor response is 80 us low and 80 us high
+#define RESPONSE_MAX    120
+#define BIT_LOW_MIN     30  // us, bit start is 50 us low
+#define BIT_LOW_MAX     90
+#define BIT_HIGH_MIN    10  // us, bit value is 26-28 us high for 0 and 70 us for 1
+#define BIT_HIGH_MAX    100
+#define BIT_THRESHOLD   48
+
+static inline int in_range(uint16_t val, uint16_t min, uint16_t max)
+{
+    return val >= min && val <= max;
+}
+
+dht_status_t dht_decode(const dht_pulse_t *pulses, size_t count, uint8_t data[DHT_DATA_BYTES])
+{
+    size_t i = 0;
+
+    // skip anything captured before the sensor response (host release)
+    while (i < count && !(in_range(pulses[i].low, RESPONSE_MIN, RESPONSE_MAX) && in_range(pulses[i].high, RESPONSE_MIN, RESPONSE_MAX))) {
+        i++;
+    }
+    if (i == count) {
+        return DHT_ERR_NO_RESPONSE;
+    }
+    i++;
+
+    if (count - i < DHT_DATA_BITS) {
+        return DHT_ERR_LENGTH;
+    }
+
+    memset(data, 0, DHT_DATA_BYTES);
+    for (int bit = 0; bit < DHT_DATA_BITS; bit++, i++) {
+        if (!in_range(pulses[i].low, BIT_LOW_MIN, BIT_LOW_MAX) || !in_range(pulses[i].high, BIT_HIGH_MIN, BIT_HIGH_MAX)) {
+            return DHT_ERR_TIMING;
+        }
+        data[bit / 8] <<= 1;
+        data[bit / 8] |= pulses[i].high > BIT_THRESHOLD;
+    }
+
+    if (((data[0] + data[1] + data[2] + data[3]) & 0xff) != data[4]) {
+        return DHT_ERR_CHECKSUM;
+    }
+
+    return DHT_OK;
+}
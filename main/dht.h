@@ -0,0 +1,23 @@
+#ifndef DHT_H_
+#define DHT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DHT_DATA_BITS   40
+#define DHT_DATA_BYTES  (DHT_DATA_BITS / 8)
+
+typedef enum
+{
+    DHT_OK, DHT_ERR_NO_RESPONSE, DHT_ERR_LENGTH, DHT_ERR_TIMING, DHT_ERR_CHECKSUM
+} dht_status_t;
+
+typedef struct
+{
+    uint16_t low;   // us
+    uint16_t high;  // us
+} dht_pulse_t;
+
+dht_status_t dht_decode(const dht_pulse_t *pulses, size_t count, uint8_t data[DHT_DATA_BYTES]);
+
+#endif /* DHT_H_ */
@@ -0,0 +1,111 @@
+#include <string.h>
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "history.h"
+#include "settings.h"
+
+static const char *TAG = "history";
+
+// records are numbered from the first one ever stored, the current block is staged in RTC memory
+static RTC_DATA_ATTR bool loaded = false;
+static RTC_DATA_ATTR uint32_t count;
+static RTC_DATA_ATTR history_record_t staging[HISTORY_BLOCK_RECORDS];
+
+// last block read from flash
+static history_record_t cache[HISTORY_BLOCK_RECORDS];
+static int32_t cache_block = -1;
+
+static void history_load()
+{
+    if (loaded) {
+        return;
+    }
+
+    // records staged before power loss are gone, continue after the last stored block
+    count = settings_load_history_count();
+    loaded = true;
+
+    ESP_LOGI(TAG, "Loaded, count %d", count);
+}
+
+void history_add(float humidity, float temperature, uint8_t battery)
+{
+    history_load();
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    history_record_t *record = &staging[count % HISTORY_BLOCK_RECORDS];
+    record->time = now.tv_sec;
+    record->humidity = humidity * 100;
+    record->temperature = temperature * 100;
+    record->battery = battery;
+    count++;
+
+    if (count % HISTORY_BLOCK_RECORDS == 0) {
+        uint32_t block = count / HISTORY_BLOCK_RECORDS - 1;
+        settings_save_history(block % HISTORY_BLOCKS, staging, sizeof(staging), count);
+        if (cache_block == block % HISTORY_BLOCKS) {
+            cache_block = -1;
+        }
+        ESP_LOGI(TAG, "Stored block %d", block);
+    }
+}
+
+uint32_t history_first()
+{
+    history_load();
+
+    uint32_t block = count / HISTORY_BLOCK_RECORDS;
+    return block > HISTORY_BLOCKS ? (block - HISTORY_BLOCKS) * HISTORY_BLOCK_RECORDS : 0;
+}
+
+uint32_t history_count()
+{
+    history_load();
+
+    return count;
+}
+
+uint16_t history_read(uint32_t index, history_record_t *records, uint16_t max)
+{
+    uint32_t first = history_first();
+    uint32_t staged = count - count % HISTORY_BLOCK_RECORDS;
+    uint16_t n = 0;
+
+    if (index < first) {
+        return 0;
+    }
+
+    while (n < max && index < count) {
+        uint16_t offset = index % HISTORY_BLOCK_RECORDS;
+        const history_record_t *block = staging;
+        if (index < staged) {
+            int32_t slot = (index / HISTORY_BLOCK_RECORDS) % HISTORY_BLOCKS;
+            if (cache_block != slot) {
+                if (!settings_load_history(slot, cache, sizeof(cache))) {
+                    ESP_LOGW(TAG, "Block %d missing", slot);
+                    break;
+                }
+                cache_block = slot;
+            }
+            block = cache;
+        }
+
+        // rest of the block, or what was asked or stored
+        uint16_t len = HISTORY_BLOCK_RECORDS - offset;
+        if (len > max - n) {
+            len = max - n;
+        }
+        if (len > count - index) {
+            len = count - index;
+        }
+        memcpy(&records[n], &block[offset], len * sizeof(history_record_t));
+        n += len;
+        index += len;
+    }
+
+    return n;
+}
@@ -0,0 +1,25 @@
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stdint.h>
+
+#define HISTORY_BLOCK_RECORDS   32  // records staged in RTC memory per flash write
+#define HISTORY_BLOCKS          16  // flash blocks kept, oldest is overwritten
+
+typedef struct
+{
+    uint32_t time;          // s, RTC time
+    uint16_t humidity;      // 0.01 %
+    int16_t temperature;    // 0.01 °C
+    uint8_t battery;        // %
+} __attribute__((packed)) history_record_t;
+
+void history_add(float humidity, float temperature, uint8_t battery);
+
+uint32_t history_first();
+
+uint32_t history_count();
+
+uint16_t history_read(uint32_t index, history_record_t *records, uint16_t max);
+
+#endif /* HISTORY_H_ */
@@ -0,0 +1,58 @@
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp32/clk.h"
+
+#include "join.h"
+
+#define BACKOFF_MIN     (15ULL * 1000000)   // 15 s
+#define BACKOFF_MAX     (3600ULL * 1000000) // 1 hour
+#define RATE_MAX        5                   // EU868 DR5, SF7
+#define RATE_MIN        0                   // EU868 DR0, SF12
+
+static const char *TAG = "join";
+
+static RTC_DATA_ATTR uint16_t attempts = 0;
+static RTC_DATA_ATTR uint64_t next_time = 0;
+static RTC_DATA_ATTR uint8_t last_rate = RATE_MAX;
+
+void join_reset()
+{
+    attempts = 0;
+    next_time = 0;
+    last_rate = RATE_MAX;
+}
+
+bool join_is_due()
+{
+    return esp_clk_rtc_time() >= next_time;
+}
+
+uint64_t join_delay()
+{
+    uint64_t now = esp_clk_rtc_time();
+    return next_time > now ? next_time - now : 0;
+}
+
+uint8_t join_rate()
+{
+    // fast rate on the first attempts, then step down to reach farther gateways
+    if (attempts == 0) {
+        return RATE_MAX;
+    }
+    return (attempts % 2 == 0 && last_rate > RATE_MIN) ? last_rate - 1 : last_rate;
+}
+
+void join_failed(uint8_t rate)
+{
+    last_rate = rate;
+
+    // exponential backoff, the node may be deployed long before a gateway is in range
+    uint64_t backoff = BACKOFF_MIN << (attempts < 8 ? attempts : 8);
+    if (backoff > BACKOFF_MAX) {
+        backoff = BACKOFF_MAX;
+    }
+    attempts++;
+    next_time = esp_clk_rtc_time() + backoff;
+
+    ESP_LOGI(TAG, "Attempt %d at rate %d failed, next in %llu s", attempts, rate, backoff / 1000000);
+}
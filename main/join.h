@@ -0,0 +1,17 @@
+#ifndef JOIN_H_
+#define JOIN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void join_reset();
+
+bool join_is_due();
+
+uint64_t join_delay();
+
+uint8_t join_rate();
+
+void join_failed(uint8_t rate);
+
+#endif /* JOIN_H_ */
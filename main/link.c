@@ -0,0 +1,126 @@
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "link.h"
+
+#define HISTORY_SIZE        8
+#define CHECK_INTERVAL      16  // uplinks between LinkCheck requests
+#define LOST_UPLINKS        32  // uplinks without any downlink to consider link lost
+#define MARGIN_TARGET       10  // dB, installation margin kept above demodulation floor
+#define RATE_MIN            0   // EU868 DR0 SF12
+#define RATE_MAX            5   // EU868 DR5 SF7
+#define RATE_STEP_DB        25  // 0.1 dB, demodulation floor difference between two SF
+#define POWER_MAX_INDEX     7   // EU868 power index 7 = max EIRP - 14 dB
+#define POWER_STEP_DB       2
+
+static const char *TAG = "link";
+
+typedef struct
+{
+    int8_t margin;  // dB above demodulation floor at rate/power
+    uint8_t rate;
+    uint8_t power;
+} observation_t;
+
+static RTC_DATA_ATTR observation_t history[HISTORY_SIZE];
+static RTC_DATA_ATTR uint8_t history_count = 0;
+static RTC_DATA_ATTR uint8_t history_head = 0;
+static RTC_DATA_ATTR uint16_t uplinks_since_check = 0;
+static RTC_DATA_ATTR uint16_t uplinks_since_downlink = 0;
+static RTC_DATA_ATTR uint8_t current_rate = RATE_MIN;
+static RTC_DATA_ATTR uint8_t current_power = 0;
+
+// SX1276 demodulation floor in 0.1 dB for SF12 (DR0) .. SF7 (DR5)
+static const int16_t snr_floor[] = { -200, -175, -150, -125, -100, -75 };
+
+static void record(int16_t margin, uint8_t rate, uint8_t power)
+{
+    if (margin > INT8_MAX) {
+        margin = INT8_MAX;
+    } else if (margin < INT8_MIN) {
+        margin = INT8_MIN;
+    }
+
+    observation_t *obs = &history[history_head];
+    obs->margin = margin;
+    obs->rate = rate;
+    obs->power = power;
+
+    history_head = (history_head + 1) % HISTORY_SIZE;
+    if (history_count < HISTORY_SIZE) {
+        history_count++;
+    }
+    uplinks_since_downlink = 0;
+
+    ESP_LOGI(TAG, "Margin %d dB (DR%d, power %d)", margin, rate, power);
+}
+
+void link_record_snr(int16_t snr, uint8_t rate)
+{
+    if (rate > RATE_MAX) {
+        return;
+    }
+    // downlink is sent by the gateway, our TX power doesn't change its margin
+    record((snr * 10 - snr_floor[rate]) / 10, rate, 0);
+}
+
+void link_record_margin(uint8_t margin)
+{
+    uplinks_since_check = 0;
+    // LinkCheck answers the uplink that requested it, sent with the selected rate and power
+    record(margin, current_rate, current_power);
+}
+
+void link_uplink()
+{
+    uplinks_since_check++;
+    uplinks_since_downlink++;
+}
+
+bool link_check_due()
+{
+    return history_count == 0 || uplinks_since_check >= CHECK_INTERVAL;
+}
+
+void link_select(uint8_t *rate, uint8_t *power)
+{
+    if (uplinks_since_downlink >= LOST_UPLINKS) {
+        // no feedback for a long time, fall back step by step to the most robust setting
+        uplinks_since_downlink = 0;
+        history_count = 0;
+        if (current_power > 0) {
+            current_power = 0;
+        } else if (current_rate > RATE_MIN) {
+            current_rate--;
+        }
+        ESP_LOGW(TAG, "Link lost, falling back to DR%d, power %d", current_rate, current_power);
+    } else if (history_count > 0) {
+        // worst recent observation, normalized to the most robust rate at full power
+        int16_t margin = INT16_MAX;
+        for (int i = 0; i < history_count; i++) {
+            int16_t m = history[i].margin * 10 + history[i].rate * RATE_STEP_DB + history[i].power * POWER_STEP_DB * 10;
+            if (m < margin) {
+                margin = m;
+            }
+        }
+
+        // spend the excess on faster data rate first (shorter airtime), then on lower TX power
+        int16_t excess = margin - MARGIN_TARGET * 10;
+        uint8_t new_rate = RATE_MIN;
+        while (new_rate < RATE_MAX && excess >= RATE_STEP_DB) {
+            new_rate++;
+            excess -= RATE_STEP_DB;
+        }
+        uint8_t new_power = 0;
+        while (new_power < POWER_MAX_INDEX && excess >= POWER_STEP_DB * 10) {
+            new_power++;
+            excess -= POWER_STEP_DB * 10;
+        }
+
+        current_rate = new_rate;
+        current_power = new_power;
+    }
+
+    *rate = current_rate;
+    *power = current_power;
+}
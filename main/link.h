@@ -0,0 +1,17 @@
+#ifndef LINK_H_
+#define LINK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void link_record_snr(int16_t snr, uint8_t rate);
+
+void link_record_margin(uint8_t margin);
+
+void link_uplink();
+
+bool link_check_due();
+
+void link_select(uint8_t *rate, uint8_t *power);
+
+#endif /* LINK_H_ */
@@ -3,21 +3,40 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/spi_master.h"
-#include "driver/timer.h"
 #include "nvs.h"
 #include "esp32/rom/rtc.h"
+#include "esp32/clk.h"
 #include "soc/rtc.h"
+#ifdef CONFIG_POWER_LIGHT_SLEEP
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "hal/gpio_ll.h"
+#endif /* CONFIG_POWER_LIGHT_SLEEP */
 #include "ldl_mac.h"
 #include "ldl_radio.h"
 #include "ldl_sm.h"
 #include "ldl_system.h"
 
-#include "storage_key.h"
+#include "lora.h"
+#include "settings.h"
 #include "peripherals.h"
+#include "profiler.h"
+#include "link.h"
+#include "session.h"
+#include "battery.h"
+#include "budget.h"
+#include "command.h"
 
 #define TPS 1000000UL  /* ticks per second (microsecond) */
-#define DIVIDER 128
+
+#define MAX_DCYCLE      7   // aggregated duty cycle limit 1/2^7, stricter than the 1 % of the EU868 bands
+
+#define ACK_STATS_MIN   8   // confirmed uplinks before the loss estimate is trusted
+#define ACK_LOSS_LOW    10  // %, confirm half as often
+#define ACK_LOSS_HIGH   30  // %, confirm twice as often
+#define ACK_LOSS_SHIFT  3   // filter weight 1/8
 
 static const char *TAG = "lora";
 
@@ -36,19 +55,36 @@ static struct ldl_mac mac;
 
 typedef enum
 {
-    WAKE_NONE, WAKE_JOIN, WAKE_SEND
+    WAKE_NONE, WAKE_JOIN, WAKE_SEND, WAKE_CANCEL
 } wake_t;
 
 static uint8_t send_buffer[LDL_MAX_PACKET];
 static uint8_t send_len = 0;
 static uint8_t send_confirmed;
+static uint8_t send_port;
+static bool send_pending = false;
+static bool wake_tx_done = false;
+static uint8_t join_rate;
+static int64_t tx_start;
+#ifdef CONFIG_POWER_LIGHT_SLEEP
+static esp_pm_lock_handle_t tx_pm_lock;
+static bool tx_pm_locked = false;
+#endif /* CONFIG_POWER_LIGHT_SLEEP */
+
+static RTC_DATA_ATTR lora_ack_stats_t ack_stats = { 0 };
+// RTC time, us, end of the duty cycle off time after the last TX; the MAC starts over on every wake
+// and knows nothing about transmissions before deep sleep, the wakeup is not set earlier instead
+static RTC_DATA_ATTR uint64_t tx_allowed = 0;
 
 uint32_t LDL_System_ticks(void *app)
 {
-    uint64_t val;
-    timer_get_counter_value(TIMER_GROUP_0, TIMER_0, &val);
-    return (uint32_t) val;
-//    return esp_timer_get_time();
+    // RTC counter scaled by the slow clock calibration, keeps running in light sleep
+    // where the APB based esp_timer would stall. The MAC state is rebuilt on every wake,
+    // duty cycle across deep sleep is kept by tx_allowed.
+    // Truncated to 32 bits it wraps every ~71.6 min, LDL compares ticks by unsigned
+    // difference, which holds across the wrap for intervals below half the range (~35 min),
+    // far longer than any MAC timer within one wake.
+    return (uint32_t) esp_clk_rtc_time();
 }
 
 uint8_t LDL_System_getBatteryLevel(void *app)
@@ -58,14 +94,13 @@ uint8_t LDL_System_getBatteryLevel(void *app)
 
 uint32_t LDL_System_tps(void)
 {
-    return (((READ_PERI_REG(RTC_APB_FREQ_REG)) & UINT16_MAX) << 12) / DIVIDER;
-//    return TPS;
+    return TPS;
 }
 
 uint32_t LDL_System_eps(void)
 {
-    //return (LDL_System_tps() / 1000) * 5;
-    return 5000;
+    // slow clock drifts more than the APB clock, allow 5 ms of error per event
+    return (TPS / 1000) * 5;
 }
 
 void LDL_Chip_reset(void *self, bool state)
@@ -100,6 +135,19 @@ void LDL_Chip_read(void *self, uint8_t addr, uint8_t *data, uint8_t len)
     ESP_ERROR_CHECK(spi_device_transmit(spi_handle, &t));
 }
 
+static void tx_lock(bool lock)
+{
+#ifdef CONFIG_POWER_LIGHT_SLEEP
+    // DIO edges and RX window timing must not be lost to light sleep between TX and the end of RX
+    if (lock && !tx_pm_locked) {
+        esp_pm_lock_acquire(tx_pm_lock);
+    } else if (!lock && tx_pm_locked) {
+        esp_pm_lock_release(tx_pm_lock);
+    }
+    tx_pm_locked = lock;
+#endif /* CONFIG_POWER_LIGHT_SLEEP */
+}
+
 void ldl_handler(void *app, enum ldl_mac_response_type type, const union ldl_mac_response_arg *arg)
 {
     bool join_status;
@@ -111,15 +159,15 @@ void ldl_handler(void *app, enum ldl_mac_response_type type, const union ldl_mac
             break;
         case LDL_MAC_JOIN_COMPLETE:
 #ifdef CONFIG_LORA_LORAWAN_VERSION_1_1
-            nvs_set_u16(storage, STORAGE_KEY_LORA_DEV_NONCE, arg->join_complete.nextDevNonce);
-            nvs_set_u32(storage, STORAGE_KEY_LORA_JOIN_NONCE, arg->join_complete.joinNonce);
+            settings_set_nonces(arg->join_complete.nextDevNonce, arg->join_complete.joinNonce);
 #endif /* CONFIG_LORA_LORAWAN_VERSION_1_1 */
             join_status = true;
-            xQueueSend(join_queue, &join_status, portMAX_DELAY);
+            xQueueOverwrite(join_queue, &join_status);
             break;
         case LDL_MAC_JOIN_TIMEOUT:
+            tx_lock(false);
             join_status = false;
-            xQueueSend(join_queue, &join_status, portMAX_DELAY);
+            xQueueOverwrite(join_queue, &join_status);
             break;
         case LDL_MAC_RX1_SLOT:
             ESP_LOGI(TAG, "RX1 slot %d %d", arg->rx_slot.error, arg->rx_slot.margin);
@@ -128,13 +176,28 @@ void ldl_handler(void *app, enum ldl_mac_response_type type, const union ldl_mac
             ESP_LOGI(TAG, "RX2 slot %d %d", arg->rx_slot.error, arg->rx_slot.margin);
             break;
         case LDL_MAC_DOWNSTREAM:
-            ESP_LOGI(TAG, "Downstrean");
+            ESP_LOGI(TAG, "Downstrean (rssi %d snr %d)", arg->downstream.rssi, arg->downstream.snr);
+            ack_stats.since_downlink = 0;
+            link_record_snr(arg->downstream.snr, LDL_MAC_getRate(&mac));
             break;
         case LDL_MAC_TX_COMPLETE:
             ESP_LOGI(TAG, "TX complete");
+            battery_tx_done(esp_timer_get_time() - tx_start);
+            tx_allowed = esp_clk_rtc_time() + ((esp_timer_get_time() - tx_start) << MAX_DCYCLE);
+            if (send_pending) {
+                profiler_end(PROFILER_PHASE_LORA_TX);
+                profiler_begin(PROFILER_PHASE_LORA_RX);
+            }
             break;
         case LDL_MAC_TX_BEGIN:
             ESP_LOGI(TAG, "TX begin");
+            tx_start = esp_timer_get_time();
+            tx_lock(true);
+            battery_tx_begin();
+            if (send_pending && !wake_tx_done) {
+                profiler_record(PROFILER_PHASE_WAKE_TO_TX, esp_timer_get_time());
+                wake_tx_done = true;
+            }
             break;
         case LDL_MAC_SESSION_UPDATED:
             if (arg->session_updated.session->joined) {
@@ -142,6 +205,12 @@ void ldl_handler(void *app, enum ldl_mac_response_type type, const union ldl_mac
             } else {
                 memset(&mac_session, 0, sizeof(struct ldl_mac_session));
             }
+            session_checkpoint(&mac_session, &sm);
+            tx_lock(false);
+            if (send_pending) {
+                profiler_end(PROFILER_PHASE_LORA_RX);
+                send_pending = false;
+            }
             xSemaphoreGive(send_semhr);
             break;
         case LDL_MAC_RESET:
@@ -149,15 +218,24 @@ void ldl_handler(void *app, enum ldl_mac_response_type type, const union ldl_mac
             break;
         case LDL_MAC_DATA_COMPLETE:
             ESP_LOGI(TAG, "LDL_MAC_DATA_COMPLETE");
+            if (send_confirmed) {
+                ack_stats.acked++;
+                ack_stats.loss -= ack_stats.loss >> ACK_LOSS_SHIFT;
+            }
             break;
         case LDL_MAC_DATA_NAK:
             ESP_LOGI(TAG, "LDL_MAC_DATA_NAK");
+            ack_stats.loss += (100 - ack_stats.loss + (1 << ACK_LOSS_SHIFT) - 1) >> ACK_LOSS_SHIFT;
             break;
         case LDL_MAC_RX:
-            ESP_LOGI(TAG, "LDL_MAC_RX");
+            ESP_LOGI(TAG, "LDL_MAC_RX (port %d)", arg->rx.port);
+            if (arg->rx.port == COMMAND_PORT) {
+                command_process(arg->rx.data, arg->rx.size);
+            }
             break;
         case LDL_MAC_LINK_STATUS:
-            ESP_LOGI(TAG, "LDL_MAC_LINK_STATUS");
+            ESP_LOGI(TAG, "LDL_MAC_LINK_STATUS (margin %d gw %d)", arg->link_status.margin, arg->link_status.gwCount);
+            link_record_margin(arg->link_status.margin);
             break;
         case LDL_MAC_DEVICE_TIME:
             ESP_LOGI(TAG, "LDL_MAC_DEVICE_TIME");
@@ -172,18 +250,24 @@ void ldl_handler(void *app, enum ldl_mac_response_type type, const union ldl_mac
 static void IRAM_ATTR dio_isr_handler(void *arg)
 {
     uint8_t dio = (uint32_t) arg;
+#ifdef CONFIG_POWER_LIGHT_SLEEP
+    // wakeup makes the line level triggered, mask it until the MAC has cleared the radio IRQ flags
+    gpio_ll_intr_disable(&GPIO, dio ? RFM_DIO1 : RFM_DIO0);
+#endif /* CONFIG_POWER_LIGHT_SLEEP */
     LDL_Radio_interrupt(&radio, dio);
 }
 
 static void process_func(void *param)
 {
     wake_t wake = WAKE_NONE;
+    struct ldl_mac_data_opts opts;
     while (1) {
         if (LDL_MAC_ready(&mac)) {
             switch (wake) {
                 case WAKE_JOIN:
                     if (!LDL_MAC_joined(&mac)) {
-                        ESP_LOGI(TAG, "LDL_MAC_otaa");
+                        ESP_LOGI(TAG, "LDL_MAC_otaa rate %d", join_rate);
+                        LDL_MAC_setRate(&mac, join_rate);
                         LDL_MAC_otaa(&mac);
                     } else {
                         wake = WAKE_NONE;
@@ -191,12 +275,19 @@ static void process_func(void *param)
                     break;
                 case WAKE_SEND:
                     ESP_LOG_BUFFER_HEX_LEVEL(TAG, send_buffer, send_len, ESP_LOG_INFO);
+                    memset(&opts, 0, sizeof(struct ldl_mac_data_opts));
+                    if (settings_get()->link_adapt) {
+                        uint8_t rate, power;
+                        link_select(&rate, &power);
+                        LDL_MAC_setRate(&mac, rate);
+                        LDL_MAC_setPower(&mac, power);
+                        opts.check = link_check_due();
+                    }
+                    link_uplink();
                     if (send_confirmed) {
-                        LDL_MAC_confirmedData(&mac, 1U, send_buffer, send_len,
-                        NULL);
+                        LDL_MAC_confirmedData(&mac, send_port, send_buffer, send_len, &opts);
                     } else {
-                        LDL_MAC_unconfirmedData(&mac, 1U, send_buffer, send_len,
-                        NULL);
+                        LDL_MAC_unconfirmedData(&mac, send_port, send_buffer, send_len, &opts);
                     }
                     wake = WAKE_NONE;
                     break;
@@ -205,7 +296,17 @@ static void process_func(void *param)
             }
         }
 
+        if (wake == WAKE_CANCEL) {
+            // stop the MAC internal join retries, retry is scheduled across deep sleep instead
+            LDL_MAC_cancel(&mac);
+            wake = WAKE_NONE;
+        }
+
         LDL_MAC_process(&mac);
+#ifdef CONFIG_POWER_LIGHT_SLEEP
+        gpio_intr_enable(RFM_DIO0);
+        gpio_intr_enable(RFM_DIO1);
+#endif /* CONFIG_POWER_LIGHT_SLEEP */
         uint32_t ticks_until_next_event = LDL_MAC_ticksUntilNextEvent(&mac);
         xQueueReceive(wake_queue, &wake, (ticks_until_next_event / ((LDL_System_tps() / 1000)) / portTICK_PERIOD_MS));
     }
@@ -213,46 +314,41 @@ static void process_func(void *param)
 
 void mac_init()
 {
-    size_t size;
+    const settings_t *settings = settings_get();
 
-    uint8_t app_key[16];
-    size = sizeof(app_key);
-    nvs_get_blob(storage, STORAGE_KEY_LORA_APP_KEY, app_key, &size);
-
-    uint8_t nwk_key[16];
-    size = sizeof(nwk_key);
-    nvs_get_blob(storage, STORAGE_KEY_LORA_NWK_KEY, nwk_key, &size);
-
-    LDL_SM_init(&sm, app_key, nwk_key);
+    LDL_SM_init(&sm, settings->app_key, settings->nwk_key);
 
     struct ldl_mac_init_arg arg = { 0 };
     arg.radio = &radio;
     arg.handler = ldl_handler;
     arg.sm = &sm;
+    if (!mac_session.joined && session_restore(&mac_session, &sm)) {
+        ESP_LOGI(TAG, "Session restored from flash, skipping join");
+    }
     if (mac_session.joined) {
         arg.session = &mac_session;
     }
 #ifdef CONFIG_LORA_LORAWAN_VERSION_1_1
-    nvs_get_u16(storage, STORAGE_KEY_LORA_DEV_NONCE, &arg.devNonce);
-    nvs_get_u32(storage, STORAGE_KEY_LORA_JOIN_NONCE, &arg.joinNonce);
+    arg.devNonce = settings->dev_nonce;
+    arg.joinNonce = settings->join_nonce;
 #endif /* CONFIG_LORA_LORAWAN_VERSION_1_1 */
     arg.gain = 0;
 
-    uint8_t join_eui[16];
-    size = sizeof(join_eui);
-    nvs_get_blob(storage, STORAGE_KEY_LORA_JOIN_EUI, join_eui, &size);
-    arg.joinEUI = join_eui;
-
-    uint8_t dev_eui[16];
-    size = sizeof(join_eui);
-    nvs_get_blob(storage, STORAGE_KEY_LORA_DEV_EUI, dev_eui, &size);
-    arg.devEUI = dev_eui;
+    arg.joinEUI = settings->join_eui;
+    arg.devEUI = settings->dev_eui;
 
     ESP_LOGI(TAG, "Init with devNonce %d joinNonce %d", arg.devNonce, arg.joinNonce);
 
     LDL_MAC_init(&mac, LDL_EU_863_870, &arg);
 
-    LDL_MAC_setMaxDCycle(&mac, 7);
+    LDL_MAC_setMaxDCycle(&mac, MAX_DCYCLE);
+
+    // ADR state is part of the session, switching the tracker off has to hand control back
+    if (settings->link_adapt) {
+        LDL_MAC_disableADR(&mac);
+    } else {
+        LDL_MAC_enableADR(&mac);
+    }
 }
 
 void lora_init()
@@ -275,6 +371,14 @@ void lora_init()
     gpio_set_intr_type(RFM_DIO1, GPIO_INTR_POSEDGE);
     gpio_isr_handler_add(RFM_DIO1, dio_isr_handler, (void*) 1);
 
+#ifdef CONFIG_POWER_LIGHT_SLEEP
+    // radio interrupts have to wake the CPU from automatic light sleep
+    gpio_wakeup_enable(RFM_DIO0, GPIO_INTR_HIGH_LEVEL);
+    gpio_wakeup_enable(RFM_DIO1, GPIO_INTR_HIGH_LEVEL);
+    ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "lora_tx", &tx_pm_lock));
+#endif /* CONFIG_POWER_LIGHT_SLEEP */
+
 // @formatter:off
     spi_device_interface_config_t spi_dev_cfg = {
             .mode = 1,
@@ -288,20 +392,6 @@ void lora_init()
 // @formatter:on
     ESP_ERROR_CHECK(spi_bus_add_device(HSPI_HOST, &spi_dev_cfg, &spi_handle));
 
-// @formatter:off
-    timer_config_t timer_config = {
-            .alarm_en = false,
-            .counter_en = false,
-            .intr_type = TIMER_INTR_LEVEL,
-            .counter_dir = TIMER_COUNT_UP,
-            .auto_reload = false,
-            .divider = DIVIDER
-    };
-// @formatter:on */
-    timer_init(TIMER_GROUP_0, TIMER_0, &timer_config);
-    timer_set_counter_value(TIMER_GROUP_0, TIMER_0, 0x0);
-    timer_start(TIMER_GROUP_0, TIMER_0);
-
     LDL_Radio_init(&radio, LDL_RADIO_SX1276, NULL);
     LDL_Radio_setPA(&radio, LDL_RADIO_PA_BOOST);
 
@@ -315,36 +405,127 @@ bool lora_is_joined()
     return LDL_MAC_joined(&mac);
 }
 
+bool lora_has_session()
+{
+    // RTC copy survives deep sleep, valid before lora_init()
+    return mac_session.joined;
+}
+
 void lora_deinit()
 {
     vTaskSuspend(process_task);
+    tx_lock(false);
 
     vQueueDelete(wake_queue);
     vSemaphoreDelete(send_semhr);
     vQueueDelete(join_queue);
 }
 
-bool lora_join()
+uint64_t lora_tx_delay()
+{
+    uint64_t now = esp_clk_rtc_time();
+    return tx_allowed > now ? tx_allowed - now : 0;
+}
+
+uint8_t lora_mtu()
+{
+    // acknowledgement of a downlink command takes the head of the next uplink
+    return LDL_MAC_mtu(&mac) - (command_ack_pending() ? COMMAND_ACK_LEN : 0);
+}
+
+bool lora_join(uint8_t rate, uint32_t timeout)
 {
     vTaskDelay(20 / portTICK_PERIOD_MS); // TODO
 
+    xQueueReset(join_queue); // drop result of a previously cancelled attempt
+    join_rate = rate;
     wake_t wake = WAKE_JOIN;
     xQueueSend(wake_queue, &wake, portMAX_DELAY);
 
-    bool joined;
-    xQueueReceive(join_queue, &joined, portMAX_DELAY);
+    bool joined = false;
+    if (!xQueueReceive(join_queue, &joined, timeout / portTICK_PERIOD_MS) || !joined) {
+        wake = WAKE_CANCEL;
+        xQueueSend(wake_queue, &wake, portMAX_DELAY);
+        joined = false;
+    }
     return joined;
 }
 
-void lora_send(const void *payload, uint8_t len)
+static bool confirm_policy(bool alarm)
+{
+    const settings_t *settings = settings_get();
+    uint8_t param = settings->confm_param ? settings->confm_param : 1;
+    bool trusted = ack_stats.confirmed >= ACK_STATS_MIN;
+
+    bool confirm;
+    switch (settings->confm) {
+        case CONFM_ALL:
+            confirm = true;
+            break;
+        case CONFM_EVERY: {
+            // clean link needs fewer confirmations, lossy link is checked more often
+            uint16_t every = param;
+            if (trusted && ack_stats.loss < ACK_LOSS_LOW) {
+                every = param * 2;
+            } else if (trusted && ack_stats.loss > ACK_LOSS_HIGH) {
+                every = (param + 1) / 2;
+            }
+            confirm = ack_stats.uplinks % every == 0;
+            break;
+        }
+        case CONFM_UNACKED:
+            confirm = ack_stats.since_downlink >= param;
+            break;
+        case CONFM_ALARM:
+            confirm = alarm;
+            break;
+        default:
+            confirm = false;
+            break;
+    }
+
+    // energy budget may thin out confirmations further
+    return confirm && budget_confirm_due();
+}
+
+const lora_ack_stats_t* lora_get_ack_stats()
+{
+    return &ack_stats;
+}
+
+void lora_send(const void *payload, uint8_t len, bool alarm)
 {
     xSemaphoreTake(send_semhr, 0); //try take value from previous join event
 
     ESP_LOG_BUFFER_HEX_LEVEL(TAG, payload, len, ESP_LOG_INFO);
 
-    memcpy(&send_buffer[0], payload, len);
-    send_len = len;
-    nvs_get_u8(storage, STORAGE_KEY_CONFM, &send_confirmed);
+    uint8_t ack_len = command_ack_pending() ? COMMAND_ACK_LEN : 0;
+    if (ack_len + len > sizeof(send_buffer)) {
+        ESP_LOGE(TAG, "Payload %d B does not fit, dropped", len);
+        return;
+    }
+
+    // pending command acknowledgement goes first, on the command port
+    send_len = 0;
+    send_port = 1U;
+    if (command_ack_pending()) {
+        command_ack(send_buffer);
+        send_len = COMMAND_ACK_LEN;
+        send_port = COMMAND_PORT;
+    }
+    memcpy(&send_buffer[send_len], payload, len);
+    send_len += len;
+    send_confirmed = confirm_policy(alarm);
+
+    ack_stats.uplinks++;
+    ack_stats.since_downlink++;
+    if (send_confirmed) {
+        ack_stats.confirmed++;
+    }
+    ESP_LOGI(TAG, "Uplink %d, confirmed %d/%d acked, loss %d%%", ack_stats.uplinks, ack_stats.acked, ack_stats.confirmed, ack_stats.loss);
+
+    send_pending = true;
+    profiler_begin(PROFILER_PHASE_LORA_TX);
 
     wake_t wake = WAKE_SEND;
     xQueueSend(wake_queue, &wake, portMAX_DELAY);
@@ -4,11 +4,22 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 
+typedef struct
+{
+    uint32_t uplinks;
+    uint32_t confirmed;
+    uint32_t acked;
+    uint16_t since_downlink;    // uplinks since the last downlink of any kind
+    uint8_t loss;               // %, filtered loss of confirmed uplinks
+} __attribute__((packed)) lora_ack_stats_t;
+
 void lora_init();
 
 bool lora_is_joined();
 
-bool lora_join();
+bool lora_has_session();
+
+bool lora_join(uint8_t rate, uint32_t timeout);
 
 void lora_start(QueueHandle_t join_queue);
 
@@ -16,6 +27,13 @@ void lora_stop();
 
 void lora_deinit();
 
-void lora_send(const void *payload, uint8_t len);
+void lora_send(const void *payload, uint8_t len, bool alarm);
+
+const lora_ack_stats_t* lora_get_ack_stats();
+
+// us until the duty cycle allows the next TX, also across deep sleep
+uint64_t lora_tx_delay();
+
+uint8_t lora_mtu();
 
 #endif /* LORA_H_ */
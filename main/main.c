@@ -10,44 +10,57 @@
 #include "esp_log.h"
 #include "esp_spi_flash.h"
 #include "esp_timer.h"
-#include "nvs_flash.h"
-#include "nvs.h"
+#ifdef CONFIG_POWER_LIGHT_SLEEP
+#include "esp_pm.h"
+#endif /* CONFIG_POWER_LIGHT_SLEEP */
 
 #include "lora.h"
-#include "storage_key.h"
+#include "settings.h"
+#include "period.h"
 #include "ble.h"
 #include "sensor.h"
 #include "peripherals.h"
 #include "battery.h"
 #include "profile.h"
+#include "profiler.h"
+#include "join.h"
+#include "budget.h"
 
 #define BLE_CONNECTION_TIMEOUT  60000  // 60sec
-#define LORA_JOIN_TIMEOUT       900000 // 15min
+#define LORA_JOIN_TIMEOUT       30000  // 30sec, single join attempt
+#define JOIN_DELAY_MIN          1000000 // 1sec, join that became due while awake must not wake right away
 #define LIRA_ERROR_TIMEOUT      30000  // 30se
+#define MEASURE_TASK_STACK      (3 * 1024) // sensor drivers, ADC calibration and float logging
 
 static const char *TAG = "main";
 
 static RTC_DATA_ATTR struct timeval send_time;
 
+static RTC_DATA_ATTR uint32_t wake_count = 0;
+
 static esp_timer_handle_t send_timer = NULL;
 
 static TaskHandle_t join_task;
 static TaskHandle_t periodic_execute_task;
+static TaskHandle_t measure_task = NULL;
+#ifdef CONFIG_BLE_BEACON
+static TaskHandle_t beacon_task;
+#endif /* CONFIG_BLE_BEACON */
 
 static SemaphoreHandle_t join_task_done_sem;
 static SemaphoreHandle_t ble_task_done_sem;
 static SemaphoreHandle_t send_sem;
 static SemaphoreHandle_t join_mutex;
 static SemaphoreHandle_t periodic_execute_mutex;
-
-nvs_handle storage;
+static SemaphoreHandle_t measure_done_sem;
+static SemaphoreHandle_t ble_stack_sem;    // BT stack owner, given back by another task than took it
+#ifdef CONFIG_BLE_BEACON
+static SemaphoreHandle_t beacon_sem;
+#endif /* CONFIG_BLE_BEACON */
 
 static uint64_t get_timer_timeout()
 {
-    uint16_t period = 60; // default 60s period
-    nvs_get_u16(storage, STORAGE_KEY_PERIOD, &period);
-
-    uint64_t timeout = period * 1000000;
+    uint64_t timeout = period_effective() * 1000000ULL;
 
     struct timeval now;
     gettimeofday(&now, NULL);
@@ -56,6 +69,9 @@ static uint64_t get_timer_timeout()
     if (dt < timeout) {
         timeout -= dt;
     }
+    if (timeout < lora_tx_delay()) {
+        timeout = lora_tx_delay();
+    }
 
     ESP_LOGI(TAG, "Timer timeout %llu s", timeout / 1000000);
 
@@ -67,23 +83,25 @@ static void join_task_func(void *param)
     esp_timer_stop(send_timer);
     memset(&send_time, 0, sizeof(struct timeval));
 
-    size_t join_eui_len = 8 * sizeof(uint8_t);
-    size_t dev_eui_len = 8 * sizeof(uint8_t);
-    size_t nwk_key_len = 16 * sizeof(uint8_t);
-    if (nvs_get_blob(storage, STORAGE_KEY_LORA_JOIN_EUI, NULL, &join_eui_len) == ESP_OK
-            && nvs_get_blob(storage, STORAGE_KEY_LORA_DEV_EUI, NULL, &dev_eui_len) == ESP_OK
-            && nvs_get_blob(storage, STORAGE_KEY_LORA_NWK_KEY, NULL, &nwk_key_len) == ESP_OK) {
+    if (settings_get()->has_credentials && !join_is_due()) {
+        ESP_LOGI(TAG, "Login postponed for %llu s", join_delay() / 1000000);
+    } else if (settings_get()->has_credentials) {
         ESP_LOGI(TAG, "Gonna to login");
 
         led_set_state(LED_ID_LORA, LED_STATE_DUTY_50);
-        if (lora_join()) {
+        uint8_t rate = join_rate();
+        profiler_begin(PROFILER_PHASE_LORA_JOIN);
+        bool joined = lora_join(rate, LORA_JOIN_TIMEOUT);
+        profiler_end(PROFILER_PHASE_LORA_JOIN);
+        if (joined) {
             led_set_state(LED_ID_LORA, LED_STATE_OFF);
             ESP_LOGI(TAG, "Login successful");
+            join_reset();
             xSemaphoreGive(send_sem);
         } else {
             led_set_state(LED_ID_LORA, LED_STATE_DUTY_90);
             ESP_LOGE(TAG, "Login not successful");
-            vTaskDelay(10000 / portTICK_PERIOD_MS);
+            join_failed(rate);
         }
     } else {
         led_set_state(LED_ID_LORA, LED_STATE_DUTY_90);
@@ -102,6 +120,8 @@ static void ble_task_func(void *param)
     bool connection = false;
     bool receved;
 
+    xSemaphoreTake(ble_stack_sem, portMAX_DELAY);
+    profiler_begin(PROFILER_PHASE_BLE);
     ble_init();
 
     led_set_state(LED_ID_BLE, LED_STATE_DUTY_50);
@@ -127,6 +147,7 @@ static void ble_task_func(void *param)
                 }
                 break;
             case BLE_EVENT_LORA_UPDATED:
+                join_reset(); // new credentials, retry right away
                 xSemaphoreTake(join_mutex, portMAX_DELAY);
                 if (join_task) {
                     vTaskDelete(join_task);
@@ -141,6 +162,8 @@ static void ble_task_func(void *param)
     }
 
     ble_deinit();
+    profiler_end(PROFILER_PHASE_BLE);
+    xSemaphoreGive(ble_stack_sem);
     xSemaphoreGive(ble_task_done_sem);
     led_set_state(LED_ID_BLE, LED_STATE_OFF);
     vTaskDelete(NULL);
@@ -158,6 +181,25 @@ static void send_timer_callback(void *arg)
     xSemaphoreGive(send_sem);
 }
 
+static void measure_task_func(void *param)
+{
+    profile_measure();
+    ESP_LOGI(TAG, "Measure task stack high water mark %d B", uxTaskGetStackHighWaterMark(NULL));
+    xSemaphoreGive(measure_done_sem);
+    vTaskDelete(NULL);
+}
+
+#ifdef CONFIG_BLE_BEACON
+static void beacon_task_func(void *param)
+{
+    while (true) {
+        xSemaphoreTake(beacon_sem, portMAX_DELAY);
+        profile_send_beacon();
+        xSemaphoreGive(ble_stack_sem);
+    }
+}
+#endif /* CONFIG_BLE_BEACON */
+
 static void periodic_execute_func(void *param)
 {
     while (true) {
@@ -167,9 +209,21 @@ static void periodic_execute_func(void *param)
         led_set_state(LED_ID_LORA, LED_STATE_DUTY_5);
 
         gettimeofday(&send_time, NULL);
-        profile_measure();
+        if (measure_task) {
+            // measurement started on wake, overlapped with radio bring-up
+            xSemaphoreTake(measure_done_sem, portMAX_DELAY);
+            measure_task = NULL;
+        } else {
+            profile_measure();
+        }
         if (ble_has_context()) profile_send_ble();
         profile_send_lora();
+#ifdef CONFIG_BLE_BEACON
+        // the GATT server advertises the values itself, beacon only when the stack is free
+        if (xSemaphoreTake(ble_stack_sem, 0)) {
+            xSemaphoreGive(beacon_sem);
+        }
+#endif /* CONFIG_BLE_BEACON */
 
         led_set_state(LED_ID_LORA, LED_STATE_OFF);
 
@@ -180,16 +234,24 @@ static void periodic_execute_func(void *param)
 
 void app_main()
 {
-    ESP_LOGI(TAG, "Starting...");
+    wake_count++;
+    ESP_LOGI(TAG, "Starting (wake %d, cause %d)...", wake_count, esp_sleep_get_wakeup_cause());
 
-    esp_err_t err = nvs_flash_init();
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        err = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(err);
+    profiler_begin(PROFILER_PHASE_NVS_OPEN);
+    settings_init();
+    profiler_end(PROFILER_PHASE_NVS_OPEN);
 
-    ESP_ERROR_CHECK(nvs_open(STORAGE_NAME, NVS_READWRITE, &storage));
+#ifdef CONFIG_POWER_LIGHT_SLEEP
+    // light sleep while waiting for RX windows, the LoRa MAC ticks come from the RTC counter
+// @formatter:off
+    esp_pm_config_esp32_t pm_config = {
+            .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+            .min_freq_mhz = 40,
+            .light_sleep_enable = true
+    };
+// @formatter:on
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+#endif /* CONFIG_POWER_LIGHT_SLEEP */
 
     ESP_ERROR_CHECK(gpio_install_isr_service(ESP_INTR_FLAG_IRAM));
 
@@ -200,6 +262,12 @@ void app_main()
     send_sem = xSemaphoreCreateBinary();
     join_mutex = xSemaphoreCreateMutex();
     periodic_execute_mutex = xSemaphoreCreateMutex();
+    measure_done_sem = xSemaphoreCreateBinary();
+    ble_stack_sem = xSemaphoreCreateBinary();
+    xSemaphoreGive(ble_stack_sem);
+#ifdef CONFIG_BLE_BEACON
+    beacon_sem = xSemaphoreCreateBinary();
+#endif /* CONFIG_BLE_BEACON */
 
 // @formatter:off
     esp_timer_create_args_t timer_args = {
@@ -216,19 +284,33 @@ void app_main()
     gpio_isr_handler_add(BUTTON_BLE, button_isr_handler, NULL);
 
     xTaskCreate(periodic_execute_func, "periodic_execute_task", 2 * 1024, NULL, 10, &periodic_execute_task);
+#ifdef CONFIG_BLE_BEACON
+    // BT controller and host bring-up needs more stack than the periodic task has
+    xTaskCreate(beacon_task_func, "beacon_task", 4 * 1024, NULL, 10, &beacon_task);
+#endif /* CONFIG_BLE_BEACON */
 
+    profiler_begin(PROFILER_PHASE_PERIPHERALS_INIT);
     led_init();
     battery_measure_init();
-#if (SENSOR_TYPE == SENSOR_DHT10)
+    budget_update();
+#ifdef CONFIG_SENSOR_I2C
     i2c_init();
-#endif
+#endif /* CONFIG_SENSOR_I2C */
     sensor_init();
+    profile_init();
+
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && lora_has_session()) {
+        // start sensor conversion and battery read while the radio is reset and the MAC initialized,
+        // only when the periodic task is going to send right away
+        xTaskCreate(measure_task_func, "measure_task", MEASURE_TASK_STACK, NULL, 10, &measure_task);
+    }
+
     spi_init();
     lora_init();
-    profile_init();
+    profiler_end(PROFILER_PHASE_PERIPHERALS_INIT);
 
     //init done
-    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER) {
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && lora_is_joined()) {
         xSemaphoreGive(send_sem);
     } else {
         if (lora_is_joined()) {
@@ -251,7 +333,16 @@ void app_main()
     xSemaphoreTake(ble_task_done_sem, portMAX_DELAY);
     xSemaphoreTake(periodic_execute_mutex, portMAX_DELAY);
     vTaskDelete(periodic_execute_task);
+    if (measure_task) {
+        // measured but not sent, the task must not be cut by deep sleep in the middle of a bus transfer
+        xSemaphoreTake(measure_done_sem, portMAX_DELAY);
+        measure_task = NULL;
+    }
     xSemaphoreGive(periodic_execute_mutex);
+#ifdef CONFIG_BLE_BEACON
+    xSemaphoreTake(ble_stack_sem, portMAX_DELAY); // beacon may be still advertising
+    vTaskDelete(beacon_task);
+#endif /* CONFIG_BLE_BEACON */
 
     lora_deinit();
     led_deinit();
@@ -260,7 +351,14 @@ void app_main()
     esp_sleep_enable_ext0_wakeup(BUTTON_BLE, 0);
     if (lora_is_joined()) { // only if has session
         esp_sleep_enable_timer_wakeup(get_timer_timeout());
+    } else if (settings_get()->has_credentials) { // next join attempt
+        uint64_t delay = join_delay();
+        if (delay < lora_tx_delay()) {
+            delay = lora_tx_delay();
+        }
+        esp_sleep_enable_timer_wakeup(delay > JOIN_DELAY_MIN ? delay : JOIN_DELAY_MIN);
     }
-    ESP_LOGI(TAG, "Entering to deep sleep (run time %d)...", xTaskGetTickCount() * portTICK_PERIOD_MS);
+    battery_sleep();
+    ESP_LOGI(TAG, "Entering to deep sleep (wake %d, run time %lld us)...", wake_count, esp_timer_get_time());
     esp_deep_sleep_start();
 }
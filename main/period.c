@@ -0,0 +1,114 @@
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "period.h"
+#include "settings.h"
+#include "budget.h"
+#include "cayenne.h"
+
+#define FACTOR_ONE  10
+
+_Static_assert(PERIOD_MAX <= UINT16_MAX && PERIOD_MAX / 36 <= INT16_MAX, "Effective period does not fit the payload trailer");
+
+static const char *TAG = "period";
+
+static RTC_DATA_ATTR uint8_t battery = 100;
+
+void period_set_battery(uint8_t val)
+{
+    battery = val;
+}
+
+static uint32_t get_factor()
+{
+    const period_breakpoint_t *breakpoints = settings_get()->period_breakpoints;
+
+    // linear interpolation between breakpoints, starting from full battery at normal period
+    uint8_t prev_battery = 100;
+    uint8_t prev_factor = FACTOR_ONE;
+
+    for (int i = 0; i < PERIOD_BREAKPOINTS && breakpoints[i].factor; i++) {
+        const period_breakpoint_t *bp = &breakpoints[i];
+        if (bp->battery >= prev_battery) {
+            break; // breakpoints must be in descending battery order
+        }
+        if (battery >= bp->battery) {
+            return bp->factor + (prev_factor - bp->factor) * (battery - bp->battery) / (prev_battery - bp->battery);
+        }
+        prev_battery = bp->battery;
+        prev_factor = bp->factor;
+    }
+
+    return prev_factor;
+}
+
+bool period_breakpoints_valid(const period_breakpoint_t *breakpoints)
+{
+    uint8_t prev_battery = 100 + 1;
+    bool unused = false;
+
+    // used breakpoints first in descending battery order, only stretching the period
+    for (int i = 0; i < PERIOD_BREAKPOINTS; i++) {
+        const period_breakpoint_t *bp = &breakpoints[i];
+        if (!bp->factor) {
+            unused = true;
+            continue;
+        }
+        if (unused || bp->battery >= prev_battery || bp->factor < FACTOR_ONE) {
+            return false;
+        }
+        prev_battery = bp->battery;
+    }
+    return true;
+}
+
+uint32_t period_effective()
+{
+    uint32_t period = settings_get()->period;
+    uint32_t factor = get_factor();
+
+    if (factor != FACTOR_ONE) {
+        period = period * factor / FACTOR_ONE;
+        ESP_LOGI(TAG, "Battery %d%%, period stretched to %d s", battery, period);
+    }
+
+    if (budget_get()->period > period) {
+        period = budget_get()->period;
+        ESP_LOGI(TAG, "Energy budget, period stretched to %d s", period);
+    }
+
+    if (period > PERIOD_MAX) {
+        period = PERIOD_MAX;
+        ESP_LOGI(TAG, "Period limited to %d s", period);
+    }
+
+    return period;
+}
+
+size_t period_trailer_len(uint8_t format, uint32_t period)
+{
+    if (period == settings_get()->period) {
+        return 0;
+    }
+    return format == PAYL_FMT_CAYENNE ? PERIOD_TRAILER_MAX : sizeof(uint16_t);
+}
+
+size_t period_trailer_encode(uint8_t *buf, uint8_t format, uint32_t period)
+{
+    uint8_t len = 0;
+    if (period == settings_get()->period) {
+        return len;
+    }
+    if (format == PAYL_FMT_CAYENNE) {
+        int16_t period_val = period / 36; // 0.01 hour
+        buf[len++] = PERIOD_LPP_CHANNEL;
+        buf[len++] = CAYENNE_LPP_ANALOG_INPUT;
+        buf[len++] = period_val >> 8;
+        buf[len++] = period_val;
+    } else {
+        uint16_t period_val = period;
+        buf[len++] = period_val;
+        buf[len++] = period_val >> 8;
+    }
+    return len;
+}
@@ -0,0 +1,30 @@
+#ifndef PERIOD_H_
+#define PERIOD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PERIOD_BREAKPOINTS  4
+#define PERIOD_MAX          UINT16_MAX  // s, longest effective period, it must fit the payload trailer
+#define PERIOD_LPP_CHANNEL  100         // Cayenne LPP channel of the trailer, above all sample channels
+#define PERIOD_TRAILER_MAX  4           // B, Cayenne LPP trailer, native one is 2 B
+
+typedef struct
+{
+    uint8_t battery;    // %
+    uint8_t factor;     // period multiplier in 0.1, 0 = unused breakpoint
+} period_breakpoint_t;
+
+void period_set_battery(uint8_t battery);
+
+uint32_t period_effective();
+
+bool period_breakpoints_valid(const period_breakpoint_t *breakpoints);
+
+// effective period is appended to the uplink only when the battery or energy budget policy changed it, 0 B otherwise
+size_t period_trailer_len(uint8_t format, uint32_t period);
+
+size_t period_trailer_encode(uint8_t *buf, uint8_t format, uint32_t period);
+
+#endif /* PERIOD_H_ */
@@ -1,18 +1,34 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/spi_master.h"
 #include "driver/i2c.h"
 #include "driver/ledc.h"
+#include "esp_log.h"
 
 #include "peripherals.h"
 
 #define I2C_MASTER_NUM      1
-#define I2C_MASTER_FREQ_HZ  100000
+#define I2C_MASTER_FREQ_HZ  400000 /*!< fast mode, supported by all I2C sensors used */
 #define ACK_CHECK_EN        0x1 /*!< I2C master will check ack from slave*/
 #define ACK_CHECK_DIS       0x0 /*!< I2C master will not check ack from slave */
 #define ACK_VAL             0x0 /*!< I2C ack value */
 #define NACK_VAL            0x1 /*!< I2C nack value */
 
+typedef struct
+{
+    i2c_cmd_handle_t cmd;
+    esp_err_t err;      // first error while queueing, the batch is not sent then
+    uint8_t ops;
+    uint16_t bytes;
+} i2c_batch_t;
+
+static const char *TAG = "peripherals";
+
+static uint8_t i2c_cmd_buffer[I2C_LINK_RECOMMENDED_SIZE(2 * I2C_BATCH_MAX)];
+static i2c_batch_t i2c_batch;
+static SemaphoreHandle_t i2c_mutex = NULL; // command buffer is shared, held from batch begin to execute
+
 static ledc_channel_t led_channel[] = { LEDC_CHANNEL_0, LEDC_CHANNEL_1 };
 
 void spi_init()
@@ -29,7 +45,7 @@ void spi_init()
 void i2c_init()
 {
     int i2c_master_port = I2C_MASTER_NUM;
-    i2c_config_t conf;
+    i2c_config_t conf = { 0 };
     conf.mode = I2C_MODE_MASTER;
     conf.sda_io_num = I2C_SDA;
     conf.sda_pullup_en = GPIO_PULLUP_ENABLE;
@@ -38,53 +54,135 @@ void i2c_init()
     conf.master.clk_speed = I2C_MASTER_FREQ_HZ;
     ESP_ERROR_CHECK(i2c_param_config(i2c_master_port, &conf));
     ESP_ERROR_CHECK(i2c_driver_install(i2c_master_port, conf.mode, 0, 0, 0));
+
+    if (!i2c_mutex) {
+        i2c_mutex = xSemaphoreCreateMutex();
+    }
+}
+
+static void i2c_batch_check(esp_err_t err)
+{
+    if (err != ESP_OK && i2c_batch.err == ESP_OK) {
+        i2c_batch.err = err;
+    }
+}
+
+static bool i2c_batch_add(uint16_t len)
+{
+    if (len == 0) {
+        i2c_batch_check(ESP_ERR_INVALID_SIZE);
+    } else if (i2c_batch.ops >= I2C_BATCH_MAX) {
+        i2c_batch_check(ESP_ERR_NO_MEM);
+    }
+    i2c_batch.ops++;
+    return i2c_batch.err == ESP_OK;
 }
 
-int8_t i2c_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len)
+void i2c_batch_begin()
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (dev_id << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN);
-    i2c_master_write_byte(cmd, reg_addr, ACK_CHECK_EN);
+    xSemaphoreTake(i2c_mutex, portMAX_DELAY);
+    i2c_batch.cmd = i2c_cmd_link_create_static(i2c_cmd_buffer, sizeof(i2c_cmd_buffer));
+    i2c_batch.err = i2c_batch.cmd ? ESP_OK : ESP_ERR_NO_MEM;
+    i2c_batch.ops = 0;
+    i2c_batch.bytes = 0;
+}
+
+void i2c_batch_write(uint8_t dev_id, uint8_t reg_addr, const uint8_t *reg_data, uint16_t len)
+{
+    // register address alone is a valid write, e.g. a command without parameters
+    if (!i2c_batch_add(2 + len)) {
+        return;
+    }
+    i2c_batch_check(i2c_master_start(i2c_batch.cmd));
+    i2c_batch_check(i2c_master_write_byte(i2c_batch.cmd, (dev_id << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN));
+    i2c_batch_check(i2c_master_write_byte(i2c_batch.cmd, reg_addr, ACK_CHECK_EN));
     if (len > 0) {
-        i2c_master_write(cmd, reg_data, len, ACK_CHECK_EN);
+        i2c_batch_check(i2c_master_write(i2c_batch.cmd, reg_data, len, ACK_CHECK_EN));
     }
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    i2c_batch_check(i2c_master_stop(i2c_batch.cmd));
+    i2c_batch.bytes += 2 + len;
+}
+
+static void i2c_batch_read_phase(uint8_t dev_id, uint8_t *data, uint16_t len)
+{
+    i2c_batch_check(i2c_master_start(i2c_batch.cmd));
+    i2c_batch_check(i2c_master_write_byte(i2c_batch.cmd, (dev_id << 1) | I2C_MASTER_READ, ACK_CHECK_EN));
+    if (len > 1) {
+        i2c_batch_check(i2c_master_read(i2c_batch.cmd, data, len - 1, ACK_VAL));
+    }
+    i2c_batch_check(i2c_master_read_byte(i2c_batch.cmd, data + len - 1, NACK_VAL));
+    i2c_batch_check(i2c_master_stop(i2c_batch.cmd));
+    i2c_batch.bytes += 1 + len;
+}
+
+void i2c_batch_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len)
+{
+    if (!i2c_batch_add(len)) {
+        return;
+    }
+    // register address write followed by repeated start read
+    i2c_batch_check(i2c_master_start(i2c_batch.cmd));
+    i2c_batch_check(i2c_master_write_byte(i2c_batch.cmd, (dev_id << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN));
+    i2c_batch_check(i2c_master_write_byte(i2c_batch.cmd, reg_addr, ACK_CHECK_EN));
+    i2c_batch.bytes += 2;
+    i2c_batch_read_phase(dev_id, reg_data, len);
+}
+
+void i2c_batch_receive(uint8_t dev_id, uint8_t *data, uint16_t len)
+{
+    if (!i2c_batch_add(len)) {
+        return;
+    }
+    i2c_batch_read_phase(dev_id, data, len);
+}
+
+int8_t i2c_batch_execute()
+{
+    esp_err_t ret = i2c_batch.err;
+    if (ret == ESP_OK) {
+        ret = i2c_master_cmd_begin(I2C_MASTER_NUM, i2c_batch.cmd, 1000 / portTICK_RATE_MS);
+    } else {
+        ESP_LOGE(TAG, "Batch of %d operations not sent: %s", i2c_batch.ops, esp_err_to_name(ret));
+    }
+    if (i2c_batch.cmd) {
+        i2c_cmd_link_delete_static(i2c_batch.cmd);
+        i2c_batch.cmd = NULL;
+    }
+    xSemaphoreGive(i2c_mutex);
+
+    // 9 clocks per byte (8 data + ack), start/stop overhead neglected
+    ESP_LOGD(TAG, "Batch %d bytes, bus time %d us", i2c_batch.bytes, i2c_batch.bytes * 9 * 1000 / (I2C_MASTER_FREQ_HZ / 1000));
+
     return ret == ESP_OK ? 0 : -1;
 }
 
+int8_t i2c_write(uint8_t dev_id, uint8_t reg_addr, const uint8_t *reg_data, uint16_t len)
+{
+    i2c_batch_begin();
+    i2c_batch_write(dev_id, reg_addr, reg_data, len);
+    return i2c_batch_execute();
+}
+
 int8_t i2c_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len)
 {
     if (len == 0) {
         return 0;
     }
 
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (dev_id << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN);
-    i2c_master_write_byte(cmd, reg_addr, ACK_CHECK_EN);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_RATE_MS);
-    if (ret != ESP_OK) {
-        return -1;
-    }
-    i2c_cmd_link_delete(cmd);
-
-    vTaskDelay(30 / portTICK_RATE_MS);
+    i2c_batch_begin();
+    i2c_batch_read(dev_id, reg_addr, reg_data, len);
+    return i2c_batch_execute();
+}
 
-    cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (dev_id << 1) | I2C_MASTER_READ, ACK_CHECK_EN);
-    if (len > 1) {
-        i2c_master_read(cmd, reg_data, len - 1, ACK_VAL);
+int8_t i2c_receive(uint8_t dev_id, uint8_t *data, uint16_t len)
+{
+    if (len == 0) {
+        return 0;
     }
-    i2c_master_read_byte(cmd, reg_data + len - 1, NACK_VAL);
-    i2c_master_stop(cmd);
-    ret = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret == ESP_OK ? 0 : -1;
+
+    i2c_batch_begin();
+    i2c_batch_receive(dev_id, data, len);
+    return i2c_batch_execute();
 }
 
 void led_init()
@@ -35,10 +35,24 @@ void spi_init();
 
 void i2c_init();
 
-int8_t i2c_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
+#define I2C_BATCH_MAX   8   // device operations in one batch
+
+void i2c_batch_begin();
+
+void i2c_batch_write(uint8_t dev_id, uint8_t reg_addr, const uint8_t *reg_data, uint16_t len);
+
+void i2c_batch_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
+
+void i2c_batch_receive(uint8_t dev_id, uint8_t *data, uint16_t len);
+
+int8_t i2c_batch_execute();
+
+int8_t i2c_write(uint8_t dev_id, uint8_t reg_addr, const uint8_t *reg_data, uint16_t len);
 
 int8_t i2c_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
 
+int8_t i2c_receive(uint8_t dev_id, uint8_t *data, uint16_t len);
+
 void led_init();
 
 void led_deinit();
@@ -1,6 +1,8 @@
 #ifndef PROFILE_H_
 #define PROFILE_H_
 
+#include "sdkconfig.h"
+
 void profile_init();
 
 void profile_measure();
@@ -9,6 +11,10 @@ void profile_send_ble();
 
 void profile_send_lora();
 
+#ifdef CONFIG_BLE_BEACON
+void profile_send_beacon();
+#endif /* CONFIG_BLE_BEACON */
+
 void profile_deinit();
 
 #endif /* PROFILE_H_ */
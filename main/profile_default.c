@@ -1,30 +1,53 @@
 #include "sdkconfig.h"
 #ifdef CONFIG_SENSOR_PROFILE_DEFAULT
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "nvs.h"
 #include "esp_log.h"
 
 #include "profile.h"
+#include "profiler.h"
 #include "peripherals.h"
 #include "battery.h"
 #include "sensor.h"
 #include "ble.h"
 #include "lora.h"
-#include "storage_key.h"
+#include "ldl_mac.h"
+#include "settings.h"
 #include "cayenne.h"
-
-typedef struct
-{
-    uint16_t humidity;
-    int16_t temperature;
-    uint8_t battery;
-} __attribute__((packed)) native_payload_t;
+#include "batch.h"
+#include "codec.h"
+#include "report.h"
+#include "period.h"
+#include "budget.h"
+#include "schema.h"
+#include "history.h"
+
+// @formatter:off
+#define SCHEMA_DEFAULT(X) \
+    X(humidity,         uint16_t,   YES,    RELATIVE_HUMIDITY,  50) \
+    X(temperature,      int16_t,    YES,    TEMPERATURE,        10) \
+    X(battery,          uint8_t,    YES,    NONE,               1)  \
+    X(battery_voltage,  uint16_t,   NO,     ANALOG_INPUT,       10)
+// @formatter:on
+
+SCHEMA_NATIVE_STRUCT(SCHEMA_DEFAULT, native_payload_t);
+SCHEMA_NATIVE_ENCODER(SCHEMA_DEFAULT, sample, native_payload_t, sample_t)
+SCHEMA_LPP_ENCODER(SCHEMA_DEFAULT, sample, sample_t)
+
+#define LPP_SAMPLE_LEN      SCHEMA_LPP_LEN(SCHEMA_DEFAULT)
+#define LPP_SAMPLE_CHANNELS SCHEMA_LPP_CHANNELS(SCHEMA_DEFAULT)
+
+_Static_assert(LPP_SAMPLE_LEN + PERIOD_TRAILER_MAX <= LDL_MAX_PACKET, "LPP sample does not fit a packet");
+_Static_assert(sizeof(native_payload_t) + sizeof(uint16_t) <= LDL_MAX_PACKET, "Native sample does not fit a packet");
+_Static_assert(LPP_SAMPLE_CHANNELS * BATCH_SIZE_MAX < PERIOD_LPP_CHANNEL, "LPP sample channels overlap the period channel");
 
 static const char *TAG = "profile_default";
 
 static float humidity;
 static float temperature;
+static bool valid; // sensor read succeeded
 static uint8_t battery;
 static float battery_voltage;
 
@@ -36,122 +59,127 @@ void profile_init()
 void profile_measure()
 {
     ESP_LOGI(TAG, "Measure");
-    sensor_read(&humidity, &temperature);
+    profiler_begin(PROFILER_PHASE_SENSOR_READ);
+    sensor_start();
+
+    // battery is measured while the sensor conversion runs
+    profiler_begin(PROFILER_PHASE_BATTERY_MEASURE);
     battery_measure(&battery, &battery_voltage);
+    profiler_end(PROFILER_PHASE_BATTERY_MEASURE);
+
+    while (!sensor_poll()) {
+        vTaskDelay(SENSOR_POLL_INTERVAL / portTICK_PERIOD_MS);
+    }
+    valid = sensor_complete(&humidity, &temperature);
+    profiler_end(PROFILER_PHASE_SENSOR_READ);
+    period_set_battery(battery);
+}
+
+static size_t max_payload_len(uint8_t format, uint8_t count)
+{
+    switch (format) {
+        case PAYL_FMT_CAYENNE:
+            return count * LPP_SAMPLE_LEN;
+        case PAYL_FMT_DELTA:
+            return CODEC_DELTA_HEADER_LEN + CODEC_DELTA_BASE_LEN + (count - 1) * CODEC_DELTA_SAMPLE_MAX_LEN;
+        default:
+            return count * sizeof(native_payload_t);
+    }
 }
 
 void profile_send_lora()
 {
-    uint8_t format = 0;
-    nvs_get_u8(storage, STORAGE_KEY_PAYL_FMT, &format);
+    if (!valid) {
+        ESP_LOGW(TAG, "No valid sample, not sent");
+        return;
+    }
+    history_add(humidity, temperature, battery);
+
+    sample_t sample;
+    sample.humidity = humidity * 100;
+    sample.temperature = temperature * 100;
+    sample.battery = battery;
+    sample.battery_voltage = battery_voltage * 1000;
+
+    report_reason_t reason = report_is_due(&sample);
+    if (!reason) {
+        ESP_LOGI(TAG, "Within deadband, skipping");
+        return;
+    }
+    report_accept(&sample);
+    batch_push(&sample);
+
+    uint8_t format = settings_get()->payl_fmt;
+    uint8_t count = batch_count();
+    uint32_t period = period_effective();
+    uint8_t mtu = lora_mtu() - period_trailer_len(format, period);
+
+    // wait for more samples, unless the next one would not fit the current data rate
+    uint8_t batch = budget_get()->batch;
+    // change beyond the deadband is an alarm, sent right away; the first sample and the heartbeat are
+    // not alarms, but they tell the backend the node is alive and must not wait for a full batch either
+    bool alarm = reason == REPORT_CHANGE;
+    bool flush = alarm || reason == REPORT_FIRST || reason == REPORT_HEARTBEAT;
+    if (!flush && count < batch && max_payload_len(format, count + 1) <= mtu) {
+        ESP_LOGI(TAG, "Batched %d/%d samples", count, batch);
+        return;
+    }
 
-    uint8_t *payload;
+    uint8_t payload[UINT8_MAX];
     size_t length = 0;
-
-    if (format == 1) {
-        //cayenne lpp payload
-        uint8_t humidity_val = humidity * 2;
-        int16_t temperature_val = temperature * 10;
-        int16_t battery_val = battery_voltage * 100;
-
-        uint8_t len = 0;
-        uint8_t lpp[11];
-        lpp[len++] = 1;
-        lpp[len++] = CAYENNE_LPP_RELATIVE_HUMIDITY;
-        lpp[len++] = humidity_val;
-        lpp[len++] = 2;
-        lpp[len++] = CAYENNE_LPP_TEMPERATURE;
-        lpp[len++] = temperature_val >> 8;
-        lpp[len++] = temperature_val;
-        lpp[len++] = 3;
-        lpp[len++] = CAYENNE_LPP_ANALOG_INPUT;
-        lpp[len++] = battery_val >> 8;
-        lpp[len++] = battery_val;
-
-        ESP_LOG_BUFFER_HEX_LEVEL(TAG, lpp, len, ESP_LOG_INFO);
-
-        payload = lpp;
-        length = len;
+    uint8_t encoded = 0;
+
+    if (format == PAYL_FMT_DELTA) {
+        //delta compressed payload
+        codec_delta_t codec;
+        codec_delta_init(&codec, payload, mtu);
+        while (encoded < count && codec_delta_add(&codec, batch_get(encoded))) {
+            encoded++;
+        }
+        length = codec.len;
     } else {
-        //native payload
-        native_payload_t native_payload;
-        native_payload.humidity = humidity * 100;
-        native_payload.temperature = temperature * 100;
-        native_payload.battery = battery;
-
-        payload = (uint8_t*) &native_payload;
-        length = sizeof(native_payload_t);
+        size_t sample_len = format == PAYL_FMT_CAYENNE ? LPP_SAMPLE_LEN : sizeof(native_payload_t);
+        while (encoded < count && length + sample_len <= mtu) {
+            if (format == PAYL_FMT_CAYENNE) {
+                //cayenne lpp payload
+                length += sample_encode_lpp(&payload[length], batch_get(encoded), encoded * LPP_SAMPLE_CHANNELS);
+            } else {
+                //native payload
+                length += sample_encode_native(&payload[length], batch_get(encoded));
+            }
+            encoded++;
+        }
+    }
+
+    if (!encoded) {
+        // the MTU of the current data rate is smaller than one sample, keep it batched
+        ESP_LOGW(TAG, "Sample does not fit %d B, not sent", mtu);
+        return;
     }
 
-    lora_send(payload, length);
+    length += period_trailer_encode(&payload[length], format, period);
+
+    lora_send(payload, length, alarm);
+    batch_drop(encoded);
 }
 
 void profile_send_ble()
 {
     ble_set_battery(battery);
-    ble_set_enviromental(humidity, temperature);
-}
-
-void profile_execute(bool lora, bool ble)
-{
-    ESP_LOGI(TAG, "Execute");
-    uint8_t battery;
-    float battery_voltage;
-    battery_measure(&battery, &battery_voltage);
-
-    float humidity, temperature;
-    sensor_read(&humidity, &temperature);
-
-    if (ble) {
-        ble_set_battery(battery);
+    if (valid) {
         ble_set_enviromental(humidity, temperature);
     }
+}
 
-    if (lora) {
-        uint8_t format = 0;
-        nvs_get_u8(storage, STORAGE_KEY_PAYL_FMT, &format);
-
-        uint8_t *payload;
-        size_t length = 0;
-
-        if (format == 1) {
-            //cayenne lpp payload
-            uint8_t humidity_val = humidity * 2;
-            int16_t temperature_val = temperature * 10;
-            int16_t battery_val = battery_voltage * 100;
-
-            uint8_t len = 0;
-            uint8_t lpp[11];
-            lpp[len++] = 1;
-            lpp[len++] = CAYENNE_LPP_RELATIVE_HUMIDITY;
-            lpp[len++] = humidity_val;
-            lpp[len++] = 2;
-            lpp[len++] = CAYENNE_LPP_TEMPERATURE;
-            lpp[len++] = temperature_val >> 8;
-            lpp[len++] = temperature_val;
-            lpp[len++] = 3;
-            lpp[len++] = CAYENNE_LPP_ANALOG_INPUT;
-            lpp[len++] = battery_val >> 8;
-            lpp[len++] = battery_val;
-
-            ESP_LOG_BUFFER_HEX_LEVEL(TAG, lpp, len, ESP_LOG_INFO);
-
-            payload = lpp;
-            length = len;
-        } else {
-            //native payload
-            native_payload_t native_payload;
-            native_payload.humidity = humidity * 100;
-            native_payload.temperature = temperature * 100;
-            native_payload.battery = battery;
-
-            payload = (uint8_t*) &native_payload;
-            length = sizeof(native_payload_t);
-        }
-
-        lora_send(payload, length);
+#ifdef CONFIG_BLE_BEACON
+void profile_send_beacon()
+{
+    if (!valid) {
+        return;
     }
+    ble_beacon(humidity, temperature, battery);
 }
+#endif /* CONFIG_BLE_BEACON */
 
 void profile_deinit()
 {
@@ -1,39 +1,73 @@
 #include "sdkconfig.h"
-#ifdef SENSOR_PROFILE_SOIL_MOSTURE
-TODO whole refacktor
+#ifdef CONFIG_SENSOR_PROFILE_SOIL_MOSTURE
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "nvs.h"
 #include "esp_log.h"
 #include "driver/adc.h"
 #include "esp_adc_cal.h"
 
 #include "profile.h"
+#include "profiler.h"
 #include "peripherals.h"
 #include "battery.h"
 #include "sensor.h"
 #include "ble.h"
 #include "lora.h"
-#include "storage_key.h"
-#include "cayenne.h"
+#include "ldl_mac.h"
+#include "settings.h"
+#include "period.h"
+#include "schema.h"
+#include "burst.h"
+#include "history.h"
 
 #define GPIO_POWER      GPIO_NUM_32
 #define INPUT_CHANNEL   ADC1_CHANNEL_7
 #define ADC_ATTEN       ADC_ATTEN_DB_11
 #define ADC_WIDTH       ADC_WIDTH_BIT_12
 
-static const char *TAG = "profile_soil_mosture";
-
 typedef struct
 {
-    uint16_t humidity;
-    int16_t temperature;
-    uint8_t battery;
-    uint16_t soil_moisture;
-} __attribute__((packed)) native_payload_t;
+    uint16_t humidity;          // 0.01 %
+    int16_t temperature;        // 0.01 °C
+    uint8_t battery;            // %
+    uint16_t battery_voltage;   // mV
+    uint16_t soil_moisture;     // 0.01 V
+    uint16_t soil_noise;        // mV
+    uint16_t soil_time;         // ms, probe power on to settled value
+} soil_sample_t;
+
+// @formatter:off
+#define SCHEMA_SOIL_MOISTURE(X) \
+    X(humidity,         uint16_t,   YES,    RELATIVE_HUMIDITY,  50) \
+    X(temperature,      int16_t,    YES,    TEMPERATURE,        10) \
+    X(battery,          uint8_t,    YES,    NONE,               1)  \
+    X(battery_voltage,  uint16_t,   NO,     ANALOG_INPUT,       10) \
+    X(soil_moisture,    uint16_t,   YES,    ANALOG_INPUT,       1)  \
+    X(soil_noise,       uint16_t,   YES,    NONE,               1)  \
+    X(soil_time,        uint16_t,   YES,    NONE,               1)
+// @formatter:on
+
+SCHEMA_NATIVE_STRUCT(SCHEMA_SOIL_MOISTURE, native_payload_t);
+SCHEMA_NATIVE_ENCODER(SCHEMA_SOIL_MOISTURE, soil_sample, native_payload_t, soil_sample_t)
+SCHEMA_LPP_ENCODER(SCHEMA_SOIL_MOISTURE, soil_sample, soil_sample_t)
+
+_Static_assert(SCHEMA_LPP_LEN(SCHEMA_SOIL_MOISTURE) + PERIOD_TRAILER_MAX <= LDL_MAX_PACKET, "LPP sample does not fit a packet");
+_Static_assert(sizeof(native_payload_t) + sizeof(uint16_t) <= LDL_MAX_PACKET, "Native sample does not fit a packet");
+_Static_assert(SCHEMA_LPP_CHANNELS(SCHEMA_SOIL_MOISTURE) < PERIOD_LPP_CHANNEL, "LPP sample channels overlap the period channel");
+
+static const char *TAG = "profile_soil_mosture";
 
 static esp_adc_cal_characteristics_t adc_char;
 
+static float humidity;
+static float temperature;
+static bool valid; // sensor read succeeded
+static uint8_t battery;
+static float battery_voltage;
+static float soil_voltage;
+static uint16_t soil_noise;
+static uint16_t soil_time;
+
 void profile_init()
 {
     ESP_LOGI(TAG, "Init");
@@ -48,84 +82,94 @@ void profile_init()
     esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN, ADC_WIDTH, 1100, &adc_char);
 }
 
-void profile_execute(bool lora, bool ble)
+void profile_measure()
 {
-    ESP_LOGI(TAG, "Execute");
+    ESP_LOGI(TAG, "Measure");
+    profiler_begin(PROFILER_PHASE_SENSOR_READ);
+    sensor_start();
 
-    uint8_t battery;
-    float battery_voltage;
+    profiler_begin(PROFILER_PHASE_BATTERY_MEASURE);
     battery_measure(&battery, &battery_voltage);
+    profiler_end(PROFILER_PHASE_BATTERY_MEASURE);
 
-    float humidity, temperature;
-    sensor_read(&humidity, &temperature);
+    while (!sensor_poll()) {
+        vTaskDelay(SENSOR_POLL_INTERVAL / portTICK_PERIOD_MS);
+    }
+    valid = sensor_complete(&humidity, &temperature);
 
+    // DMA burst from probe power on, the burst itself waits for the probe to settle
+    burst_result_t burst;
     gpio_set_level(GPIO_POWER, 1);
-    vTaskDelay(200 / portTICK_PERIOD_MS);
-
-    int adc_reading;
-    for (int i = 0; i < 30; i++) {
-        adc_reading = adc1_get_raw(INPUT_CHANNEL);
-        ESP_LOGI(TAG, "Voltage %d %dmV", adc_reading, esp_adc_cal_raw_to_voltage(adc_reading, &adc_char));
-        vTaskDelay(100 / portTICK_PERIOD_MS);
-    }
+    burst_read(INPUT_CHANNEL, &burst);
     gpio_set_level(GPIO_POWER, 0);
 
-    float voltage = esp_adc_cal_raw_to_voltage(adc_reading, &adc_char) / 1000.0;
+    uint32_t voltage = esp_adc_cal_raw_to_voltage(burst.value, &adc_char);
+    soil_voltage = voltage / 1000.0;
+    soil_noise = esp_adc_cal_raw_to_voltage(burst.value + burst.noise, &adc_char) - voltage;
+    soil_time = burst.time / 1000;
+    ESP_LOGI(TAG, "Voltage %dmV, noise %dmV, %d ms", voltage, soil_noise, soil_time);
+    profiler_end(PROFILER_PHASE_SENSOR_READ);
+    period_set_battery(battery);
+}
 
-    if (ble) {
-        ble_set_battery(battery);
+void profile_send_ble()
+{
+    ble_set_battery(battery);
+    if (valid) {
         ble_set_enviromental(humidity, temperature);
-        //TODO ble_set_soil_mosture
     }
+    //TODO ble_set_soil_mosture
+}
+
+#ifdef CONFIG_BLE_BEACON
+void profile_send_beacon()
+{
+    if (!valid) {
+        return;
+    }
+    ble_beacon(humidity, temperature, battery);
+}
+#endif /* CONFIG_BLE_BEACON */
 
-    if (lora) {
-        uint8_t format = 0;
-        nvs_get_u8(storage, STORAGE_KEY_PAYL_FMT, &format);
-
-        uint8_t *payload;
-        size_t length = 0;
-
-        if (format == 1) {
-            //cayenne lpp payload
-            uint8_t humidity_val = humidity * 2;
-            int16_t temperature_val = temperature * 10;
-            int16_t soil_moisture = voltage * 100;
-            int16_t battery_val = battery_voltage * 100;
-
-            uint8_t len = 0;
-            uint8_t lpp[19];
-            lpp[len++] = 1;
-            lpp[len++] = CAYENNE_LPP_RELATIVE_HUMIDITY;
-            lpp[len++] = humidity_val;
-            lpp[len++] = 2;
-            lpp[len++] = CAYENNE_LPP_TEMPERATURE;
-            lpp[len++] = temperature_val >> 8;
-            lpp[len++] = temperature_val;
-            lpp[len++] = 3;
-            lpp[len++] = CAYENNE_LPP_ANALOG_INPUT;
-            lpp[len++] = battery >> 8;
-            lpp[len++] = battery;
-            lpp[len++] = 4;
-            lpp[len++] = CAYENNE_LPP_ANALOG_INPUT;
-            lpp[len++] = soil_moisture >> 8;
-            lpp[len++] = soil_moisture;
-
-            payload = lpp;
-            length = len;
-        } else {
-            //native payload
-            native_payload_t native_payload;
-            native_payload.humidity = humidity * 100;
-            native_payload.temperature = temperature * 100;
-            native_payload.battery = battery;
-            native_payload.soil_moisture = voltage * 100;
-
-            payload = (uint8_t*) &native_payload;
-            length = sizeof(native_payload_t);
-        }
-
-        lora_send((uint8_t*) payload, length);
+void profile_send_lora()
+{
+    if (!valid) {
+        ESP_LOGW(TAG, "No valid sample, not sent");
+        return;
+    }
+    history_add(humidity, temperature, battery);
+
+    soil_sample_t sample;
+    sample.humidity = humidity * 100;
+    sample.temperature = temperature * 100;
+    sample.battery = battery;
+    sample.battery_voltage = battery_voltage * 1000;
+    sample.soil_moisture = soil_voltage * 100;
+    sample.soil_noise = soil_noise;
+    sample.soil_time = soil_time;
+
+    uint8_t format = settings_get()->payl_fmt;
+    uint32_t period = period_effective();
+    uint8_t mtu = lora_mtu() - period_trailer_len(format, period);
+
+    uint8_t payload[LDL_MAX_PACKET];
+    size_t length;
+
+    if (format == PAYL_FMT_CAYENNE) {
+        //cayenne lpp payload
+        length = soil_sample_encode_lpp(payload, &sample, 0);
+    } else {
+        //native payload, delta format is not supported by this profile
+        length = soil_sample_encode_native(payload, &sample);
     }
+
+    if (length > mtu) {
+        ESP_LOGW(TAG, "Sample does not fit %d B, not sent", mtu);
+        return;
+    }
+    length += period_trailer_encode(&payload[length], format, period);
+
+    lora_send(payload, length, false);
 }
 
 void profile_deinit()
@@ -134,4 +178,4 @@ void profile_deinit()
     gpio_set_direction(GPIO_POWER, GPIO_MODE_DISABLE);
 }
 
-#endif /* SENSOR_PROFILE_SOIL_MOSTURE */
+#endif /* CONFIG_SENSOR_PROFILE_SOIL_MOSTURE */
@@ -0,0 +1,79 @@
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "profiler.h"
+
+typedef struct
+{
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t count;
+} phase_stats_t;
+
+static const char *TAG = "profiler";
+
+static RTC_DATA_ATTR phase_stats_t phase_stats[PROFILER_PHASE_NB];
+
+static int64_t phase_begin[PROFILER_PHASE_NB];
+static bool phase_started[PROFILER_PHASE_NB];
+
+// phases are recorded from several tasks, BLE reads the stats from its own
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+void profiler_begin(profiler_phase_t phase)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&lock);
+    phase_begin[phase] = now;
+    phase_started[phase] = true;
+    portEXIT_CRITICAL(&lock);
+}
+
+void profiler_end(profiler_phase_t phase)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&lock);
+    bool started = phase_started[phase];
+    int64_t begin = phase_begin[phase];
+    phase_started[phase] = false;
+    portEXIT_CRITICAL(&lock);
+
+    if (!started) {
+        return; // not started in this wake
+    }
+    profiler_record(phase, now - begin);
+}
+
+void profiler_record(profiler_phase_t phase, uint32_t duration)
+{
+    phase_stats_t *stats = &phase_stats[phase];
+
+    portENTER_CRITICAL(&lock);
+    if (stats->count == 0 || duration < stats->min) {
+        stats->min = duration;
+    }
+    if (duration > stats->max) {
+        stats->max = duration;
+    }
+    stats->sum += duration;
+    stats->count++;
+    portEXIT_CRITICAL(&lock);
+
+    ESP_LOGD(TAG, "Phase %d took %d us", phase, duration);
+}
+
+void profiler_get_stats(profiler_stats_t stats[PROFILER_PHASE_NB])
+{
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < PROFILER_PHASE_NB; i++) {
+        stats[i].min = phase_stats[i].min;
+        stats[i].avg = phase_stats[i].count ? phase_stats[i].sum / phase_stats[i].count : 0;
+        stats[i].max = phase_stats[i].max;
+        stats[i].count = phase_stats[i].count;
+    }
+    portEXIT_CRITICAL(&lock);
+}
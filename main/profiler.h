@@ -0,0 +1,36 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+
+typedef enum
+{
+    PROFILER_PHASE_NVS_OPEN,
+    PROFILER_PHASE_PERIPHERALS_INIT,
+    PROFILER_PHASE_SENSOR_READ,
+    PROFILER_PHASE_BATTERY_MEASURE,
+    PROFILER_PHASE_LORA_JOIN,
+    PROFILER_PHASE_LORA_TX,
+    PROFILER_PHASE_LORA_RX,
+    PROFILER_PHASE_BLE,
+    PROFILER_PHASE_WAKE_TO_TX,
+    PROFILER_PHASE_NB
+} profiler_phase_t;
+
+typedef struct
+{
+    uint32_t min;   // us
+    uint32_t avg;   // us
+    uint32_t max;   // us
+    uint32_t count;
+} __attribute__((packed)) profiler_stats_t;
+
+void profiler_begin(profiler_phase_t phase);
+
+void profiler_end(profiler_phase_t phase);
+
+void profiler_record(profiler_phase_t phase, uint32_t duration);
+
+void profiler_get_stats(profiler_stats_t stats[PROFILER_PHASE_NB]);
+
+#endif /* PROFILER_H_ */
@@ -0,0 +1,50 @@
+#include <stdlib.h>
+#include <sys/time.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "report.h"
+#include "settings.h"
+
+static const char *TAG = "report";
+
+static RTC_DATA_ATTR bool has_last = false;
+static RTC_DATA_ATTR sample_t last_sample;
+static RTC_DATA_ATTR time_t last_time;
+
+report_reason_t report_is_due(const sample_t *sample)
+{
+    const settings_t *settings = settings_get();
+
+    if (settings->deadband_hum == 0 && settings->deadband_temp == 0) {
+        return REPORT_ALWAYS; // report on change disabled
+    }
+    if (!has_last) {
+        return REPORT_FIRST;
+    }
+    if (settings->deadband_hum && abs(sample->humidity - last_sample.humidity) >= settings->deadband_hum) {
+        return REPORT_CHANGE;
+    }
+    if (settings->deadband_temp && abs(sample->temperature - last_sample.temperature) >= settings->deadband_temp) {
+        return REPORT_CHANGE;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    if (settings->heartbeat && now.tv_sec - last_time >= settings->heartbeat * 60) {
+        ESP_LOGI(TAG, "Heartbeat");
+        return REPORT_HEARTBEAT;
+    }
+
+    return REPORT_NONE;
+}
+
+void report_accept(const sample_t *sample)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    last_sample = *sample;
+    last_time = now.tv_sec;
+    has_last = true;
+}
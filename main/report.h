@@ -0,0 +1,17 @@
+#ifndef REPORT_H_
+#define REPORT_H_
+
+#include <stdbool.h>
+
+#include "batch.h"
+
+typedef enum
+{
+    REPORT_NONE, REPORT_ALWAYS, REPORT_FIRST, REPORT_CHANGE, REPORT_HEARTBEAT
+} report_reason_t;
+
+report_reason_t report_is_due(const sample_t *sample);
+
+void report_accept(const sample_t *sample);
+
+#endif /* REPORT_H_ */
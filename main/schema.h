@@ -0,0 +1,77 @@
+#ifndef SCHEMA_H_
+#define SCHEMA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "cayenne.h"
+
+/*
+ * Measurement schema, a list of X(name, type, native, lpp, scale) entries:
+ *   name   - field of the sample struct, also the native payload field
+ *   type   - native payload field type
+ *   native - YES when the field is part of the native payload, NO otherwise
+ *   lpp    - Cayenne LPP data type without the CAYENNE_LPP_ prefix, NONE when not sent in LPP
+ *   scale  - sample units per LPP unit
+ *
+ * Native payload struct, LPP lengths and encoders are expanded from the list at compile time.
+ */
+
+#define CAYENNE_LPP_NONE                        (0U)
+#define CAYENNE_LPP_NONE_SIZE                   0
+
+#define SCHEMA_NATIVE_FIELD_YES(type, name)     type name;
+#define SCHEMA_NATIVE_FIELD_NO(type, name)
+#define SCHEMA_NATIVE_FIELD(name, type, native, lpp, scale) SCHEMA_NATIVE_FIELD_##native(type, name)
+
+#define SCHEMA_NATIVE_COPY_YES(name)            native.name = sample->name;
+#define SCHEMA_NATIVE_COPY_NO(name)
+#define SCHEMA_NATIVE_COPY(name, type, native, lpp, scale) SCHEMA_NATIVE_COPY_##native(name)
+
+#define SCHEMA_LPP_FIELD_LEN(name, type, native, lpp, scale) \
+    + (CAYENNE_LPP_##lpp##_SIZE ? 2 + CAYENNE_LPP_##lpp##_SIZE : 0)
+#define SCHEMA_LPP_FIELD_CHANNELS(name, type, native, lpp, scale) \
+    + (CAYENNE_LPP_##lpp##_SIZE ? 1 : 0)
+
+#define SCHEMA_LPP_FIELD_ENCODE(name, type, native, lpp, scale) \
+    if (CAYENNE_LPP_##lpp##_SIZE) { \
+        int32_t val = sample->name / (scale); \
+        buf[len++] = ++channel; \
+        buf[len++] = CAYENNE_LPP_##lpp; \
+        for (int i = CAYENNE_LPP_##lpp##_SIZE - 1; i >= 0; i--) { \
+            buf[len++] = val >> (8 * i); \
+        } \
+    }
+
+// length of one sample in LPP format, channels it occupies
+#define SCHEMA_LPP_LEN(SCHEMA)          (0 SCHEMA(SCHEMA_LPP_FIELD_LEN))
+#define SCHEMA_LPP_CHANNELS(SCHEMA)     (0 SCHEMA(SCHEMA_LPP_FIELD_CHANNELS))
+
+// packed native payload struct
+#define SCHEMA_NATIVE_STRUCT(SCHEMA, native_type) \
+    typedef struct \
+    { \
+        SCHEMA(SCHEMA_NATIVE_FIELD) \
+    } __attribute__((packed)) native_type
+
+// size_t <prefix>_encode_native(uint8_t *buf, const sample_type *sample)
+#define SCHEMA_NATIVE_ENCODER(SCHEMA, prefix, native_type, sample_type) \
+    static size_t prefix##_encode_native(uint8_t *buf, const sample_type *sample) \
+    { \
+        native_type native; \
+        SCHEMA(SCHEMA_NATIVE_COPY) \
+        memcpy(buf, &native, sizeof(native_type)); \
+        return sizeof(native_type); \
+    }
+
+// size_t <prefix>_encode_lpp(uint8_t *buf, const sample_type *sample, uint8_t channel), channels start at channel + 1
+#define SCHEMA_LPP_ENCODER(SCHEMA, prefix, sample_type) \
+    static size_t prefix##_encode_lpp(uint8_t *buf, const sample_type *sample, uint8_t channel) \
+    { \
+        size_t len = 0; \
+        SCHEMA(SCHEMA_LPP_FIELD_ENCODE) \
+        return len; \
+    }
+
+#endif /* SCHEMA_H_ */
@@ -1,119 +1,133 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "driver/gpio.h"
+#include "esp_attr.h"
 #include "esp_log.h"
-#include "esp_err.h"
 #include "sdkconfig.h"
 
 #include "sensor.h"
+#include "sensor_driver.h"
 #include "peripherals.h"
 
-#define ONE_WIRE                I2C_SDA
-
-#define DHT10_I2C_ADDR          0x38
-#define DHT10_RESET_REG_ADDR    0xba
-#define DHT10_INIT_REG_ADDR     0xe1
-#define DHT10_MEASURE_REG_ADDR  0xac
+#if !defined(CONFIG_SENSOR_I2C) && !defined(CONFIG_SENSOR_DHT22)
+#error "No sensor driver enabled"
+#endif
 
 static const char *TAG = "sensor";
 
+// first present sensor provides the reported humidity and temperature, most accurate first
+static const sensor_driver_t *drivers[] = {
+#ifdef CONFIG_SENSOR_I2C
+        &sensor_sht3x,
+        &sensor_bme280,
+        &sensor_dht10,
+#endif /* CONFIG_SENSOR_I2C */
+#ifdef CONFIG_SENSOR_DHT22
+        &sensor_dht22,
+#endif /* CONFIG_SENSOR_DHT22 */
+};
+
+#define DRIVERS_COUNT   (sizeof(drivers) / sizeof(sensor_driver_t*))
+
+static RTC_DATA_ATTR uint8_t present = 0; // bit per driver, 0 = not probed yet
+
+static uint8_t pending = 0;
+static uint8_t failed = 0;
+
 void sensor_init()
 {
-#ifdef CONFIG_SENSOR_TYPE_DHT10
-    ESP_ERROR_CHECK(i2c_write(DHT10_I2C_ADDR, DHT10_RESET_REG_ADDR, NULL, 0));
-
-    uint8_t init_param[] = { 0x08, 0x00 };
-    ESP_ERROR_CHECK(i2c_write(DHT10_I2C_ADDR, DHT10_INIT_REG_ADDR, init_param, sizeof(init_param)));
-
-    uint8_t status = 0;
-    ESP_ERROR_CHECK(i2c_read(DHT10_I2C_ADDR, 1, &status, sizeof(uint8_t)));
-    ESP_ERROR_CHECK((status & 0x8) == 0x8 ? ESP_OK : ESP_FAIL);
-#endif /* CONFIG_SENSOR_TYPE_DHT10 */
-#ifdef CONFIG_SENSOR_TYPE_DHT22
-    gpio_pad_select_gpio(ONE_WIRE);
-#endif /* CONFIG_SENSOR_TYPE_DHT22 */
+    if (!present) {
+        for (int i = 0; i < DRIVERS_COUNT; i++) {
+            if (drivers[i]->probe()) {
+                ESP_LOGI(TAG, "Found %s", drivers[i]->name);
+                present |= BIT(i);
+            }
+        }
+        if (!present) {
+            ESP_LOGE(TAG, "No sensor found"); // probed again on the next wake
+        }
+    }
+
+    for (int i = 0; i < DRIVERS_COUNT; i++) {
+        if ((present & BIT(i)) && drivers[i]->init) {
+            drivers[i]->init();
+        }
+    }
 }
 
-#ifdef CONFIG_SENSOR_TYPE_DHT22
-static esp_err_t dht_await_pin_state(gpio_num_t pin, uint32_t timeout, int expected_pin_state, uint32_t *duration)
+void sensor_start()
 {
-    gpio_set_direction(pin, GPIO_MODE_INPUT);
-    for (uint32_t i = 0; i < timeout; i += 2)
-    {
-        ets_delay_us(2);
-        if (gpio_get_level(pin) == expected_pin_state) {
-            if (duration) *duration = i;
-            return ESP_OK;
+    bool i2c = false;
+    for (int i = 0; i < DRIVERS_COUNT; i++) {
+        i2c |= (present & BIT(i)) && drivers[i]->i2c;
+    }
+
+    // all I2C conversion commands go out in a single bus transaction
+    if (i2c) {
+        i2c_batch_begin();
+    }
+    for (int i = 0; i < DRIVERS_COUNT; i++) {
+        if (present & BIT(i)) {
+            drivers[i]->start();
+        }
+    }
+    failed = 0;
+    if (i2c && i2c_batch_execute() != 0) {
+        ESP_LOGE(TAG, "Conversion start failed");
+        for (int i = 0; i < DRIVERS_COUNT; i++) {
+            if (drivers[i]->i2c) {
+                failed |= present & BIT(i);
+            }
         }
     }
 
-    return ESP_ERR_TIMEOUT;
+    pending = present & ~failed;
 }
 
-static inline int16_t dht_convert_data(uint8_t msb, uint8_t lsb)
+bool sensor_poll()
 {
-    int16_t data;
-    data = msb & 0x7F;
-    data <<= 8;
-    data |= lsb;
-    if (msb & BIT(7)) data = -data;
-    return data;
+    for (int i = 0; i < DRIVERS_COUNT; i++) {
+        if ((pending & BIT(i)) && drivers[i]->poll()) {
+            pending &= ~BIT(i);
+        }
+    }
+    return !pending;
 }
-#endif /* CONFIG_SENSOR_TYPE_DHT22 */
 
-void sensor_read(float *humidity, float *temperature)
+bool sensor_complete(float *humidity, float *temperature)
 {
-#ifdef CONFIG_SENSOR_TYPE_DHT10
-    uint8_t measure_param[] = { 0x33, 0x00 };
-    ESP_ERROR_CHECK(i2c_write(DHT10_I2C_ADDR, DHT10_MEASURE_REG_ADDR, measure_param, sizeof(measure_param)));
-
-    vTaskDelay(60 / portTICK_RATE_MS);
-
-    uint8_t bytes[6] = { 0 };
-    ESP_ERROR_CHECK(i2c_read(DHT10_I2C_ADDR, DHT10_MEASURE_REG_ADDR, bytes, sizeof(bytes)));
-
-    ESP_LOG_BUFFER_HEX(TAG, bytes, 6);
-
-    *humidity = ((((bytes[1] << 8) | bytes[2]) << 4) | bytes[3] >> 4) / 1048576.0f * 100.0f;
-    *temperature = (((((bytes[3] & 0b00001111) << 8) | bytes[4]) << 8) | bytes[5]) / 1048576.0f * 200.0f - 50.0f;
-#endif /* CONFIG_SENSOR_TYPE_DHT10 */
-#ifdef CONFIG_SENSOR_TYPE_DHT22
-    uint32_t low_duration;
-    uint32_t high_duration;
-
-    // Phase 'A' pulling signal low to initiate read sequence
-    gpio_set_direction(ONE_WIRE, GPIO_MODE_OUTPUT_OD);
-    gpio_set_level(ONE_WIRE, 0);
-    ets_delay_us(20000);
-    gpio_set_level(ONE_WIRE, 1);
-
-    // Step through Phase 'B', 40us
-    ESP_ERROR_CHECK(dht_await_pin_state(ONE_WIRE, 40, 0, NULL));
-    // Step through Phase 'C', 88us
-    ESP_ERROR_CHECK(dht_await_pin_state(ONE_WIRE, 88, 1, NULL));
-    // Step through Phase 'D', 88us
-    ESP_ERROR_CHECK(dht_await_pin_state(ONE_WIRE, 88, 0, NULL));
-
-    bool bits[40];
-
-    // Read in each of the 40 bits of data...
-    for (int i = 0; i < 40; i++) {
-        ESP_ERROR_CHECK(dht_await_pin_state(ONE_WIRE, 65, 1, &low_duration));
-        ESP_ERROR_CHECK(dht_await_pin_state(ONE_WIRE, 75, 0, &high_duration));
-        bits[i] = high_duration > low_duration;
-    }
+    bool primary = true;
+    bool valid = false;
+    for (int i = 0; i < DRIVERS_COUNT; i++) {
+        if (!(present & BIT(i))) continue;
+
+        sensor_data_t data = { .pressure = NAN };
+        if ((failed & BIT(i)) || !drivers[i]->complete(&data)) {
+            // the next sensor is not used in its place, values of two sensors would jump between samples
+            ESP_LOGE(TAG, "%s read failed", drivers[i]->name);
+            primary = false;
+            continue;
+        }
 
-    uint8_t data[40 / 8] = { 0 };
-    for (uint8_t i = 0; i < 40; i++) {
-        // Read each bit into 'result' byte array...
-        data[i / 8] <<= 1;
-        data[i / 8] |= bits[i];
-    }
+        ESP_LOGI(TAG, "%s temperature %.2f °C, humidity %.2f %%", drivers[i]->name, data.temperature, data.humidity);
+        if (!isnan(data.pressure)) {
+            ESP_LOGI(TAG, "%s pressure %.2f hPa", drivers[i]->name, data.pressure);
+        }
 
-    *humidity = dht_convert_data(data[0], data[1]) / 10.0f;
-    *temperature = dht_convert_data(data[2], data[3]) / 10.0f;
-#endif /* CONFIG_SENSOR_TYPE_DHT22 */
+        if (primary) {
+            *humidity = data.humidity;
+            *temperature = data.temperature;
+            primary = false;
+            valid = true;
+        }
+    }
+    return valid;
+}
 
-    ESP_LOGI(TAG, "Temperature %.2f °C", *temperature);
-    ESP_LOGI(TAG, "Humidity %.2f %%", *humidity);
+bool sensor_read(float *humidity, float *temperature)
+{
+    sensor_start();
+    while (!sensor_poll()) {
+        vTaskDelay(SENSOR_POLL_INTERVAL / portTICK_RATE_MS);
+    }
+    return sensor_complete(humidity, temperature);
 }
@@ -1,8 +1,19 @@
 #ifndef SENSOR_H_
 #define SENSOR_H_
 
+#include <stdbool.h>
+
+#define SENSOR_POLL_INTERVAL    10 // ms
+
 void sensor_init();
 
-void sensor_read(float *humidity, float *temperature);
+void sensor_start();
+
+bool sensor_poll();
+
+// false when the primary sensor gave no valid reading, the sample has to be skipped
+bool sensor_complete(float *humidity, float *temperature);
+
+bool sensor_read(float *humidity, float *temperature);
 
 #endif /* SENSOR_H_ */
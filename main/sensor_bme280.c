@@ -0,0 +1,193 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_SENSOR_I2C
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "sensor_driver.h"
+#include "peripherals.h"
+
+#define BME280_I2C_ADDR         0x76
+#define BME280_CHIP_ID          0x60
+#define BME280_REG_CALIB_TP     0x88
+#define BME280_REG_CALIB_H1     0xa1
+#define BME280_REG_CHIP_ID      0xd0
+#define BME280_REG_CALIB_H      0xe1
+#define BME280_REG_CTRL_HUM     0xf2
+#define BME280_REG_STATUS       0xf3
+#define BME280_REG_CTRL_MEAS    0xf4
+#define BME280_REG_DATA         0xf7
+#define BME280_STATUS_MEASURING 0x08
+#define BME280_CTRL_HUM         0x01 // humidity oversampling x1
+#define BME280_CTRL_MEAS        0x25 // temperature and pressure oversampling x1, forced mode
+#define BME280_MEASURE_TIME     10   // ms, datasheet maximum for x1 oversampling
+#define BME280_TIMEOUT          50   // ms
+
+typedef struct
+{
+    uint16_t t1;
+    int16_t t2, t3;
+    uint16_t p1;
+    int16_t p2, p3, p4, p5, p6, p7, p8, p9;
+    uint8_t h1;
+    int16_t h2;
+    uint8_t h3;
+    int16_t h4, h5;
+    int8_t h6;
+} bme280_calib_t;
+
+static const char *TAG = "bme280";
+
+// factory trimming, read once at cold boot
+static RTC_DATA_ATTR bme280_calib_t calib;
+
+static int64_t conversion_start;
+static bool conversion_failed;
+
+static bool bme280_probe()
+{
+    uint8_t id = 0;
+    if (i2c_read(BME280_I2C_ADDR, BME280_REG_CHIP_ID, &id, sizeof(uint8_t)) != 0 || id != BME280_CHIP_ID) {
+        return false;
+    }
+
+    uint8_t tp[24], h1, h[7];
+    i2c_batch_begin();
+    i2c_batch_read(BME280_I2C_ADDR, BME280_REG_CALIB_TP, tp, sizeof(tp));
+    i2c_batch_read(BME280_I2C_ADDR, BME280_REG_CALIB_H1, &h1, sizeof(uint8_t));
+    i2c_batch_read(BME280_I2C_ADDR, BME280_REG_CALIB_H, h, sizeof(h));
+    if (i2c_batch_execute() != 0) {
+        return false;
+    }
+
+    calib.t1 = tp[0] | (tp[1] << 8);
+    calib.t2 = tp[2] | (tp[3] << 8);
+    calib.t3 = tp[4] | (tp[5] << 8);
+    calib.p1 = tp[6] | (tp[7] << 8);
+    calib.p2 = tp[8] | (tp[9] << 8);
+    calib.p3 = tp[10] | (tp[11] << 8);
+    calib.p4 = tp[12] | (tp[13] << 8);
+    calib.p5 = tp[14] | (tp[15] << 8);
+    calib.p6 = tp[16] | (tp[17] << 8);
+    calib.p7 = tp[18] | (tp[19] << 8);
+    calib.p8 = tp[20] | (tp[21] << 8);
+    calib.p9 = tp[22] | (tp[23] << 8);
+    calib.h1 = h1;
+    calib.h2 = h[0] | (h[1] << 8);
+    calib.h3 = h[2];
+    calib.h4 = (int16_t) ((int8_t) h[3] * 16) | (h[4] & 0x0f);
+    calib.h5 = (int16_t) ((int8_t) h[5] * 16) | (h[4] >> 4);
+    calib.h6 = (int8_t) h[6];
+
+    return true;
+}
+
+static void bme280_start()
+{
+    static const uint8_t ctrl_hum = BME280_CTRL_HUM;
+    static const uint8_t ctrl_meas = BME280_CTRL_MEAS;
+    // humidity control is applied by the following control measurement write
+    i2c_batch_write(BME280_I2C_ADDR, BME280_REG_CTRL_HUM, &ctrl_hum, sizeof(uint8_t));
+    i2c_batch_write(BME280_I2C_ADDR, BME280_REG_CTRL_MEAS, &ctrl_meas, sizeof(uint8_t));
+    conversion_start = esp_timer_get_time();
+    conversion_failed = false;
+}
+
+static bool bme280_poll()
+{
+    int64_t elapsed = esp_timer_get_time() - conversion_start;
+    if (elapsed < BME280_MEASURE_TIME * 1000) {
+        return false;
+    }
+
+    // data registers still hold the previous conversion, a failed one must not be read as a result
+    uint8_t status = 0;
+    if (i2c_read(BME280_I2C_ADDR, BME280_REG_STATUS, &status, sizeof(uint8_t)) != 0) {
+        ESP_LOGE(TAG, "No response");
+        conversion_failed = true;
+        return true;
+    }
+    if (status & BME280_STATUS_MEASURING) {
+        if (elapsed >= BME280_TIMEOUT * 1000) {
+            ESP_LOGE(TAG, "Conversion timeout");
+            conversion_failed = true;
+            return true;
+        }
+        return false;
+    }
+    return true;
+}
+
+// compensation formulas from the BME280 datasheet, section 4.2.3
+
+static int32_t bme280_compensate_t_fine(int32_t adc_t)
+{
+    int32_t var1 = ((((adc_t >> 3) - ((int32_t) calib.t1 << 1))) * ((int32_t) calib.t2)) >> 11;
+    int32_t var2 = (((((adc_t >> 4) - ((int32_t) calib.t1)) * ((adc_t >> 4) - ((int32_t) calib.t1))) >> 12) * ((int32_t) calib.t3)) >> 14;
+    return var1 + var2;
+}
+
+static uint32_t bme280_compensate_p(int32_t adc_p, int32_t t_fine)
+{
+    int64_t var1 = ((int64_t) t_fine) - 128000;
+    int64_t var2 = var1 * var1 * (int64_t) calib.p6;
+    var2 = var2 + ((var1 * (int64_t) calib.p5) << 17);
+    var2 = var2 + (((int64_t) calib.p4) << 35);
+    var1 = ((var1 * var1 * (int64_t) calib.p3) >> 8) + ((var1 * (int64_t) calib.p2) << 12);
+    var1 = (((((int64_t) 1) << 47) + var1)) * ((int64_t) calib.p1) >> 33;
+    if (var1 == 0) {
+        return 0;
+    }
+    int64_t p = 1048576 - adc_p;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = (((int64_t) calib.p9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t) calib.p8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t) calib.p7) << 4);
+    return (uint32_t) p; // Pa in Q24.8
+}
+
+static uint32_t bme280_compensate_h(int32_t adc_h, int32_t t_fine)
+{
+    int32_t v = t_fine - ((int32_t) 76800);
+    v = (((((adc_h << 14) - (((int32_t) calib.h4) << 20) - (((int32_t) calib.h5) * v)) + ((int32_t) 16384)) >> 15)
+            * (((((((v * ((int32_t) calib.h6)) >> 10) * (((v * ((int32_t) calib.h3)) >> 11) + ((int32_t) 32768))) >> 10) + ((int32_t) 2097152))
+                    * ((int32_t) calib.h2) + 8192) >> 14));
+    v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t) calib.h1)) >> 4));
+    v = (v < 0 ? 0 : v);
+    v = (v > 419430400 ? 419430400 : v);
+    return (uint32_t) (v >> 12); // % in Q22.10
+}
+
+static bool bme280_complete(sensor_data_t *data)
+{
+    uint8_t bytes[8] = { 0 };
+    if (conversion_failed || i2c_read(BME280_I2C_ADDR, BME280_REG_DATA, bytes, sizeof(bytes)) != 0) {
+        return false;
+    }
+
+    ESP_LOG_BUFFER_HEX(TAG, bytes, 8);
+
+    int32_t adc_p = (bytes[0] << 12) | (bytes[1] << 4) | (bytes[2] >> 4);
+    int32_t adc_t = (bytes[3] << 12) | (bytes[4] << 4) | (bytes[5] >> 4);
+    int32_t adc_h = (bytes[6] << 8) | bytes[7];
+
+    int32_t t_fine = bme280_compensate_t_fine(adc_t);
+    data->temperature = ((t_fine * 5 + 128) >> 8) / 100.0f;
+    data->pressure = bme280_compensate_p(adc_p, t_fine) / 256.0f / 100.0f;
+    data->humidity = bme280_compensate_h(adc_h, t_fine) / 1024.0f;
+    return true;
+}
+
+// @formatter:off
+const sensor_driver_t sensor_bme280 = {
+        .name = "BME280",
+        .i2c = true,
+        .probe = bme280_probe,
+        .init = NULL,
+        .start = bme280_start,
+        .poll = bme280_poll,
+        .complete = bme280_complete
+};
+// @formatter:on
+
+#endif /* CONFIG_SENSOR_I2C */
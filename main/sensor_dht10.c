@@ -0,0 +1,120 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_SENSOR_I2C
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "sensor.h"
+#include "sensor_driver.h"
+#include "peripherals.h"
+
+#define DHT10_I2C_ADDR          0x38
+#define DHT10_RESET_REG_ADDR    0xba
+#define DHT10_INIT_REG_ADDR     0xe1
+#define DHT10_MEASURE_REG_ADDR  0xac
+#define DHT10_STATUS_BUSY       0x80
+#define DHT10_STATUS_CALIBRATED 0x08
+#define DHT10_RESET_TIME        20  // ms
+#define DHT10_TIMEOUT           200 // ms
+
+static const char *TAG = "dht10";
+
+static int64_t conversion_start;
+
+static bool dht10_probe()
+{
+    uint8_t status = 0;
+    return i2c_receive(DHT10_I2C_ADDR, &status, sizeof(uint8_t)) == 0;
+}
+
+static void dht10_init()
+{
+    uint8_t status = 0;
+    if (i2c_receive(DHT10_I2C_ADDR, &status, sizeof(uint8_t)) != 0) {
+        ESP_LOGE(TAG, "No response");
+        return; // the read fails as well and the sample is skipped
+    }
+    if (status & DHT10_STATUS_CALIBRATED) {
+        return; // sensor stays powered and calibrated during deep sleep
+    }
+
+    if (i2c_write(DHT10_I2C_ADDR, DHT10_RESET_REG_ADDR, NULL, 0) != 0) {
+        ESP_LOGE(TAG, "Reset failed");
+        return;
+    }
+    vTaskDelay(DHT10_RESET_TIME / portTICK_RATE_MS);
+
+    uint8_t init_param[] = { 0x08, 0x00 };
+    if (i2c_write(DHT10_I2C_ADDR, DHT10_INIT_REG_ADDR, init_param, sizeof(init_param)) != 0) {
+        ESP_LOGE(TAG, "Calibration failed");
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    do {
+        vTaskDelay(SENSOR_POLL_INTERVAL / portTICK_RATE_MS);
+        if (i2c_receive(DHT10_I2C_ADDR, &status, sizeof(uint8_t)) != 0 || esp_timer_get_time() - start >= DHT10_TIMEOUT * 1000) {
+            ESP_LOGE(TAG, "Calibration failed");
+            return;
+        }
+    } while (status & DHT10_STATUS_BUSY);
+    if (!(status & DHT10_STATUS_CALIBRATED)) {
+        ESP_LOGE(TAG, "Not calibrated");
+    }
+}
+
+static void dht10_start()
+{
+    static const uint8_t measure_param[] = { 0x33, 0x00 };
+    i2c_batch_write(DHT10_I2C_ADDR, DHT10_MEASURE_REG_ADDR, measure_param, sizeof(measure_param));
+    conversion_start = esp_timer_get_time();
+}
+
+static bool dht10_poll()
+{
+    // on a bus error or timeout the conversion is over, the status read with the result tells it failed
+    uint8_t status = 0;
+    if (i2c_receive(DHT10_I2C_ADDR, &status, sizeof(uint8_t)) != 0) {
+        return true;
+    }
+    if (status & DHT10_STATUS_BUSY) {
+        return esp_timer_get_time() - conversion_start >= DHT10_TIMEOUT * 1000;
+    }
+    ESP_LOGI(TAG, "Conversion time %lld us", esp_timer_get_time() - conversion_start);
+    return true;
+}
+
+static bool dht10_complete(sensor_data_t *data)
+{
+    uint8_t bytes[6] = { 0 };
+    if (i2c_receive(DHT10_I2C_ADDR, bytes, sizeof(bytes)) != 0) {
+        ESP_LOGE(TAG, "No response");
+        return false;
+    }
+
+    ESP_LOG_BUFFER_HEX(TAG, bytes, 6);
+
+    if ((bytes[0] & DHT10_STATUS_BUSY) || !(bytes[0] & DHT10_STATUS_CALIBRATED)) {
+        ESP_LOGE(TAG, "Conversion failed, status %02x", bytes[0]);
+        return false;
+    }
+
+    data->humidity = ((((bytes[1] << 8) | bytes[2]) << 4) | bytes[3] >> 4) / 1048576.0f * 100.0f;
+    data->temperature = (((((bytes[3] & 0b00001111) << 8) | bytes[4]) << 8) | bytes[5]) / 1048576.0f * 200.0f - 50.0f;
+    return true;
+}
+
+// @formatter:off
+const sensor_driver_t sensor_dht10 = {
+        .name = "DHT10",
+        .i2c = true,
+        .probe = dht10_probe,
+        .init = dht10_init,
+        .start = dht10_start,
+        .poll = dht10_poll,
+        .complete = dht10_complete
+};
+// @formatter:on
+
+#endif /* CONFIG_SENSOR_I2C */
@@ -0,0 +1,168 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_SENSOR_DHT22
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "driver/gpio.h"
+#include "driver/rmt.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp32/clk.h"
+
+#include "sensor.h"
+#include "sensor_driver.h"
+#include "dht.h"
+
+#define DHT22_GPIO              CONFIG_SENSOR_DHT22_GPIO
+#define DHT22_RMT_CHANNEL       RMT_CHANNEL_0
+#define DHT22_START_TIME        20  // ms
+#define DHT22_IDLE_THRESHOLD    200 // us, longer high than any bit ends the frame
+#define DHT22_TIMEOUT           50  // ms
+#define DHT22_READ_INTERVAL     2000 // ms, minimal time between two reads
+
+static const char *TAG = "dht22";
+
+static bool installed = false;
+
+static int64_t conversion_start;
+// RTC clock keeps running in deep sleep, a wake right after the previous read has to wait as well
+static RTC_DATA_ATTR int64_t last_read = -DHT22_READ_INTERVAL * 1000LL;
+
+static size_t dht22_capture_pulses(dht_pulse_t *pulses, size_t max)
+{
+    RingbufHandle_t rb = NULL;
+    ESP_ERROR_CHECK(rmt_get_ringbuf_handle(DHT22_RMT_CHANNEL, &rb));
+
+    size_t size = 0;
+    rmt_item32_t *items = (rmt_item32_t*) xRingbufferReceive(rb, &size, DHT22_TIMEOUT / portTICK_PERIOD_MS);
+    if (!items) {
+        return 0;
+    }
+
+    // pair every low phase with the following high phase, one RMT tick is 1 us
+    size_t count = 0;
+    uint16_t low = 0;
+    for (size_t i = 0; i < size / sizeof(rmt_item32_t) && count < max; i++) {
+        uint16_t durations[] = { items[i].duration0, items[i].duration1 };
+        uint8_t levels[] = { items[i].level0, items[i].level1 };
+        for (int j = 0; j < 2 && count < max; j++) {
+            if (durations[j] == 0) {
+                break; // end marker
+            }
+            if (levels[j] == 0) {
+                low = durations[j];
+            } else if (low) {
+                pulses[count].low = low;
+                pulses[count].high = durations[j];
+                count++;
+                low = 0;
+            }
+        }
+    }
+    vRingbufferReturnItem(rb, items);
+
+    return count;
+}
+
+static inline int16_t dht22_convert_data(uint8_t msb, uint8_t lsb)
+{
+    int16_t data;
+    data = msb & 0x7F;
+    data <<= 8;
+    data |= lsb;
+    if (msb & BIT(7)) data = -data;
+    return data;
+}
+
+static dht_status_t dht22_receive(uint8_t data[DHT_DATA_BYTES])
+{
+    // release the line and let RMT record the response while this task blocks
+    ESP_ERROR_CHECK(rmt_rx_start(DHT22_RMT_CHANNEL, true));
+    gpio_set_level(DHT22_GPIO, 1);
+
+    dht_pulse_t pulses[DHT_DATA_BITS + 4];
+    size_t count = dht22_capture_pulses(pulses, sizeof(pulses) / sizeof(dht_pulse_t));
+    ESP_ERROR_CHECK(rmt_rx_stop(DHT22_RMT_CHANNEL));
+    last_read = esp_clk_rtc_time();
+
+    dht_status_t status = dht_decode(pulses, count, data);
+    if (status != DHT_OK) {
+        ESP_LOGE(TAG, "Decode failed %d (%d pulses)", status, (int) count);
+    }
+    return status;
+}
+
+static void dht22_init()
+{
+    if (installed) {
+        return;
+    }
+
+    // line stays an input for RMT capture, driven low as open drain only for the start signal
+    gpio_pad_select_gpio(DHT22_GPIO);
+    gpio_set_direction(DHT22_GPIO, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_level(DHT22_GPIO, 1);
+
+    rmt_config_t rmt_cfg = RMT_DEFAULT_CONFIG_RX(DHT22_GPIO, DHT22_RMT_CHANNEL);
+    rmt_cfg.clk_div = 80; // 1 us tick
+    rmt_cfg.rx_config.filter_en = true;
+    rmt_cfg.rx_config.filter_ticks_thresh = 100; // APB ticks, ignore glitches under 1.25 us
+    rmt_cfg.rx_config.idle_threshold = DHT22_IDLE_THRESHOLD;
+    ESP_ERROR_CHECK(rmt_config(&rmt_cfg));
+    ESP_ERROR_CHECK(rmt_driver_install(DHT22_RMT_CHANNEL, 1024, 0));
+    gpio_set_direction(DHT22_GPIO, GPIO_MODE_INPUT_OUTPUT_OD); // rmt_config switches the pin to input only
+
+    installed = true;
+}
+
+static void dht22_start()
+{
+    // start signal, line is held low while the caller does other work
+    gpio_set_level(DHT22_GPIO, 0);
+    conversion_start = esp_timer_get_time();
+}
+
+static bool dht22_poll()
+{
+    // a read right after the probe at cold boot has to wait, the start signal is just held longer
+    return esp_timer_get_time() - conversion_start >= DHT22_START_TIME * 1000
+            && (int64_t) esp_clk_rtc_time() - last_read >= DHT22_READ_INTERVAL * 1000LL;
+}
+
+static bool dht22_probe()
+{
+    dht22_init();
+    dht22_start();
+    vTaskDelay(DHT22_START_TIME / portTICK_PERIOD_MS + 1);
+
+    uint8_t data[DHT_DATA_BYTES];
+    return dht22_receive(data) == DHT_OK;
+}
+
+static bool dht22_complete(sensor_data_t *data)
+{
+    uint8_t bytes[DHT_DATA_BYTES];
+    if (dht22_receive(bytes) != DHT_OK) {
+        return false;
+    }
+
+    data->humidity = dht22_convert_data(bytes[0], bytes[1]) / 10.0f;
+    data->temperature = dht22_convert_data(bytes[2], bytes[3]) / 10.0f;
+    return true;
+}
+
+// @formatter:off
+const sensor_driver_t sensor_dht22 = {
+        .name = "DHT22",
+        .i2c = false,
+        .probe = dht22_probe,
+        .init = dht22_init,
+        .start = dht22_start,
+        .poll = dht22_poll,
+        .complete = dht22_complete
+};
+// @formatter:on
+
+#endif /* CONFIG_SENSOR_DHT22 */
@@ -0,0 +1,35 @@
+#ifndef SENSOR_DRIVER_H_
+#define SENSOR_DRIVER_H_
+
+#include <stdbool.h>
+#include <math.h>
+#include "sdkconfig.h"
+
+typedef struct
+{
+    float humidity;     // %
+    float temperature;  // °C
+    float pressure;     // hPa, NAN when not measured
+} sensor_data_t;
+
+typedef struct
+{
+    const char *name;
+    bool i2c;                           // start() appends to the current I2C batch
+    bool (*probe)();                    // once at cold boot, result is cached in RTC memory
+    void (*init)();                     // every wake, optional
+    void (*start)();                    // start conversion
+    bool (*poll)();                     // conversion finished or failed
+    bool (*complete)(sensor_data_t *data); // false on a bus or data error, data is not set
+} sensor_driver_t;
+
+#ifdef CONFIG_SENSOR_I2C
+extern const sensor_driver_t sensor_sht3x;
+extern const sensor_driver_t sensor_bme280;
+extern const sensor_driver_t sensor_dht10;
+#endif /* CONFIG_SENSOR_I2C */
+#ifdef CONFIG_SENSOR_DHT22
+extern const sensor_driver_t sensor_dht22;
+#endif /* CONFIG_SENSOR_DHT22 */
+
+#endif /* SENSOR_DRIVER_H_ */
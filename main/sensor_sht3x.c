@@ -0,0 +1,81 @@
+#include "sdkconfig.h"
+#ifdef CONFIG_SENSOR_I2C
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "sensor_driver.h"
+#include "peripherals.h"
+
+#define SHT3X_I2C_ADDR          0x44
+#define SHT3X_CMD_STATUS        0xf3 // 0xf32d
+#define SHT3X_CMD_MEASURE       0x24 // 0x2400, high repeatability, no clock stretching
+#define SHT3X_MEASURE_TIME      16   // ms
+
+static const char *TAG = "sht3x";
+
+static int64_t conversion_start;
+
+static uint8_t sht3x_crc(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0xff;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static bool sht3x_probe()
+{
+    uint8_t param = 0x2d;
+    return i2c_write(SHT3X_I2C_ADDR, SHT3X_CMD_STATUS, &param, sizeof(uint8_t)) == 0;
+}
+
+static void sht3x_start()
+{
+    static const uint8_t param = 0x00;
+    i2c_batch_write(SHT3X_I2C_ADDR, SHT3X_CMD_MEASURE, &param, sizeof(uint8_t));
+    conversion_start = esp_timer_get_time();
+}
+
+static bool sht3x_poll()
+{
+    // sensor NACKs reads during conversion, wait for the datasheet maximum instead
+    return esp_timer_get_time() - conversion_start >= SHT3X_MEASURE_TIME * 1000;
+}
+
+static bool sht3x_complete(sensor_data_t *data)
+{
+    uint8_t bytes[6] = { 0 };
+    if (i2c_receive(SHT3X_I2C_ADDR, bytes, sizeof(bytes)) != 0) {
+        ESP_LOGE(TAG, "No response");
+        return false;
+    }
+
+    ESP_LOG_BUFFER_HEX(TAG, bytes, 6);
+
+    if (sht3x_crc(&bytes[0], 2) != bytes[2] || sht3x_crc(&bytes[3], 2) != bytes[5]) {
+        ESP_LOGE(TAG, "CRC mismatch");
+        return false;
+    }
+
+    data->temperature = ((bytes[0] << 8) | bytes[1]) * 175.0f / 65535.0f - 45.0f;
+    data->humidity = ((bytes[3] << 8) | bytes[4]) * 100.0f / 65535.0f;
+    return true;
+}
+
+// @formatter:off
+const sensor_driver_t sensor_sht3x = {
+        .name = "SHT3x",
+        .i2c = true,
+        .probe = sht3x_probe,
+        .init = NULL,
+        .start = sht3x_start,
+        .poll = sht3x_poll,
+        .complete = sht3x_complete
+};
+// @formatter:on
+
+#endif /* CONFIG_SENSOR_I2C */
@@ -0,0 +1,79 @@
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "session.h"
+#include "settings.h"
+
+static const char *TAG = "session";
+
+// session keys derived at join live in the security module, not in the MAC session,
+// without them a restored session can't compute a valid MIC
+typedef struct
+{
+    struct ldl_mac_session session;
+    struct ldl_sm sm;
+} checkpoint_t;
+
+// last checkpoint written to flash, its uplink counter is the end of the reserved block
+static RTC_DATA_ATTR checkpoint_t checkpoint;
+static RTC_DATA_ATTR uint32_t writes = 0;
+
+static void write_checkpoint(const struct ldl_mac_session *session, const struct ldl_sm *sm)
+{
+    checkpoint_t next;
+    memcpy(&next.session, session, sizeof(struct ldl_mac_session));
+    memcpy(&next.sm, sm, sizeof(struct ldl_sm));
+    next.session.up = session->up + SESSION_FCNT_BLOCK;
+
+    // keep the old checkpoint on failure, the next session update tries again
+    if (!settings_save_session(&next, sizeof(checkpoint_t))) {
+        ESP_LOGW(TAG, "Checkpoint failed, up counter %d", session->up);
+        return;
+    }
+    memcpy(&checkpoint, &next, sizeof(checkpoint_t));
+    writes++;
+
+    ESP_LOGI(TAG, "Checkpoint %d, up counter reserved to %d", writes, checkpoint.session.up);
+}
+
+bool session_restore(struct ldl_mac_session *session, struct ldl_sm *sm)
+{
+    if (!settings_load_session(&checkpoint, sizeof(checkpoint_t)) || !checkpoint.session.joined) {
+        memset(&checkpoint, 0, sizeof(checkpoint_t));
+        return false;
+    }
+
+    // frames up to the end of the block may have been sent before power loss, continue after it
+    memcpy(session, &checkpoint.session, sizeof(struct ldl_mac_session));
+    memcpy(sm, &checkpoint.sm, sizeof(struct ldl_sm));
+    write_checkpoint(session, sm);
+
+    ESP_LOGI(TAG, "Restored, up counter %d", session->up);
+    return true;
+}
+
+void session_checkpoint(const struct ldl_mac_session *session, const struct ldl_sm *sm)
+{
+    if (!session->joined) {
+        if (checkpoint.session.joined) {
+            settings_erase_session();
+            memset(&checkpoint, 0, sizeof(checkpoint_t));
+            ESP_LOGI(TAG, "Erased");
+        }
+        return;
+    }
+
+    // counters change on every frame, anything else (keys, channels, rate) needs a write right away
+    checkpoint_t masked;
+    memcpy(&masked.session, session, sizeof(struct ldl_mac_session));
+    memcpy(&masked.sm, sm, sizeof(struct ldl_sm));
+    masked.session.up = checkpoint.session.up;
+    masked.session.appDown = checkpoint.session.appDown;
+    masked.session.nwkDown = checkpoint.session.nwkDown;
+
+    if (!checkpoint.session.joined || session->up >= checkpoint.session.up
+            || memcmp(&masked, &checkpoint, sizeof(checkpoint_t))) {
+        write_checkpoint(session, sm);
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef SESSION_H_
+#define SESSION_H_
+
+#include <stdbool.h>
+#include "ldl_mac.h"
+#include "ldl_sm.h"
+
+#define SESSION_FCNT_BLOCK  64 // uplink frame counters reserved per flash write
+
+bool session_restore(struct ldl_mac_session *session, struct ldl_sm *sm);
+
+void session_checkpoint(const struct ldl_mac_session *session, const struct ldl_sm *sm);
+
+#endif /* SESSION_H_ */
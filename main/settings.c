@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+
+#include "settings.h"
+#include "storage_key.h"
+#include "budget.h"
+
+#define DEFAULT_PERIOD  60 // 60s
+
+static const char *TAG = "settings";
+
+static RTC_DATA_ATTR settings_t settings = { 0 };
+
+// snapshot is read by every task, changes are applied to it as a whole
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+nvs_handle storage = 0;
+
+static void storage_open()
+{
+    if (storage) {
+        return;
+    }
+
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+
+    ESP_ERROR_CHECK(nvs_open(STORAGE_NAME, NVS_READWRITE, &storage));
+}
+
+static bool load_blob(const char *key, uint8_t *value, size_t len)
+{
+    size_t size = len;
+    memset(value, 0, len);
+    return nvs_get_blob(storage, key, value, &size) == ESP_OK;
+}
+
+void settings_init()
+{
+    // RTC memory is cleared only on power-on, deep sleep keeps the snapshot,
+    // so timer wakes don't need to touch flash at all
+    if (settings.generation == 0) {
+        settings_load();
+    }
+}
+
+static void load(settings_t *loaded)
+{
+    memset(loaded, 0, sizeof(settings_t));
+
+    loaded->period = DEFAULT_PERIOD;
+    nvs_get_u16(storage, STORAGE_KEY_PERIOD, &loaded->period);
+    nvs_get_u8(storage, STORAGE_KEY_PAYL_FMT, &loaded->payl_fmt);
+    nvs_get_u8(storage, STORAGE_KEY_CONFM, &loaded->confm);
+    nvs_get_u8(storage, STORAGE_KEY_CONFM_PARAM, &loaded->confm_param);
+    loaded->batch = 1;
+    nvs_get_u8(storage, STORAGE_KEY_BATCH, &loaded->batch);
+    if (!settings_batch_valid(loaded->batch)) {
+        loaded->batch = 1;
+    }
+    nvs_get_u16(storage, STORAGE_KEY_DEADBAND_HUM, &loaded->deadband_hum);
+    nvs_get_u16(storage, STORAGE_KEY_DEADBAND_TEMP, &loaded->deadband_temp);
+    nvs_get_u16(storage, STORAGE_KEY_HEARTBEAT, &loaded->heartbeat);
+    load_blob(STORAGE_KEY_BAT_PERIOD, (uint8_t*) loaded->period_breakpoints, sizeof(loaded->period_breakpoints));
+    nvs_get_u8(storage, STORAGE_KEY_LINK_ADAPT, &loaded->link_adapt);
+    nvs_get_u16(storage, STORAGE_KEY_CAPACITY, &loaded->capacity);
+    nvs_get_u16(storage, STORAGE_KEY_LIFETIME, &loaded->lifetime);
+
+    bool has_join_eui = load_blob(STORAGE_KEY_LORA_JOIN_EUI, loaded->join_eui, SETTINGS_EUI_LEN);
+    bool has_dev_eui = load_blob(STORAGE_KEY_LORA_DEV_EUI, loaded->dev_eui, SETTINGS_EUI_LEN);
+    load_blob(STORAGE_KEY_LORA_APP_KEY, loaded->app_key, SETTINGS_KEY_LEN);
+    bool has_nwk_key = load_blob(STORAGE_KEY_LORA_NWK_KEY, loaded->nwk_key, SETTINGS_KEY_LEN);
+    loaded->has_credentials = has_join_eui && has_dev_eui && has_nwk_key;
+
+#ifdef CONFIG_LORA_LORAWAN_VERSION_1_1
+    nvs_get_u16(storage, STORAGE_KEY_LORA_DEV_NONCE, &loaded->dev_nonce);
+    nvs_get_u32(storage, STORAGE_KEY_LORA_JOIN_NONCE, &loaded->join_nonce);
+#endif /* CONFIG_LORA_LORAWAN_VERSION_1_1 */
+}
+
+void settings_load()
+{
+    storage_open();
+
+    // load aside, readers keep the old snapshot until the new one is complete;
+    // a setter that ran meanwhile may be missing from what was read, then load again
+    settings_t loaded;
+    bool changed;
+    do {
+        portENTER_CRITICAL(&lock);
+        uint32_t generation = settings.generation;
+        portEXIT_CRITICAL(&lock);
+
+        load(&loaded);
+
+        portENTER_CRITICAL(&lock);
+        changed = settings.generation != generation;
+        if (!changed) {
+            loaded.generation = generation + 1;
+            settings = loaded;
+        }
+        portEXIT_CRITICAL(&lock);
+    } while (changed);
+
+    ESP_LOGI(TAG, "Loaded (generation %d)", loaded.generation);
+}
+
+const settings_t* settings_get()
+{
+    return &settings;
+}
+
+void settings_set_period(uint16_t period)
+{
+    storage_open();
+    nvs_set_u16(storage, STORAGE_KEY_PERIOD, period);
+    portENTER_CRITICAL(&lock);
+    settings.period = period;
+    settings.generation++;
+    portEXIT_CRITICAL(&lock);
+    budget_update(); // budget decision starts from these settings
+}
+
+void settings_set_payl_fmt(uint8_t payl_fmt)
+{
+    storage_open();
+    nvs_set_u8(storage, STORAGE_KEY_PAYL_FMT, payl_fmt);
+    portENTER_CRITICAL(&lock);
+    settings.payl_fmt = payl_fmt;
+    settings.generation++;
+    portEXIT_CRITICAL(&lock);
+}
+
+void settings_set_confm(uint8_t confm, uint8_t confm_param)
+{
+    storage_open();
+    nvs_set_u8(storage, STORAGE_KEY_CONFM, confm);
+    nvs_set_u8(storage, STORAGE_KEY_CONFM_PARAM, confm_param);
+    portENTER_CRITICAL(&lock);
+    settings.confm = confm;
+    settings.confm_param = confm_param;
+    settings.generation++;
+    portEXIT_CRITICAL(&lock);
+    budget_update();
+}
+
+void settings_set_batch(uint8_t batch)
+{
+    if (!settings_batch_valid(batch)) {
+        ESP_LOGW(TAG, "Invalid batch size %d", batch);
+        return;
+    }
+    storage_open();
+    nvs_set_u8(storage, STORAGE_KEY_BATCH, batch);
+    portENTER_CRITICAL(&lock);
+    settings.batch = batch;
+    settings.generation++;
+    portEXIT_CRITICAL(&lock);
+    budget_update();
+}
+
+void settings_set_deadband(uint16_t deadband_hum, uint16_t deadband_temp, uint16_t heartbeat)
+{
+    storage_open();
+    nvs_set_u16(storage, STORAGE_KEY_DEADBAND_HUM, deadband_hum);
+    nvs_set_u16(storage, STORAGE_KEY_DEADBAND_TEMP, deadband_temp);
+    nvs_set_u16(storage, STORAGE_KEY_HEARTBEAT, heartbeat);
+    portENTER_CRITICAL(&lock);
+    settings.deadband_hum = deadband_hum;
+    settings.deadband_temp = deadband_temp;
+    settings.heartbeat = heartbeat;
+    settings.generation++;
+    portEXIT_CRITICAL(&lock);
+}
+
+void settings_set_period_breakpoints(const period_breakpoint_t *breakpoints)
+{
+    storage_open();
+    nvs_set_blob(storage, STORAGE_KEY_BAT_PERIOD, breakpoints, sizeof(settings.period_breakpoints));
+    portENTER_CRITICAL(&lock);
+    memcpy(settings.period_breakpoints, breakpoints, sizeof(settings.period_breakpoints));
+    settings.generation++;
+    portEXIT_CRITICAL(&lock);
+}
+
+void settings_set_link_adapt(uint8_t link_adapt)
+{
+    storage_open();
+    nvs_set_u8(storage, STORAGE_KEY_LINK_ADAPT, link_adapt);
+    portENTER_CRITICAL(&lock);
+    settings.link_adapt = link_adapt;
+    settings.generation++;
+    portEXIT_CRITICAL(&lock);
+}
+
+void settings_set_budget(uint16_t capacity, uint16_t lifetime)
+{
+    storage_open();
+    nvs_set_u16(storage, STORAGE_KEY_CAPACITY, capacity);
+    nvs_set_u16(storage, STORAGE_KEY_LIFETIME, lifetime);
+    portENTER_CRITICAL(&lock);
+    settings.capacity = capacity;
+    settings.lifetime = lifetime;
+    settings.generation++;
+    portEXIT_CRITICAL(&lock);
+}
+
+void settings_load_budget_usage(uint32_t *elapsed, uint64_t *consumed)
+{
+    storage_open();
+    nvs_get_u32(storage, STORAGE_KEY_BUDGET_ELAPSED, elapsed);
+    nvs_get_u64(storage, STORAGE_KEY_BUDGET_CONSUMED, consumed);
+}
+
+void settings_save_budget_usage(uint32_t elapsed, uint64_t consumed)
+{
+    storage_open();
+    esp_err_t err = nvs_set_u32(storage, STORAGE_KEY_BUDGET_ELAPSED, elapsed);
+    if (err == ESP_OK) {
+        err = nvs_set_u64(storage, STORAGE_KEY_BUDGET_CONSUMED, consumed);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Budget usage not saved: %s", esp_err_to_name(err));
+    }
+}
+
+void settings_set_join_eui(const uint8_t *join_eui)
+{
+    storage_open();
+    nvs_set_blob(storage, STORAGE_KEY_LORA_JOIN_EUI, join_eui, SETTINGS_EUI_LEN);
+    nvs_erase_key(storage, STORAGE_KEY_LORA_SESSION); // session belongs to old credentials
+    settings_load();
+}
+
+void settings_set_dev_eui(const uint8_t *dev_eui)
+{
+    storage_open();
+    nvs_set_blob(storage, STORAGE_KEY_LORA_DEV_EUI, dev_eui, SETTINGS_EUI_LEN);
+    nvs_erase_key(storage, STORAGE_KEY_LORA_SESSION); // session belongs to old credentials
+    settings_load();
+}
+
+void settings_set_app_key(const uint8_t *app_key)
+{
+    storage_open();
+    nvs_set_blob(storage, STORAGE_KEY_LORA_APP_KEY, app_key, SETTINGS_KEY_LEN);
+    nvs_erase_key(storage, STORAGE_KEY_LORA_SESSION); // session belongs to old credentials
+    settings_load();
+}
+
+void settings_set_nwk_key(const uint8_t *nwk_key)
+{
+    storage_open();
+    nvs_set_blob(storage, STORAGE_KEY_LORA_NWK_KEY, nwk_key, SETTINGS_KEY_LEN);
+    nvs_erase_key(storage, STORAGE_KEY_LORA_SESSION); // session belongs to old credentials
+    settings_load();
+}
+
+bool settings_load_session(void *session, size_t len)
+{
+    storage_open();
+    size_t size = len;
+    // different size means the MAC library changed, the session can't be used
+    return nvs_get_blob(storage, STORAGE_KEY_LORA_SESSION, session, &size) == ESP_OK && size == len;
+}
+
+bool settings_save_session(const void *session, size_t len)
+{
+    storage_open();
+    // called from the MAC event handler, a full flash must not end in a panic loop
+    esp_err_t err = nvs_set_blob(storage, STORAGE_KEY_LORA_SESSION, session, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Session not saved: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+void settings_erase_session()
+{
+    storage_open();
+    nvs_erase_key(storage, STORAGE_KEY_LORA_SESSION);
+}
+
+bool settings_load_history(uint8_t block, void *data, size_t len)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    snprintf(key, sizeof(key), STORAGE_KEY_HISTORY, block);
+    storage_open();
+    size_t size = len;
+    return nvs_get_blob(storage, key, data, &size) == ESP_OK && size == len;
+}
+
+void settings_save_history(uint8_t block, const void *data, size_t len, uint32_t count)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    snprintf(key, sizeof(key), STORAGE_KEY_HISTORY, block);
+    storage_open();
+    esp_err_t err = nvs_set_blob(storage, key, data, len);
+    if (err == ESP_OK) {
+        // count only covers blocks that made it to flash
+        err = nvs_set_u32(storage, STORAGE_KEY_HISTORY_COUNT, count);
+    } else {
+        // slot still holds the block stored a round ago, it must read as missing, not as this one
+        nvs_erase_key(storage, key);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "History block %d not saved: %s", block, esp_err_to_name(err));
+    }
+}
+
+uint32_t settings_load_history_count()
+{
+    uint32_t count = 0;
+    storage_open();
+    nvs_get_u32(storage, STORAGE_KEY_HISTORY_COUNT, &count);
+    return count;
+}
+
+#ifdef CONFIG_LORA_LORAWAN_VERSION_1_1
+void settings_set_nonces(uint16_t dev_nonce, uint32_t join_nonce)
+{
+    storage_open();
+    nvs_set_u16(storage, STORAGE_KEY_LORA_DEV_NONCE, dev_nonce);
+    nvs_set_u32(storage, STORAGE_KEY_LORA_JOIN_NONCE, join_nonce);
+    portENTER_CRITICAL(&lock);
+    settings.dev_nonce = dev_nonce;
+    settings.join_nonce = join_nonce;
+    settings.generation++;
+    portEXIT_CRITICAL(&lock);
+}
+#endif /* CONFIG_LORA_LORAWAN_VERSION_1_1 */
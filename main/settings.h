@@ -0,0 +1,127 @@
+#ifndef SETTINGS_H_
+#define SETTINGS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+#include "period.h"
+#include "batch.h"
+
+#define SETTINGS_EUI_LEN  8
+#define SETTINGS_KEY_LEN  16
+
+typedef enum
+{
+    PAYL_FMT_NATIVE, PAYL_FMT_CAYENNE, PAYL_FMT_DELTA
+} payl_fmt_t;
+
+typedef enum
+{
+    CONFM_NONE, CONFM_ALL, CONFM_EVERY, CONFM_UNACKED, CONFM_ALARM
+} confm_t;
+
+typedef struct
+{
+    uint32_t generation;    // incremented on every change, 0 = not loaded
+    uint16_t period;
+    uint8_t payl_fmt;
+    uint8_t confm;          // confirmed uplink policy
+    uint8_t confm_param;    // N for every Nth uplink, K unacknowledged uplinks
+    uint8_t batch;          // samples per uplink
+    uint16_t deadband_hum;  // 0.01 %, 0 = disabled
+    uint16_t deadband_temp; // 0.01 °C, 0 = disabled
+    uint16_t heartbeat;     // min, 0 = disabled
+    period_breakpoint_t period_breakpoints[PERIOD_BREAKPOINTS];
+    uint8_t link_adapt;     // device side data rate and TX power selection instead of ADR
+    uint16_t capacity;      // mAh, 0 = energy budget disabled
+    uint16_t lifetime;      // days, 0 = energy budget disabled
+    bool has_credentials;   // join EUI, dev EUI and network key are set
+    uint8_t join_eui[SETTINGS_EUI_LEN];
+    uint8_t dev_eui[SETTINGS_EUI_LEN];
+    uint8_t app_key[SETTINGS_KEY_LEN];
+    uint8_t nwk_key[SETTINGS_KEY_LEN];
+#ifdef CONFIG_LORA_LORAWAN_VERSION_1_1
+    uint16_t dev_nonce;
+    uint32_t join_nonce;
+#endif /* CONFIG_LORA_LORAWAN_VERSION_1_1 */
+} settings_t;
+
+// value ranges shared by the GATT server and downlink commands
+static inline bool settings_period_valid(uint16_t period)
+{
+    return period > 0;
+}
+
+static inline bool settings_payl_fmt_valid(uint8_t payl_fmt)
+{
+    return payl_fmt <= PAYL_FMT_DELTA;
+}
+
+static inline bool settings_confm_valid(uint8_t confm)
+{
+    return confm <= CONFM_ALARM;
+}
+
+static inline bool settings_batch_valid(uint8_t batch)
+{
+    return batch > 0 && batch <= BATCH_SIZE_MAX;
+}
+
+static inline bool settings_link_adapt_valid(uint8_t link_adapt)
+{
+    return link_adapt <= 1;
+}
+
+void settings_init();
+
+void settings_load();
+
+const settings_t* settings_get();
+
+void settings_set_period(uint16_t period);
+
+void settings_set_payl_fmt(uint8_t payl_fmt);
+
+void settings_set_confm(uint8_t confm, uint8_t confm_param);
+
+void settings_set_batch(uint8_t batch);
+
+void settings_set_deadband(uint16_t deadband_hum, uint16_t deadband_temp, uint16_t heartbeat);
+
+void settings_set_period_breakpoints(const period_breakpoint_t *breakpoints);
+
+void settings_set_link_adapt(uint8_t link_adapt);
+
+void settings_set_budget(uint16_t capacity, uint16_t lifetime);
+
+void settings_load_budget_usage(uint32_t *elapsed, uint64_t *consumed);
+
+void settings_save_budget_usage(uint32_t elapsed, uint64_t consumed);
+
+void settings_set_join_eui(const uint8_t *join_eui);
+
+void settings_set_dev_eui(const uint8_t *dev_eui);
+
+void settings_set_app_key(const uint8_t *app_key);
+
+void settings_set_nwk_key(const uint8_t *nwk_key);
+
+bool settings_load_session(void *session, size_t len);
+
+bool settings_save_session(const void *session, size_t len);
+
+void settings_erase_session();
+
+bool settings_load_history(uint8_t block, void *data, size_t len);
+
+void settings_save_history(uint8_t block, const void *data, size_t len, uint32_t count);
+
+uint32_t settings_load_history_count();
+
+#ifdef CONFIG_LORA_LORAWAN_VERSION_1_1
+void settings_set_nonces(uint16_t dev_nonce, uint32_t join_nonce);
+#endif /* CONFIG_LORA_LORAWAN_VERSION_1_1 */
+
+#endif /* SETTINGS_H_ */
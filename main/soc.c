@@ -0,0 +1,86 @@
+#include <stddef.h>
+
+#include "soc.h"
+
+#define SOC_FILTER_SHIFT        3   // new estimate weight 1/8
+#define SOC_RESISTANCE_DEFAULT  150 // mOhm, typical small Li-ion cell
+#define SOC_RESISTANCE_MAX      2000
+#define SOC_RESET_DELTA         2000 // 0.01 %
+
+typedef struct
+{
+    uint16_t voltage;   // mV
+    uint16_t soc;       // 0.01 %
+} ocv_point_t;
+
+// single Li-ion cell open circuit voltage at room temperature
+// @formatter:off
+static const ocv_point_t ocv_curve[] = {
+        { 3000, 0 },
+        { 3300, 500 },
+        { 3600, 1000 },
+        { 3700, 2000 },
+        { 3750, 3000 },
+        { 3790, 4000 },
+        { 3830, 5000 },
+        { 3870, 6000 },
+        { 3920, 7000 },
+        { 3980, 8000 },
+        { 4060, 9000 },
+        { 4200, 10000 }
+};
+// @formatter:on
+
+#define OCV_POINTS  (sizeof(ocv_curve) / sizeof(ocv_point_t))
+
+uint16_t soc_from_ocv(uint16_t ocv)
+{
+    if (ocv <= ocv_curve[0].voltage) {
+        return ocv_curve[0].soc;
+    }
+    for (size_t i = 1; i < OCV_POINTS; i++) {
+        if (ocv < ocv_curve[i].voltage) {
+            const ocv_point_t *lo = &ocv_curve[i - 1];
+            const ocv_point_t *hi = &ocv_curve[i];
+            return lo->soc + (uint32_t) (hi->soc - lo->soc) * (ocv - lo->voltage) / (hi->voltage - lo->voltage);
+        }
+    }
+    return ocv_curve[OCV_POINTS - 1].soc;
+}
+
+void soc_update_resistance(soc_state_t *state, uint16_t rest, uint16_t loaded, uint16_t current)
+{
+    if (!state->resistance) {
+        state->resistance = SOC_RESISTANCE_DEFAULT;
+    }
+    if (loaded >= rest || current == 0) {
+        return;
+    }
+
+    // mV / mA = Ohm, scaled to mOhm
+    uint32_t resistance = (uint32_t) (rest - loaded) * 1000 / current;
+    if (resistance > SOC_RESISTANCE_MAX) {
+        resistance = SOC_RESISTANCE_MAX;
+    }
+    state->resistance = state->resistance + ((int32_t) resistance - state->resistance) / (1 << SOC_FILTER_SHIFT);
+}
+
+uint16_t soc_update(soc_state_t *state, uint16_t voltage, uint16_t current)
+{
+    if (!state->resistance) {
+        state->resistance = SOC_RESISTANCE_DEFAULT;
+    }
+
+    // voltage under load is below the open circuit voltage by the drop on internal resistance
+    uint16_t ocv = voltage + (uint32_t) current * state->resistance / 1000;
+    uint16_t soc = soc_from_ocv(ocv);
+
+    // large jump means the battery was replaced or charged, don't filter it out slowly
+    if (!state->initialized || soc > state->soc + SOC_RESET_DELTA) {
+        state->soc = soc;
+        state->initialized = 1;
+    } else {
+        state->soc = state->soc + ((int32_t) soc - state->soc) / (1 << SOC_FILTER_SHIFT);
+    }
+    return state->soc;
+}
@@ -0,0 +1,19 @@
+#ifndef SOC_H_
+#define SOC_H_
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint16_t soc;           // 0.01 %, filtered estimate
+    uint16_t resistance;    // mOhm, filtered internal resistance
+    uint8_t initialized;
+} soc_state_t;
+
+uint16_t soc_from_ocv(uint16_t ocv);
+
+void soc_update_resistance(soc_state_t *state, uint16_t rest, uint16_t loaded, uint16_t current);
+
+uint16_t soc_update(soc_state_t *state, uint16_t voltage, uint16_t current);
+
+#endif /* SOC_H_ */
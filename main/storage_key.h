@@ -7,6 +7,7 @@
 #define STORAGE_KEY_LORA_DEV_EUI    "lora_dev_eui"
 #define STORAGE_KEY_LORA_APP_KEY    "lora_app_key"
 #define STORAGE_KEY_LORA_NWK_KEY    "lora_nwk_key"
+#define STORAGE_KEY_LORA_SESSION    "lora_session"
 #ifdef CONFIG_LORA_LORAWAN_VERSION_1_1
 #define STORAGE_KEY_LORA_DEV_NONCE  "lora_dev_nonce"
 #define STORAGE_KEY_LORA_JOIN_NONCE "lora_join_nonce"
@@ -14,6 +15,19 @@
 #define STORAGE_KEY_PERIOD          "period"
 #define STORAGE_KEY_PAYL_FMT        "payl_fmt"
 #define STORAGE_KEY_CONFM           "confm"
+#define STORAGE_KEY_CONFM_PARAM     "confm_param"
+#define STORAGE_KEY_BATCH           "batch"
+#define STORAGE_KEY_DEADBAND_HUM    "db_hum"
+#define STORAGE_KEY_DEADBAND_TEMP   "db_temp"
+#define STORAGE_KEY_HEARTBEAT       "heartbeat"
+#define STORAGE_KEY_BAT_PERIOD      "bat_period"
+#define STORAGE_KEY_LINK_ADAPT      "link_adapt"
+#define STORAGE_KEY_CAPACITY        "capacity"
+#define STORAGE_KEY_LIFETIME        "lifetime"
+#define STORAGE_KEY_BUDGET_ELAPSED  "bgt_elapsed"
+#define STORAGE_KEY_BUDGET_CONSUMED "bgt_consumed"
+#define STORAGE_KEY_HISTORY         "hist_%d"
+#define STORAGE_KEY_HISTORY_COUNT   "hist_count"
 
 extern nvs_handle storage;
 
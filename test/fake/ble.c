@@ -0,0 +1,28 @@
+// BLE stack left out of the host build, the GATT server only runs after the button wake
+#include "ble.h"
+
+QueueHandle_t ble_event_queue = NULL;
+
+void ble_init()
+{
+    ble_event_queue = xQueueCreate(10, sizeof(ble_event_t));
+}
+
+bool ble_has_context()
+{
+    return false;
+}
+
+void ble_deinit()
+{
+    vQueueDelete(ble_event_queue);
+    ble_event_queue = NULL;
+}
+
+void ble_set_battery(uint8_t battery)
+{
+}
+
+void ble_set_enviromental(float humidity, float temperature)
+{
+}
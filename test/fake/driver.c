@@ -0,0 +1,253 @@
+// GPIO, ADC, SPI and LEDC drivers without hardware, time is charged on the simulated clock
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "driver/adc.h"
+#include "driver/spi_master.h"
+#include "driver/ledc.h"
+#include "esp_adc_cal.h"
+#include "fake_driver.h"
+#include "sim.h"
+
+#define ADC_CONVERSION_US   10
+
+typedef struct
+{
+    int level;
+    int input;
+    gpio_mode_t mode;
+    gpio_int_type_t intr_type;
+    bool intr_enabled;
+    gpio_isr_t isr;
+    void *isr_arg;
+} pin_t;
+
+struct sim_spi_device
+{
+    int clock_speed_hz;
+};
+
+static pin_t pins[GPIO_NUM_MAX];
+static fake_adc_source_t adc_source = NULL;
+static void *adc_source_arg = NULL;
+
+void gpio_pad_select_gpio(uint8_t gpio_num)
+{
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    pins[gpio_num].mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    pins[gpio_num].level = level;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    return pins[gpio_num].mode == GPIO_MODE_OUTPUT ? pins[gpio_num].level : pins[gpio_num].input;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    if (pull == GPIO_PULLUP_ONLY) {
+        pins[gpio_num].input = 1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    pins[gpio_num].intr_type = intr_type;
+    pins[gpio_num].intr_enabled = intr_type != GPIO_INTR_DISABLE;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    pins[gpio_num].intr_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+    pins[gpio_num].intr_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    pins[gpio_num].isr = isr_handler;
+    pins[gpio_num].isr_arg = args;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    pins[gpio_num].isr = NULL;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    pins[gpio_num].intr_type = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_hold_en(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_hold_dis(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+void fake_gpio_input(int gpio_num, int level)
+{
+    pin_t *pin = &pins[gpio_num];
+    int last = pin->input;
+    pin->input = level;
+
+    bool fire;
+    switch (pin->intr_type) {
+        case GPIO_INTR_POSEDGE:
+            fire = !last && level;
+            break;
+        case GPIO_INTR_NEGEDGE:
+            fire = last && !level;
+            break;
+        case GPIO_INTR_ANYEDGE:
+            fire = last != level;
+            break;
+        case GPIO_INTR_LOW_LEVEL:
+            fire = !level;
+            break;
+        case GPIO_INTR_HIGH_LEVEL:
+            fire = level;
+            break;
+        default:
+            fire = false;
+            break;
+    }
+    if (fire && pin->intr_enabled && pin->isr) {
+        pin->isr(pin->isr_arg);
+    }
+}
+
+int fake_gpio_output(int gpio_num)
+{
+    return pins[gpio_num].level;
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t width)
+{
+    return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten)
+{
+    return ESP_OK;
+}
+
+int adc1_get_raw(adc1_channel_t channel)
+{
+    sim_busy(ADC_CONVERSION_US);
+    return adc_source ? adc_source(channel, adc_source_arg) : 0;
+}
+
+void adc_power_acquire(void)
+{
+}
+
+void adc_power_release(void)
+{
+}
+
+void fake_adc_source(fake_adc_source_t source, void *arg)
+{
+    adc_source = source;
+    adc_source_arg = arg;
+}
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t unit, adc_atten_t atten, adc_bits_width_t width, uint32_t vref,
+        esp_adc_cal_characteristics_t *chars)
+{
+    chars->adc_num = unit;
+    chars->atten = atten;
+    chars->bit_width = width;
+    chars->vref = vref;
+    return ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t raw, const esp_adc_cal_characteristics_t *chars)
+{
+    return raw * FAKE_ADC_FULL_SCALE / 4095;
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dma_chan)
+{
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host)
+{
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config, spi_device_handle_t *handle)
+{
+    static struct sim_spi_device devices[4];
+    static int count = 0;
+    if (count >= 4) {
+        return ESP_ERR_NO_MEM;
+    }
+    devices[count].clock_speed_hz = config->clock_speed_hz;
+    *handle = &devices[count++];
+    return ESP_OK;
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans)
+{
+    // no device answers, reads return what was sent
+    if (trans->rx_buffer && trans->rx_buffer != trans->tx_buffer) {
+        memset(trans->rx_buffer, 0, (trans->rxlength ? trans->rxlength : trans->length) / 8);
+    }
+    sim_busy((trans->length + 8) * 1000000LL / handle->clock_speed_hz);
+    return ESP_OK;
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_stop(ledc_mode_t mode, ledc_channel_t channel, uint32_t idle_level)
+{
+    return ESP_OK;
+}
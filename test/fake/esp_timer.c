@@ -0,0 +1,47 @@
+// esp_timer on the simulated clock, callbacks run like the esp_timer task between task switches
+#include "esp_timer.h"
+#include "sim.h"
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    *handle = sim_event_create(args->callback, args->arg);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (sim_event_active(timer)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim_event_start(timer, sim_time() + timeout_us, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    if (sim_event_active(timer)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim_event_start(timer, sim_time() + period_us, period_us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!sim_event_active(timer)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim_event_stop(timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    sim_event_delete(timer);
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_time();
+}
@@ -0,0 +1,57 @@
+// Hooks of the fake peripheral drivers, tests and simulated devices plug in here
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// I2C device on the simulated bus, returning false NACKs the address
+typedef struct fake_i2c_device
+{
+    uint8_t address;
+    bool (*write)(struct fake_i2c_device *device, const uint8_t *data, size_t len);
+    bool (*read)(struct fake_i2c_device *device, uint8_t *data, size_t len);
+    struct fake_i2c_device *next;
+} fake_i2c_device_t;
+
+typedef struct
+{
+    uint32_t transactions;  // i2c_master_cmd_begin calls
+    uint32_t starts;        // start and repeated start conditions
+    uint32_t bytes;         // address and data bytes
+    int64_t bus_time;       // us
+} fake_i2c_stats_t;
+
+void fake_i2c_attach(fake_i2c_device_t *device);
+
+void fake_i2c_detach_all();
+
+fake_i2c_stats_t fake_i2c_stats();
+
+void fake_i2c_stats_reset();
+
+// GPIO input driven from outside, fires the ISR registered for the pin
+void fake_gpio_input(int gpio_num, int level);
+
+int fake_gpio_output(int gpio_num);
+
+// ADC input, the value is read on every conversion
+typedef int (*fake_adc_source_t)(int channel, void *arg);
+
+#define FAKE_ADC_FULL_SCALE 2600 // mV at 11 dB attenuation and 12 bit width
+
+void fake_adc_source(fake_adc_source_t source, void *arg);
+
+// NVS writes and erases since start, failure injection for the next n writes
+uint32_t fake_nvs_writes();
+
+void fake_nvs_fail_writes(int n);
+
+// NVS content lives in this section, the deep sleep harness keeps it like flash
+#define FAKE_FLASH_ATTR __attribute__((section("fake_flash")))
+
+// boot after reset or deep sleep, the RTC clock continues from rtc_time (us since power on)
+void fake_sleep_boot(int cause, int64_t rtc_time);
+
+// esp_deep_sleep_start() lands here with the enabled timer wakeup (0 = none), default reports and exits
+void fake_deep_sleep(uint64_t timer);
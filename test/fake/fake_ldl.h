@@ -0,0 +1,34 @@
+// Network behind the behavioural LoRaWAN MAC fake, tests choose how it answers
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint8_t join_reject;    // join requests left unanswered before the first accept
+    uint8_t ack_loss;       // %, confirmed uplinks left without acknowledgement
+    int8_t snr;             // dB, of every downlink
+    int16_t rssi;           // dBm, of every downlink
+    uint8_t margin;         // dB, LinkCheckAns demodulation margin
+    uint8_t gw_count;       // LinkCheckAns gateways
+} fake_ldl_network_t;
+
+typedef struct
+{
+    uint32_t joins;         // join requests sent
+    uint32_t uplinks;       // data frames sent
+    uint32_t confirmed;
+    uint32_t acked;
+    uint32_t downlinks;     // frames received in RX1
+    uint32_t up;            // frame counter of the last uplink
+    int64_t tx_time;        // us since boot, start of the last uplink
+    int64_t airtime;        // us, all transmissions
+} fake_ldl_stats_t;
+
+void fake_ldl_network(const fake_ldl_network_t *network);
+
+// answered in RX1 of the next uplink
+void fake_ldl_downlink(uint8_t port, const uint8_t *data, uint8_t len);
+
+fake_ldl_stats_t fake_ldl_stats();
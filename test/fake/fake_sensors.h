@@ -0,0 +1,24 @@
+// Simulated I2C climate sensors answering like the real parts
+#pragma once
+
+#include <stdbool.h>
+
+#define FAKE_SHT3X      (1 << 0)
+#define FAKE_DHT10      (1 << 1)
+#define FAKE_BME280     (1 << 2)
+
+typedef struct
+{
+    bool sht3x_bad_crc;     // corrupt the temperature CRC
+    bool sht3x_nack;        // NACK every address
+    bool dht10_stuck_busy;  // conversion never finishes
+} fake_sensors_fault_t;
+
+void fake_sensors_attach(unsigned mask);
+
+void fake_sensors_set(float temperature, float humidity);
+
+// BME280 answers the datasheet example conversion, 25.08 °C at 1006.53 hPa
+#define FAKE_BME280_TEMPERATURE 25.08f
+
+extern fake_sensors_fault_t fake_sensors_fault;
@@ -0,0 +1,499 @@
+// FreeRTOS on a simulated single core. Every task is a thread, but only the one holding
+// the CPU lock runs. Tasks switch only when they block or wake a higher priority task.
+// When no task is ready, the virtual clock jumps to the next timeout or event.
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "sim.h"
+
+#define TICK_US (1000000LL / configTICK_RATE_HZ)
+#define FOREVER INT64_MAX
+
+typedef enum
+{
+    TASK_READY, TASK_BLOCKED, TASK_SUSPENDED, TASK_DELETED
+} task_state_t;
+
+struct sim_task
+{
+    pthread_t thread;
+    pthread_cond_t cond;
+    TaskFunction_t func;
+    void *arg;
+    const char *name;
+    UBaseType_t priority;
+    uint32_t stack;
+    task_state_t state;
+    const void *wait;   // object the task is blocked on, NULL for delay
+    int64_t wake;       // timeout, virtual time
+    struct sim_task *next;
+};
+
+struct sim_event
+{
+    sim_callback_t callback;
+    void *arg;
+    int64_t at;         // -1 when stopped
+    int64_t period;
+    struct sim_event *next;
+};
+
+struct sim_queue
+{
+    UBaseType_t length;
+    UBaseType_t size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *items;
+};
+
+static pthread_mutex_t cpu = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_task main_task = { .name = "main", .priority = 1, .stack = 3584 };
+static struct sim_task *tasks = NULL;
+static struct sim_task *current = NULL;
+static struct sim_event *events = NULL;
+static int64_t now = 0;
+static int isr = 0;
+
+static void attach()
+{
+    // the thread calling first becomes the main task, like app_main
+    if (current) {
+        return;
+    }
+    pthread_cond_init(&main_task.cond, NULL);
+    main_task.thread = pthread_self();
+    pthread_mutex_lock(&cpu);
+    tasks = &main_task;
+    current = &main_task;
+}
+
+int64_t sim_time()
+{
+    return now;
+}
+
+void sim_set_time(int64_t time)
+{
+    now = time;
+}
+
+bool sim_in_isr()
+{
+    return isr > 0;
+}
+
+__attribute__((weak)) void sim_idle_forever()
+{
+    fprintf(stderr, "sim: all tasks blocked forever at %lld us\n", (long long) now);
+    abort();
+}
+
+static void run_due_events()
+{
+    bool fired;
+    isr++;
+    do {
+        fired = false;
+        for (struct sim_event *e = events; e; e = e->next) {
+            if (e->at >= 0 && e->at <= now) {
+                e->at = e->period ? e->at + e->period : -1;
+                e->callback(e->arg);
+                fired = true;
+                break; // callback may have changed the list
+            }
+        }
+    } while (fired);
+    isr--;
+}
+
+static void advance()
+{
+    int64_t next = FOREVER;
+    for (struct sim_task *t = tasks; t; t = t->next) {
+        if (t->state == TASK_BLOCKED && t->wake < next) {
+            next = t->wake;
+        }
+    }
+    for (struct sim_event *e = events; e; e = e->next) {
+        if (e->at >= 0 && e->at < next) {
+            next = e->at;
+        }
+    }
+    if (next == FOREVER) {
+        sim_idle_forever();
+        return;
+    }
+    if (next > now) {
+        now = next;
+    }
+
+    run_due_events();
+    for (struct sim_task *t = tasks; t; t = t->next) {
+        if (t->state == TASK_BLOCKED && t->wake <= now) {
+            t->state = TASK_READY;
+            t->wait = NULL;
+        }
+    }
+}
+
+static struct sim_task* pick()
+{
+    // the running task keeps the CPU against equal priority, others take turns
+    struct sim_task *best = current->state == TASK_READY ? current : NULL;
+    struct sim_task *t = current;
+    do {
+        t = t->next ? t->next : tasks;
+        if (t != current && t->state == TASK_READY && (!best || t->priority > best->priority)) {
+            best = t;
+        }
+    } while (t != current);
+    return best;
+}
+
+static void schedule()
+{
+    struct sim_task *self = current;
+    struct sim_task *next;
+    while (!(next = pick())) {
+        advance();
+    }
+    if (next != self) {
+        current = next;
+        pthread_cond_signal(&next->cond);
+        while (current != self) {
+            pthread_cond_wait(&self->cond, &cpu);
+        }
+    }
+    if (self->state == TASK_DELETED) {
+        pthread_mutex_unlock(&cpu);
+        pthread_exit(NULL);
+    }
+}
+
+static void preempt()
+{
+    if (isr) {
+        return;
+    }
+    for (struct sim_task *t = tasks; t; t = t->next) {
+        if (t->state == TASK_READY && t->priority > current->priority) {
+            schedule();
+            return;
+        }
+    }
+}
+
+static void block(const void *wait, int64_t wake)
+{
+    current->state = TASK_BLOCKED;
+    current->wait = wait;
+    current->wake = wake;
+    schedule();
+}
+
+static void wake_waiters(const void *wait)
+{
+    for (struct sim_task *t = tasks; t; t = t->next) {
+        if (t->state == TASK_BLOCKED && t->wait == wait) {
+            t->state = TASK_READY;
+            t->wait = NULL;
+        }
+    }
+    preempt();
+}
+
+static int64_t deadline(TickType_t ticks)
+{
+    // timeouts end on a tick boundary like on the target
+    return ticks == portMAX_DELAY ? FOREVER : (now / TICK_US + ticks) * TICK_US;
+}
+
+void sim_wait(int64_t us)
+{
+    attach();
+    if (isr) {
+        now += us;
+        return;
+    }
+    block(NULL, now + us);
+}
+
+void sim_busy(int64_t us)
+{
+    attach();
+    now += us;
+    if (!isr) {
+        run_due_events();
+        preempt();
+    }
+}
+
+sim_event_t* sim_event_create(sim_callback_t callback, void *arg)
+{
+    struct sim_event *event = calloc(1, sizeof(struct sim_event));
+    event->callback = callback;
+    event->arg = arg;
+    event->at = -1;
+    event->next = events;
+    events = event;
+    return event;
+}
+
+void sim_event_start(sim_event_t *event, int64_t at, int64_t period)
+{
+    event->at = at;
+    event->period = period;
+}
+
+void sim_event_stop(sim_event_t *event)
+{
+    event->at = -1;
+}
+
+bool sim_event_active(sim_event_t *event)
+{
+    return event->at >= 0;
+}
+
+void sim_event_delete(sim_event_t *event)
+{
+    for (struct sim_event **e = &events; *e; e = &(*e)->next) {
+        if (*e == event) {
+            *e = event->next;
+            free(event);
+            return;
+        }
+    }
+}
+
+static void* task_entry(void *param)
+{
+    struct sim_task *self = param;
+    pthread_mutex_lock(&cpu);
+    while (current != self) {
+        pthread_cond_wait(&self->cond, &cpu);
+    }
+    self->func(self->arg);
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t func, const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+        TaskHandle_t *handle, BaseType_t core)
+{
+    attach();
+    struct sim_task *task = calloc(1, sizeof(struct sim_task));
+    task->func = func;
+    task->arg = arg;
+    task->name = name;
+    task->priority = priority;
+    task->stack = stack;
+    task->state = TASK_READY;
+    pthread_cond_init(&task->cond, NULL);
+
+    struct sim_task **tail = &tasks;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    *tail = task;
+    if (handle) {
+        *handle = task;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&task->thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+
+    preempt();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(func, name, stack, arg, priority, handle, 0);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    attach();
+    if (!task || task == current) {
+        current->state = TASK_DELETED;
+        schedule();
+    } else {
+        task->state = TASK_DELETED;
+    }
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+    attach();
+    if (!task || task == current) {
+        current->state = TASK_SUSPENDED;
+        schedule();
+    } else if (task->state != TASK_DELETED) {
+        task->state = TASK_SUSPENDED;
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    attach();
+    if (ticks == 0) {
+        schedule();
+        return;
+    }
+    block(NULL, deadline(ticks));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return now / TICK_US;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    attach();
+    return current;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    // host stacks say nothing about the target, report the whole stack as unused
+    attach();
+    return task ? task->stack : current->stack;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct sim_queue *queue = calloc(1, sizeof(struct sim_queue));
+    queue->length = length;
+    queue->size = item_size;
+    queue->items = calloc(length, item_size ? item_size : 1);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    // tasks may still reference it in a simulation that ends with the process
+    queue->length = 0;
+    queue->count = 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    attach();
+    int64_t until = deadline(ticks);
+    while (queue->count >= queue->length) {
+        if (isr || ticks == 0 || now >= until) {
+            return pdFALSE;
+        }
+        block(queue, until);
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->size) {
+        memcpy(queue->items + tail * queue->size, item, queue->size);
+    }
+    queue->count++;
+    wake_waiters(queue);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken)
+{
+    if (woken) {
+        *woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+    attach();
+    queue->head = 0;
+    queue->count = 0;
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    attach();
+    int64_t until = deadline(ticks);
+    while (queue->count == 0) {
+        if (isr || ticks == 0 || now >= until) {
+            return pdFALSE;
+        }
+        block(queue, until);
+    }
+    if (queue->size) {
+        memcpy(item, queue->items + queue->head * queue->size, queue->size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    wake_waiters(queue);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    attach();
+    queue->head = 0;
+    queue->count = 0;
+    wake_waiters(queue);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    sem->count = 1;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max, 0);
+    sem->count = initial;
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return xQueueReceive(sem, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, NULL, 0);
+}
+
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+    if (woken) {
+        *woken = pdFALSE;
+    }
+    return xQueueReceive(sem, NULL, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+    return xQueueSendFromISR(sem, NULL, woken);
+}
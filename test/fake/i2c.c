@@ -0,0 +1,244 @@
+// I2C master driver on a simulated bus. Commands are queued like in the driver,
+// i2c_master_cmd_begin() plays them against the attached devices and charges the bus time.
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/i2c.h"
+#include "fake_driver.h"
+#include "sim.h"
+
+#define DATA_MAX    64
+
+typedef enum
+{
+    CMD_START, CMD_STOP, CMD_WRITE, CMD_READ
+} cmd_type_t;
+
+typedef struct
+{
+    cmd_type_t type;
+    const uint8_t *data;    // write source, NULL for a single byte
+    uint8_t byte;
+    uint8_t *dest;          // read destination
+    size_t len;
+} cmd_t;
+
+struct sim_i2c_link
+{
+    cmd_t *cmds;
+    size_t count;
+    size_t capacity;
+};
+
+static fake_i2c_device_t *devices = NULL;
+static fake_i2c_stats_t stats;
+static uint32_t clk_speed = 100000;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *conf)
+{
+    clk_speed = conf->master.clk_speed;
+    return clk_speed > 0 && clk_speed <= 1000000 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rx_buf, size_t tx_buf, int flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t port)
+{
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size)
+{
+    if (!buffer || size <= 2 * I2C_INTERNAL_STRUCT_SIZE) {
+        return NULL;
+    }
+    struct sim_i2c_link *link = calloc(1, sizeof(struct sim_i2c_link));
+    link->capacity = (size - 2 * I2C_INTERNAL_STRUCT_SIZE) / I2C_INTERNAL_STRUCT_SIZE;
+    link->cmds = calloc(link->capacity, sizeof(cmd_t));
+    return link;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return i2c_cmd_link_create_static((uint8_t*) "", I2C_LINK_RECOMMENDED_SIZE(16));
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd)
+{
+    if (cmd) {
+        free(cmd->cmds);
+        free(cmd);
+    }
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd)
+{
+    i2c_cmd_link_delete_static(cmd);
+}
+
+static esp_err_t add(i2c_cmd_handle_t cmd, cmd_t c)
+{
+    if (!cmd) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cmd->count >= cmd->capacity) {
+        return ESP_ERR_NO_MEM;
+    }
+    cmd->cmds[cmd->count++] = c;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd)
+{
+    return add(cmd, (cmd_t) { .type = CMD_START });
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd)
+{
+    return add(cmd, (cmd_t) { .type = CMD_STOP });
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en)
+{
+    return add(cmd, (cmd_t) { .type = CMD_WRITE, .byte = data, .len = 1 });
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *data, size_t len, bool ack_en)
+{
+    if (!data || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return add(cmd, (cmd_t) { .type = CMD_WRITE, .data = data, .len = len });
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *data, i2c_ack_type_t ack)
+{
+    return i2c_master_read(cmd, data, 1, ack);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t *data, size_t len, i2c_ack_type_t ack)
+{
+    if (!data || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return add(cmd, (cmd_t) { .type = CMD_READ, .dest = data, .len = len });
+}
+
+static fake_i2c_device_t* find(uint8_t address)
+{
+    for (fake_i2c_device_t *d = devices; d; d = d->next) {
+        if (d->address == address) {
+            return d;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks)
+{
+    if (!cmd) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t bits = 0;
+    esp_err_t ret = ESP_OK;
+    size_t i = 0;
+    stats.transactions++;
+
+    while (i < cmd->count && ret == ESP_OK) {
+        if (cmd->cmds[i].type != CMD_START) {
+            bits += cmd->cmds[i].type == CMD_STOP ? 1 : 9 * cmd->cmds[i].len;
+            i++;
+            continue;
+        }
+        // start, address byte, then data until the next start or stop
+        stats.starts++;
+        bits += 1;
+        i++;
+        if (i >= cmd->count || cmd->cmds[i].type != CMD_WRITE) {
+            ret = ESP_ERR_INVALID_STATE;
+            break;
+        }
+        uint8_t addr_byte = cmd->cmds[i].data ? cmd->cmds[i].data[0] : cmd->cmds[i].byte;
+        fake_i2c_device_t *device = find(addr_byte >> 1);
+        bool read = addr_byte & 1;
+        bits += 9;
+        stats.bytes++;
+
+        uint8_t data[DATA_MAX];
+        size_t len = 0;
+        size_t first = ++i;
+        while (i < cmd->count && cmd->cmds[i].type != CMD_START && cmd->cmds[i].type != CMD_STOP) {
+            const cmd_t *c = &cmd->cmds[i];
+            if (read != (c->type == CMD_READ)) {
+                ret = ESP_ERR_INVALID_STATE;
+            }
+            if (c->type == CMD_WRITE && !read && len + c->len <= DATA_MAX) {
+                if (c->data) {
+                    memcpy(data + len, c->data, c->len);
+                } else {
+                    data[len] = c->byte;
+                }
+            }
+            len += c->len;
+            i++;
+        }
+        if (ret != ESP_OK) {
+            break;
+        }
+        if (len > DATA_MAX) {
+            ret = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        if (!device) {
+            ret = ESP_FAIL; // address NACK, driver sends stop
+            break;
+        }
+        bits += 9 * len;
+        stats.bytes += len;
+
+        if (read) {
+            if (!device->read(device, data, len)) {
+                ret = ESP_FAIL;
+                break;
+            }
+            size_t offset = 0;
+            for (size_t j = first; j < i; j++) {
+                memcpy(cmd->cmds[j].dest, data + offset, cmd->cmds[j].len);
+                offset += cmd->cmds[j].len;
+            }
+        } else if (!device->write(device, data, len)) {
+            ret = ESP_FAIL;
+            break;
+        }
+    }
+
+    int64_t time = (int64_t) bits * 1000000 / clk_speed;
+    stats.bus_time += time;
+    sim_wait(time);
+    return ret;
+}
+
+void fake_i2c_attach(fake_i2c_device_t *device)
+{
+    device->next = devices;
+    devices = device;
+}
+
+void fake_i2c_detach_all()
+{
+    devices = NULL;
+}
+
+fake_i2c_stats_t fake_i2c_stats()
+{
+    return stats;
+}
+
+void fake_i2c_stats_reset()
+{
+    memset(&stats, 0, sizeof(stats));
+}
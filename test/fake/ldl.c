@@ -0,0 +1,406 @@
+// LoRaWAN MAC of lora_device_lib replaced by its observable behaviour on the EU868 plan:
+// radio reset, join and data exchanges with the airtime of the data rate, RX1/RX2 windows
+// and the answers of a fake network. No frames are encrypted or parsed. Time comes from
+// LDL_System_ticks() of the firmware, the radio FIFO is loaded over its SPI chip interface.
+#include <math.h>
+#include <string.h>
+
+#include "ldl_mac.h"
+#include "ldl_system.h"
+#include "fake_ldl.h"
+#include "sim.h"
+
+#define RESET_TIME          5000    // us, radio out of reset
+#define PROCESS_TIME        20      // us of CPU per LDL_MAC_process() call
+#define JOIN_ACCEPT_DELAY1  5000000 // us from end of TX
+#define RECEIVE_DELAY1      1000000 // us from end of TX
+#define RX2_DELAY           1000000 // us after RX1
+#define RX_SYMBOLS          8       // preamble detection timeout without a frame
+#define RX2_RATE            0       // DR0 in RX2
+#define FRAME_OVERHEAD      13      // MHDR, FHDR without options, FPort, MIC
+#define JOIN_REQUEST_LEN    23
+#define JOIN_ACCEPT_LEN     17
+#define ACK_LEN             12      // empty downlink with the ACK bit
+#define LINK_CHECK_LEN      3       // LinkCheckAns in FOpts
+#define REG_FIFO            0x00
+#define REG_IRQ_FLAGS       0x12
+
+typedef enum
+{
+    STATE_RESET, STATE_IDLE, STATE_TX, STATE_RX1, STATE_RX2
+} state_t;
+
+typedef enum
+{
+    OP_NONE, OP_JOIN, OP_DATA
+} op_t;
+
+static fake_ldl_network_t network = { .snr = 5, .rssi = -90, .margin = 10, .gw_count = 1 };
+static fake_ldl_stats_t stats;
+static op_t op = OP_NONE;
+static uint8_t downlink[LDL_MAX_PACKET];
+static uint8_t downlink_len = 0;
+static uint8_t downlink_port = 0;
+static uint32_t random_state = 1;
+
+// EU868 maximum application payload (N) per data rate, DR0 to DR7
+static const uint8_t mtu[] = { 51, 51, 51, 115, 222, 222, 222, 222 };
+
+static uint32_t random_u32()
+{
+    // xorshift, the same sequence on every run
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static int spreading_factor(uint8_t rate)
+{
+    return 12 - (rate > 5 ? 5 : rate);
+}
+
+static int64_t symbol_time(uint8_t rate)
+{
+    return (1 << spreading_factor(rate)) * 1000000LL / 125000;
+}
+
+static int64_t airtime(uint8_t rate, uint8_t len)
+{
+    // LoRa time on air at 125 kHz, coding rate 4/5, explicit header, CRC on
+    int sf = spreading_factor(rate);
+    int de = sf >= 11;
+    double payload = ceil((8.0 * len - 4 * sf + 28 + 16) / (4 * (sf - 2 * de))) * 5;
+    return (int64_t) (((8 + 4.25) + 8 + (payload > 0 ? payload : 0)) * symbol_time(rate));
+}
+
+static uint32_t ticks(int64_t us)
+{
+    return us * LDL_System_tps() / 1000000;
+}
+
+static uint32_t now(struct ldl_mac *self)
+{
+    return LDL_System_ticks(self->app);
+}
+
+static void respond(struct ldl_mac *self, enum ldl_mac_response_type type, const union ldl_mac_response_arg *arg)
+{
+    union ldl_mac_response_arg none;
+    memset(&none, 0, sizeof(none));
+    self->handler(self->app, type, arg ? arg : &none);
+}
+
+static void session_updated(struct ldl_mac *self)
+{
+    union ldl_mac_response_arg arg = { .session_updated = { .session = &self->session } };
+    respond(self, LDL_MAC_SESSION_UPDATED, &arg);
+}
+
+static void transmit(struct ldl_mac *self, uint8_t len)
+{
+    uint8_t frame[LDL_MAX_PACKET] = { 0 };
+    LDL_Chip_write(NULL, REG_FIFO, frame, len);
+    respond(self, LDL_MAC_TX_BEGIN, NULL);
+
+    int64_t time = airtime(self->rate, len);
+    stats.airtime += time;
+    self->len = len;
+    self->state = STATE_TX;
+    self->next = now(self) + ticks(time);
+}
+
+static void receive(struct ldl_mac *self, uint8_t len)
+{
+    uint8_t frame[LDL_MAX_PACKET];
+    sim_wait(airtime(self->rate, len));
+    LDL_Chip_read(NULL, REG_FIFO, frame, len);
+    stats.downlinks++;
+}
+
+static void finish(struct ldl_mac *self)
+{
+    op = OP_NONE;
+    self->state = STATE_IDLE;
+    session_updated(self);
+}
+
+static void rx1(struct ldl_mac *self)
+{
+    union ldl_mac_response_arg arg;
+    uint8_t flags;
+    LDL_Chip_read(NULL, REG_IRQ_FLAGS, &flags, sizeof(flags));
+
+    if (op == OP_JOIN) {
+        if (network.join_reject > 0) {
+            network.join_reject--;
+            return;
+        }
+        receive(self, JOIN_ACCEPT_LEN);
+        self->session.joined = true;
+        self->session.devAddr = random_u32();
+        self->session.up = 0;
+        self->session.appDown = 0;
+        self->session.nwkDown = 0;
+        self->session.rate = self->rate;
+        memset(&arg, 0, sizeof(arg));
+        arg.join_complete.nextDevNonce = ++self->dev_nonce;
+        arg.join_complete.joinNonce = random_u32() & 0xffffff;
+        respond(self, LDL_MAC_JOIN_COMPLETE, &arg);
+        finish(self);
+        return;
+    }
+
+    bool ack = self->confirmed && random_u32() % 100 >= network.ack_loss;
+    if (!ack && !self->check && !downlink_len) {
+        return;
+    }
+
+    uint8_t len = (downlink_len ? FRAME_OVERHEAD + downlink_len : ACK_LEN) + (self->check ? LINK_CHECK_LEN : 0);
+    receive(self, len);
+    memset(&arg, 0, sizeof(arg));
+    arg.downstream.rssi = network.rssi;
+    arg.downstream.snr = network.snr;
+    arg.downstream.size = len;
+    respond(self, LDL_MAC_DOWNSTREAM, &arg);
+    if (self->check) {
+        memset(&arg, 0, sizeof(arg));
+        arg.link_status.margin = network.margin;
+        arg.link_status.gwCount = network.gw_count;
+        respond(self, LDL_MAC_LINK_STATUS, &arg);
+    }
+    if (downlink_len) {
+        memset(&arg, 0, sizeof(arg));
+        arg.rx.port = downlink_port;
+        arg.rx.data = downlink;
+        arg.rx.size = downlink_len;
+        arg.rx.counter = self->session.appDown++;
+        respond(self, LDL_MAC_RX, &arg);
+        downlink_len = 0;
+    }
+    if (ack) {
+        stats.acked++;
+    }
+    respond(self, LDL_MAC_DATA_COMPLETE, NULL);
+    finish(self);
+}
+
+static void rx2(struct ldl_mac *self)
+{
+    if (op == OP_JOIN) {
+        op = OP_NONE;
+        self->state = STATE_IDLE;
+        respond(self, LDL_MAC_JOIN_TIMEOUT, NULL);
+        return;
+    }
+    respond(self, self->confirmed ? LDL_MAC_DATA_NAK : LDL_MAC_DATA_COMPLETE, NULL);
+    finish(self);
+}
+
+void fake_ldl_network(const fake_ldl_network_t *value)
+{
+    network = *value;
+}
+
+void fake_ldl_downlink(uint8_t port, const uint8_t *data, uint8_t len)
+{
+    downlink_port = port;
+    downlink_len = len;
+    memcpy(downlink, data, len);
+}
+
+fake_ldl_stats_t fake_ldl_stats()
+{
+    return stats;
+}
+
+void LDL_Radio_init(struct ldl_radio *self, enum ldl_radio_type type, void *board)
+{
+    self->board = board;
+    self->type = type;
+}
+
+void LDL_Radio_setPA(struct ldl_radio *self, enum ldl_radio_pa pa)
+{
+    self->pa = pa;
+}
+
+void LDL_Radio_interrupt(struct ldl_radio *self, uint8_t n)
+{
+}
+
+void LDL_SM_init(struct ldl_sm *self, const void *appKey, const void *nwkKey)
+{
+}
+
+void LDL_MAC_init(struct ldl_mac *self, enum ldl_region region, const struct ldl_mac_init_arg *arg)
+{
+    memset(self, 0, sizeof(struct ldl_mac));
+    self->app = arg->app;
+    self->handler = arg->handler;
+    self->dev_nonce = arg->devNonce;
+    self->adr = true;
+    if (arg->session) {
+        self->session = *arg->session;
+        self->rate = self->session.rate;
+        self->power = self->session.power;
+    }
+
+    LDL_Chip_reset(NULL, true);
+    self->state = STATE_RESET;
+    self->next = now(self) + ticks(RESET_TIME);
+}
+
+void LDL_MAC_process(struct ldl_mac *self)
+{
+    sim_busy(PROCESS_TIME);
+    if (self->state == STATE_IDLE || (int32_t) (now(self) - self->next) < 0) {
+        return;
+    }
+
+    switch (self->state) {
+        case STATE_RESET: {
+            LDL_Chip_reset(NULL, false);
+            union ldl_mac_response_arg arg = { .startup = { .entropy = random_u32() } };
+            self->state = STATE_IDLE;
+            respond(self, LDL_MAC_STARTUP, &arg);
+            break;
+        }
+        case STATE_TX:
+            respond(self, LDL_MAC_TX_COMPLETE, NULL);
+            self->state = STATE_RX1;
+            self->next += ticks((op == OP_JOIN ? JOIN_ACCEPT_DELAY1 : RECEIVE_DELAY1));
+            break;
+        case STATE_RX1:
+            self->state = STATE_RX2;
+            self->next += ticks(RX2_DELAY);
+            rx1(self);
+            if (self->state == STATE_RX2) {
+                // nothing received, the window closes after the preamble timeout
+                sim_wait(RX_SYMBOLS * symbol_time(self->rate));
+            }
+            break;
+        case STATE_RX2:
+            sim_wait(RX_SYMBOLS * symbol_time(RX2_RATE));
+            rx2(self);
+            break;
+        default:
+            break;
+    }
+}
+
+uint32_t LDL_MAC_ticksUntilNextEvent(const struct ldl_mac *self)
+{
+    if (self->state == STATE_IDLE) {
+        return UINT32_MAX;
+    }
+    int32_t delta = self->next - LDL_System_ticks(self->app);
+    return delta > 0 ? delta : 0;
+}
+
+bool LDL_MAC_ready(const struct ldl_mac *self)
+{
+    return self->state == STATE_IDLE;
+}
+
+bool LDL_MAC_joined(const struct ldl_mac *self)
+{
+    return self->session.joined;
+}
+
+enum ldl_mac_status LDL_MAC_otaa(struct ldl_mac *self)
+{
+    if (!LDL_MAC_ready(self)) {
+        return LDL_STATUS_BUSY;
+    }
+    if (self->session.joined) {
+        return LDL_STATUS_JOINED;
+    }
+    op = OP_JOIN;
+    stats.joins++;
+    transmit(self, JOIN_REQUEST_LEN);
+    return LDL_STATUS_OK;
+}
+
+void LDL_MAC_cancel(struct ldl_mac *self)
+{
+    if (self->state != STATE_RESET) {
+        op = OP_NONE;
+        self->state = STATE_IDLE;
+    }
+}
+
+static enum ldl_mac_status data(struct ldl_mac *self, bool confirmed, uint8_t port, uint8_t len, const struct ldl_mac_data_opts *opts)
+{
+    if (!self->session.joined) {
+        return LDL_STATUS_NOTJOINED;
+    }
+    if (!LDL_MAC_ready(self)) {
+        return LDL_STATUS_BUSY;
+    }
+    if (len > LDL_MAC_mtu(self)) {
+        return LDL_STATUS_SIZE;
+    }
+    op = OP_DATA;
+    self->confirmed = confirmed;
+    self->check = opts && opts->check;
+    stats.uplinks++;
+    stats.confirmed += confirmed;
+    stats.up = self->session.up++;
+    stats.tx_time = sim_time();
+    transmit(self, FRAME_OVERHEAD + len + (self->check ? 1 : 0));
+    return LDL_STATUS_OK;
+}
+
+enum ldl_mac_status LDL_MAC_unconfirmedData(struct ldl_mac *self, uint8_t port, const void *data_, uint8_t len,
+        const struct ldl_mac_data_opts *opts)
+{
+    return data(self, false, port, len, opts);
+}
+
+enum ldl_mac_status LDL_MAC_confirmedData(struct ldl_mac *self, uint8_t port, const void *data_, uint8_t len,
+        const struct ldl_mac_data_opts *opts)
+{
+    return data(self, true, port, len, opts);
+}
+
+uint8_t LDL_MAC_mtu(const struct ldl_mac *self)
+{
+    return mtu[self->rate];
+}
+
+enum ldl_mac_status LDL_MAC_setRate(struct ldl_mac *self, uint8_t rate)
+{
+    if (rate > 5) {
+        return LDL_STATUS_RATE;
+    }
+    self->rate = rate;
+    self->session.rate = rate;
+    return LDL_STATUS_OK;
+}
+
+uint8_t LDL_MAC_getRate(const struct ldl_mac *self)
+{
+    return self->rate;
+}
+
+enum ldl_mac_status LDL_MAC_setPower(struct ldl_mac *self, uint8_t power)
+{
+    self->power = power;
+    self->session.power = power;
+    return LDL_STATUS_OK;
+}
+
+void LDL_MAC_enableADR(struct ldl_mac *self)
+{
+    self->adr = true;
+}
+
+void LDL_MAC_disableADR(struct ldl_mac *self)
+{
+    self->adr = false;
+}
+
+void LDL_MAC_setMaxDCycle(struct ldl_mac *self, uint8_t maxDCycle)
+{
+}
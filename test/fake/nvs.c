@@ -0,0 +1,191 @@
+// NVS as a table of typed entries in memory, the section is kept over simulated deep sleep and power loss
+#include <string.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "fake_driver.h"
+
+#define ENTRIES_MAX     96
+#define VALUE_MAX       512
+
+typedef enum
+{
+    TYPE_FREE, TYPE_U8, TYPE_U16, TYPE_U32, TYPE_U64, TYPE_BLOB
+} type_t;
+
+typedef struct
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t type;
+    uint16_t len;
+    uint8_t value[VALUE_MAX];
+} entry_t;
+
+static FAKE_FLASH_ATTR entry_t entries[ENTRIES_MAX];
+
+static uint32_t writes = 0;
+static int fail_writes = 0;
+
+static entry_t* find(const char *key)
+{
+    for (int i = 0; i < ENTRIES_MAX; i++) {
+        if (entries[i].type != TYPE_FREE && strcmp(entries[i].key, key) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t set(const char *key, type_t type, const void *value, size_t len)
+{
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    if (len > VALUE_MAX) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+    if (fail_writes > 0) {
+        fail_writes--;
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    entry_t *entry = find(key);
+    for (int i = 0; !entry && i < ENTRIES_MAX; i++) {
+        if (entries[i].type == TYPE_FREE) {
+            entry = &entries[i];
+        }
+    }
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    strcpy(entry->key, key);
+    entry->type = type;
+    entry->len = len;
+    memcpy(entry->value, value, len);
+    writes++;
+    return ESP_OK;
+}
+
+static esp_err_t get(const char *key, type_t type, void *value, size_t len)
+{
+    entry_t *entry = find(key);
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (entry->type != type) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    memcpy(value, entry->value, len);
+    return ESP_OK;
+}
+
+uint32_t fake_nvs_writes()
+{
+    return writes;
+}
+
+void fake_nvs_fail_writes(int n)
+{
+    fail_writes = n;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(entries, 0, sizeof(entries));
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    entry_t *entry = find(key);
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    memset(entry, 0, sizeof(entry_t));
+    writes++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return set(key, TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char *key, uint16_t value)
+{
+    return set(key, TYPE_U16, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return set(key, TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char *key, uint64_t value)
+{
+    return set(key, TYPE_U64, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return set(key, TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    return get(key, TYPE_U8, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char *key, uint16_t *out_value)
+{
+    return get(key, TYPE_U16, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    return get(key, TYPE_U32, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char *key, uint64_t *out_value)
+{
+    return get(key, TYPE_U64, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    entry_t *entry = find(key);
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (entry->type != TYPE_BLOB) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    // like IDF: NULL asks for the size, a short buffer fails
+    if (out_value && *length < entry->len) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    if (out_value) {
+        memcpy(out_value, entry->value, entry->len);
+    }
+    *length = entry->len;
+    return ESP_OK;
+}
@@ -0,0 +1,168 @@
+#include <string.h>
+
+#include "fake_driver.h"
+#include "fake_sensors.h"
+#include "sim.h"
+
+#define SHT3X_CONVERSION_US     12500
+#define DHT10_CONVERSION_US     75000
+#define BME280_CONVERSION_US    8000
+
+fake_sensors_fault_t fake_sensors_fault;
+
+static float temperature = 21.5f;
+static float humidity = 45.0f;
+
+static struct
+{
+    int64_t start;
+    bool data;
+} sht3x;
+
+static struct
+{
+    int64_t start;
+    bool calibrated;
+} dht10 = { .calibrated = true };
+
+static struct
+{
+    uint8_t regs[256];
+    uint8_t ptr;
+    int64_t start;
+} bme280;
+
+static uint8_t sht3x_crc(const uint8_t *data)
+{
+    uint8_t crc = 0xff;
+    for (int i = 0; i < 2; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static bool sht3x_write(fake_i2c_device_t *device, const uint8_t *data, size_t len)
+{
+    if (fake_sensors_fault.sht3x_nack || len != 2) {
+        return false;
+    }
+    if (data[0] == 0x24 && data[1] == 0x00) {
+        sht3x.start = sim_time();
+        sht3x.data = true;
+    }
+    return true;
+}
+
+static bool sht3x_read(fake_i2c_device_t *device, uint8_t *data, size_t len)
+{
+    // reads are NACKed until a conversion is finished
+    if (fake_sensors_fault.sht3x_nack || !sht3x.data || sim_time() - sht3x.start < SHT3X_CONVERSION_US) {
+        return false;
+    }
+    uint16_t t = (temperature + 45.0f) * 65535.0f / 175.0f + 0.5f;
+    uint16_t h = humidity * 65535.0f / 100.0f + 0.5f;
+    uint8_t frame[6] = { t >> 8, t & 0xff, 0, h >> 8, h & 0xff, 0 };
+    frame[2] = sht3x_crc(&frame[0]) ^ (fake_sensors_fault.sht3x_bad_crc ? 0x01 : 0x00);
+    frame[5] = sht3x_crc(&frame[3]);
+    memcpy(data, frame, len < 6 ? len : 6);
+    sht3x.data = false;
+    return true;
+}
+
+static bool dht10_write(fake_i2c_device_t *device, const uint8_t *data, size_t len)
+{
+    switch (data[0]) {
+        case 0xba:
+            dht10.calibrated = false;
+            break;
+        case 0xe1:
+            dht10.calibrated = true;
+            break;
+        case 0xac:
+            dht10.start = sim_time();
+            break;
+    }
+    return true;
+}
+
+static bool dht10_read(fake_i2c_device_t *device, uint8_t *data, size_t len)
+{
+    bool busy = fake_sensors_fault.dht10_stuck_busy || (dht10.start && sim_time() - dht10.start < DHT10_CONVERSION_US);
+    uint32_t h = humidity / 100.0f * 1048576.0f;
+    uint32_t t = (temperature + 50.0f) / 200.0f * 1048576.0f;
+    uint8_t frame[6] = { (busy ? 0x80 : 0x00) | (dht10.calibrated ? 0x08 : 0x00) | 0x10, h >> 12, h >> 4, ((h & 0x0f) << 4) | (t >> 16),
+            t >> 8, t };
+    memcpy(data, frame, len < 6 ? len : 6);
+    return true;
+}
+
+static bool bme280_write(fake_i2c_device_t *device, const uint8_t *data, size_t len)
+{
+    bme280.ptr = data[0];
+    for (size_t i = 1; i < len; i++) {
+        bme280.regs[(uint8_t) (data[0] + i - 1)] = data[i];
+    }
+    if (len > 1 && data[0] <= 0xf4 && data[0] + len - 1 > 0xf4 && (bme280.regs[0xf4] & 0x03) == 0x01) {
+        bme280.start = sim_time(); // forced mode
+    }
+    return true;
+}
+
+static bool bme280_read(fake_i2c_device_t *device, uint8_t *data, size_t len)
+{
+    bool measuring = bme280.start && sim_time() - bme280.start < BME280_CONVERSION_US;
+    bme280.regs[0xf3] = measuring ? 0x08 : 0x00;
+    for (size_t i = 0; i < len; i++) {
+        data[i] = bme280.regs[(uint8_t) (bme280.ptr + i)];
+    }
+    return true;
+}
+
+static void bme280_reset()
+{
+    // compensation parameters and raw values of the datasheet example, section 8.2
+    // @formatter:off
+    static const uint8_t calib_tp[24] = {
+            0x70, 0x6b, 0x43, 0x67, 0x18, 0xfc,     // T1 27504, T2 26435, T3 -1000
+            0x7d, 0x8e, 0x43, 0xd6, 0xd0, 0x0b,     // P1 36477, P2 -10685, P3 3024
+            0x27, 0x0b, 0x8c, 0x00, 0xf9, 0xff,     // P4 2855, P5 140, P6 -7
+            0x8c, 0x3c, 0xf8, 0xc6, 0x70, 0x17      // P7 15500, P8 -14600, P9 6000
+    };
+    static const uint8_t calib_h[7] = { 0x6a, 0x01, 0x00, 0x13, 0x22, 0x03, 0x1e }; // H2 362, H3 0, H4 306, H5 50, H6 30
+    static const uint8_t data[8] = { 0x65, 0x5a, 0xc0, 0x7e, 0xed, 0x00, 0x6f, 0x2c }; // P 415148, T 519888, H 28460
+    // @formatter:on
+    memset(&bme280, 0, sizeof(bme280));
+    bme280.regs[0xd0] = 0x60;
+    memcpy(&bme280.regs[0x88], calib_tp, sizeof(calib_tp));
+    bme280.regs[0xa1] = 75;
+    memcpy(&bme280.regs[0xe1], calib_h, sizeof(calib_h));
+    memcpy(&bme280.regs[0xf7], data, sizeof(data));
+}
+
+static fake_i2c_device_t sht3x_device = { .address = 0x44, .write = sht3x_write, .read = sht3x_read };
+static fake_i2c_device_t dht10_device = { .address = 0x38, .write = dht10_write, .read = dht10_read };
+static fake_i2c_device_t bme280_device = { .address = 0x76, .write = bme280_write, .read = bme280_read };
+
+void fake_sensors_attach(unsigned mask)
+{
+    fake_i2c_detach_all();
+    if (mask & FAKE_SHT3X) {
+        fake_i2c_attach(&sht3x_device);
+    }
+    if (mask & FAKE_DHT10) {
+        fake_i2c_attach(&dht10_device);
+    }
+    if (mask & FAKE_BME280) {
+        bme280_reset();
+        fake_i2c_attach(&bme280_device);
+    }
+}
+
+void fake_sensors_set(float t, float h)
+{
+    temperature = t;
+    humidity = h;
+}
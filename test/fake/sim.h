@@ -0,0 +1,34 @@
+// Control of the simulated single core: virtual clock, scheduler and timed events.
+// FreeRTOS and IDF fakes are built on this, tests use it to drive time.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct sim_event sim_event_t;
+
+typedef void (*sim_callback_t)(void *arg);
+
+int64_t sim_time();                 // us since boot
+
+void sim_set_time(int64_t time);    // boot time offset, before anything runs
+
+// callback at absolute virtual time, runs like an interrupt between two task switches
+sim_event_t* sim_event_create(sim_callback_t callback, void *arg);
+
+void sim_event_start(sim_event_t *event, int64_t at, int64_t period);
+
+void sim_event_stop(sim_event_t *event);
+
+bool sim_event_active(sim_event_t *event);
+
+void sim_event_delete(sim_event_t *event);
+
+void sim_wait(int64_t us);          // calling task waits for a peripheral, other tasks run meanwhile
+
+void sim_busy(int64_t us);          // calling task keeps the CPU busy
+
+bool sim_in_isr();
+
+// called when every task blocks forever and no event is pending, default reports and aborts
+void sim_idle_forever();
@@ -0,0 +1,67 @@
+// Deep sleep and the RTC clock. RTC time is the boot time handed over by the harness plus the virtual
+// time since boot, it drives esp_clk_rtc_time() and gettimeofday() like the RTC timer on the target.
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "esp_sleep.h"
+#include "esp32/clk.h"
+#include "fake_driver.h"
+#include "sim.h"
+
+static esp_sleep_wakeup_cause_t cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+static int64_t boot_rtc_time = 0;
+static uint64_t timer_wakeup = 0;
+
+void fake_sleep_boot(int wakeup_cause, int64_t rtc_time)
+{
+    cause = wakeup_cause;
+    boot_rtc_time = rtc_time;
+    timer_wakeup = 0;
+}
+
+__attribute__((weak)) void fake_deep_sleep(uint64_t timer)
+{
+    printf("sim: deep sleep at %lld us, timer %llu us\n", (long long) sim_time(), (unsigned long long) timer);
+    exit(0);
+}
+
+uint64_t esp_clk_rtc_time(void)
+{
+    return boot_rtc_time + sim_time();
+}
+
+int gettimeofday(struct timeval *restrict tv, void *restrict tz)
+{
+    int64_t time = esp_clk_rtc_time();
+    tv->tv_sec = time / 1000000;
+    tv->tv_usec = time % 1000000;
+    return 0;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void)
+{
+    return cause;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    timer_wakeup = time_in_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void)
+{
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start(void)
+{
+    fake_deep_sleep(timer_wakeup);
+    abort();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum
+{
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_0 = 0, GPIO_NUM_1, GPIO_NUM_2, GPIO_NUM_3, GPIO_NUM_4, GPIO_NUM_5, GPIO_NUM_6, GPIO_NUM_7,
+    GPIO_NUM_8, GPIO_NUM_9, GPIO_NUM_10, GPIO_NUM_11, GPIO_NUM_12, GPIO_NUM_13, GPIO_NUM_14, GPIO_NUM_15,
+    GPIO_NUM_16, GPIO_NUM_17, GPIO_NUM_18, GPIO_NUM_19, GPIO_NUM_20, GPIO_NUM_21, GPIO_NUM_22, GPIO_NUM_23,
+    GPIO_NUM_25 = 25, GPIO_NUM_26, GPIO_NUM_27,
+    GPIO_NUM_32 = 32, GPIO_NUM_33, GPIO_NUM_34, GPIO_NUM_35, GPIO_NUM_36, GPIO_NUM_37, GPIO_NUM_38, GPIO_NUM_39,
+    GPIO_NUM_MAX
+} gpio_num_t;
+
+typedef enum
+{
+    GPIO_MODE_DISABLE, GPIO_MODE_INPUT, GPIO_MODE_OUTPUT, GPIO_MODE_OUTPUT_OD, GPIO_MODE_INPUT_OUTPUT_OD, GPIO_MODE_INPUT_OUTPUT
+} gpio_mode_t;
+
+typedef enum
+{
+    GPIO_PULLUP_ONLY, GPIO_PULLDOWN_ONLY, GPIO_PULLUP_PULLDOWN, GPIO_FLOATING
+} gpio_pull_mode_t;
+
+typedef enum
+{
+    GPIO_PULLUP_DISABLE, GPIO_PULLUP_ENABLE
+} gpio_pullup_t;
+
+typedef enum
+{
+    GPIO_INTR_DISABLE, GPIO_INTR_POSEDGE, GPIO_INTR_NEGEDGE, GPIO_INTR_ANYEDGE, GPIO_INTR_LOW_LEVEL, GPIO_INTR_HIGH_LEVEL
+} gpio_int_type_t;
+
+typedef void (*gpio_isr_t)(void *arg);
+
+#define ESP_INTR_FLAG_IRAM  (1 << 10)
+
+void gpio_pad_select_gpio(uint8_t gpio_num);
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode);
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+
+int gpio_get_level(gpio_num_t gpio_num);
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull);
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type);
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num);
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num);
+
+esp_err_t gpio_install_isr_service(int flags);
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args);
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num);
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type);
+
+esp_err_t gpio_hold_en(gpio_num_t gpio_num);
+
+esp_err_t gpio_hold_dis(gpio_num_t gpio_num);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+
+typedef int i2c_port_t;
+
+typedef enum
+{
+    I2C_MODE_SLAVE, I2C_MODE_MASTER
+} i2c_mode_t;
+
+typedef enum
+{
+    I2C_MASTER_WRITE, I2C_MASTER_READ
+} i2c_rw_t;
+
+typedef enum
+{
+    I2C_MASTER_ACK, I2C_MASTER_NACK, I2C_MASTER_LAST_NACK
+} i2c_ack_type_t;
+
+typedef struct
+{
+    i2c_mode_t mode;
+    int sda_io_num;
+    int scl_io_num;
+    bool sda_pullup_en;
+    bool scl_pullup_en;
+    struct
+    {
+        uint32_t clk_speed;
+    } master;
+    uint32_t clk_flags;
+} i2c_config_t;
+
+typedef struct sim_i2c_link *i2c_cmd_handle_t;
+
+// same accounting as the driver: a link header and a command descriptor per queued command
+#define I2C_INTERNAL_STRUCT_SIZE            24
+#define I2C_LINK_RECOMMENDED_SIZE(TRANSACTIONS) (2 * I2C_INTERNAL_STRUCT_SIZE + I2C_INTERNAL_STRUCT_SIZE * (5 * (TRANSACTIONS)))
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *conf);
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rx_buf, size_t tx_buf, int flags);
+
+esp_err_t i2c_driver_delete(i2c_port_t port);
+
+i2c_cmd_handle_t i2c_cmd_link_create(void);
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size);
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd);
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd);
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd);
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd);
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en);
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *data, size_t len, bool ack_en);
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *data, i2c_ack_type_t ack);
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t *data, size_t len, i2c_ack_type_t ack);
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// RTC clock, keeps counting over deep sleep, implemented by fake/sleep.c
+uint64_t esp_clk_rtc_time(void);
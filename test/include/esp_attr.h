@@ -0,0 +1,10 @@
+#ifndef ESP_ATTR_H_
+#define ESP_ATTR_H_
+
+// host build: RTC memory is a section of its own, the simulation keeps it over deep sleep
+#define RTC_DATA_ATTR   __attribute__((section("rtc_data")))
+#define RTC_NOINIT_ATTR RTC_DATA_ATTR
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#endif /* ESP_ATTR_H_ */
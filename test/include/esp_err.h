@@ -0,0 +1,54 @@
+#ifndef ESP_ERR_H_
+#define ESP_ERR_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_INVALID_SIZE    0x104
+#define ESP_ERR_NOT_FOUND       0x105
+#define ESP_ERR_TIMEOUT         0x107
+#define ESP_ERR_INVALID_CRC     0x109
+
+static inline const char *esp_err_to_name(esp_err_t err)
+{
+    switch (err) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:
+            return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_CRC:
+            return "ESP_ERR_INVALID_CRC";
+        default:
+            return "ESP_ERR";
+    }
+}
+
+#define ESP_ERROR_CHECK(x) do { \
+        esp_err_t _err = (x); \
+        if (_err != ESP_OK) { \
+            fprintf(stderr, "ESP_ERROR_CHECK failed: 0x%x at %s:%d\n", _err, __FILE__, __LINE__); \
+            abort(); \
+        } \
+    } while (0)
+
+#endif /* ESP_ERR_H_ */
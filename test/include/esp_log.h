@@ -0,0 +1,28 @@
+#ifndef ESP_LOG_H_
+#define ESP_LOG_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// host build: warnings and errors go to stderr, the rest only with HOST_LOG set in environment
+typedef enum
+{
+    ESP_LOG_NONE, ESP_LOG_ERROR, ESP_LOG_WARN, ESP_LOG_INFO, ESP_LOG_DEBUG, ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#define HOST_LOG(level, tag, format, ...) do { \
+        if (level <= ESP_LOG_WARN || getenv("HOST_LOG")) { \
+            fprintf(stderr, "%s: " format "\n", tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOST_LOG(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, len, level) do { (void) (tag); (void) (buffer); (void) (len); } while (0)
+#define ESP_LOG_BUFFER_HEX(tag, buffer, len) ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, len, ESP_LOG_INFO)
+
+#endif /* ESP_LOG_H_ */
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+
+// no heap accounting on the host
+static inline uint32_t esp_get_free_heap_size(void)
+{
+    return 0;
+}
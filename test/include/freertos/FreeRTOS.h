@@ -0,0 +1,40 @@
+// Host stand-in for the FreeRTOS API used by the firmware, implemented by fake/freertos.c
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_attr.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define configTICK_RATE_HZ      100
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS        portTICK_PERIOD_MS
+#define portMAX_DELAY           ((TickType_t) 0xffffffffUL)
+#define pdMS_TO_TICKS(ms)       ((TickType_t) ((uint64_t) (ms) * configTICK_RATE_HZ / 1000))
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+
+#ifndef BIT
+#define BIT(n)                  (1UL << (n))
+#endif
+
+// single simulated core, critical sections only have to keep out the scheduler, which never preempts
+typedef struct
+{
+    int owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+#define portENTER_CRITICAL(mux)         ((void) (mux))
+#define portEXIT_CRITICAL(mux)          ((void) (mux))
+#define portENTER_CRITICAL_ISR(mux)     ((void) (mux))
+#define portEXIT_CRITICAL_ISR(mux)      ((void) (mux))
+#define portYIELD_FROM_ISR()            ((void) 0)
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+void vQueueDelete(QueueHandle_t queue);
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken);
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item);
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#define xQueueSendToBack    xQueueSend
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+// semaphores are queues of empty items like in FreeRTOS, a mutex starts given
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t sem, BaseType_t *woken);
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken);
+
+#define vSemaphoreDelete(sem)   vQueueDelete(sem)
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_task *TaskHandle_t;
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t func, const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+        TaskHandle_t *handle, BaseType_t core);
+
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskSuspend(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+TickType_t xTaskGetTickCount(void);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
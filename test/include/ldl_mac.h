@@ -0,0 +1,174 @@
+// Host stand-in for the MAC API of lora_device_lib, the names and types the firmware uses.
+// fake/ldl.c implements it behaviourally: airtime, receive windows and answers of a fake network.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ldl_radio.h"
+#include "ldl_sm.h"
+
+#define LDL_MAX_PACKET  255U
+
+enum ldl_region
+{
+    LDL_EU_863_870
+};
+
+enum ldl_mac_status
+{
+    LDL_STATUS_OK, LDL_STATUS_NOTJOINED, LDL_STATUS_JOINED, LDL_STATUS_BUSY, LDL_STATUS_SIZE, LDL_STATUS_RATE, LDL_STATUS_POWER
+};
+
+enum ldl_mac_response_type
+{
+    LDL_MAC_CHIP_ERROR,
+    LDL_MAC_RESET,
+    LDL_MAC_STARTUP,
+    LDL_MAC_JOIN_COMPLETE,
+    LDL_MAC_JOIN_TIMEOUT,
+    LDL_MAC_DATA_COMPLETE,
+    LDL_MAC_DATA_TIMEOUT,
+    LDL_MAC_DATA_NAK,
+    LDL_MAC_RX,
+    LDL_MAC_LINK_STATUS,
+    LDL_MAC_RX1_SLOT,
+    LDL_MAC_RX2_SLOT,
+    LDL_MAC_DOWNSTREAM,
+    LDL_MAC_TX_COMPLETE,
+    LDL_MAC_TX_BEGIN,
+    LDL_MAC_SESSION_UPDATED,
+    LDL_MAC_DEVICE_TIME
+};
+
+struct ldl_mac_session
+{
+    uint32_t up;
+    uint32_t appDown;
+    uint32_t nwkDown;
+    uint32_t devAddr;
+    uint8_t rate;
+    uint8_t power;
+    uint8_t rx1DROffset;
+    bool joined;
+};
+
+union ldl_mac_response_arg
+{
+    struct
+    {
+        unsigned int entropy;
+    } startup;
+
+    struct
+    {
+        uint32_t joinNonce;
+        uint16_t nextDevNonce;
+    } join_complete;
+
+    struct
+    {
+        uint32_t margin;
+        uint32_t error;
+    } rx_slot;
+
+    struct
+    {
+        int16_t rssi;
+        int16_t snr;
+        uint8_t size;
+    } downstream;
+
+    struct
+    {
+        const struct ldl_mac_session *session;
+    } session_updated;
+
+    struct
+    {
+        const uint8_t *data;
+        uint16_t counter;
+        uint8_t port;
+        uint8_t size;
+    } rx;
+
+    struct
+    {
+        int16_t margin;
+        uint8_t gwCount;
+    } link_status;
+};
+
+typedef void (*ldl_mac_response_fn)(void *app, enum ldl_mac_response_type type, const union ldl_mac_response_arg *arg);
+
+struct ldl_mac_init_arg
+{
+    void *app;
+    struct ldl_radio *radio;
+    struct ldl_sm *sm;
+    ldl_mac_response_fn handler;
+    const struct ldl_mac_session *session;
+    const void *joinEUI;
+    const void *devEUI;
+    uint16_t devNonce;
+    uint32_t joinNonce;
+    int16_t gain;
+};
+
+struct ldl_mac_data_opts
+{
+    uint8_t nbTrans;
+    bool check;
+    bool getTime;
+};
+
+// state of the fake, the firmware only passes it around
+struct ldl_mac
+{
+    void *app;
+    ldl_mac_response_fn handler;
+    struct ldl_mac_session session;
+    int state;
+    uint32_t next;      // ticks of the next state change
+    bool adr;
+    bool confirmed;
+    bool check;
+    uint8_t len;        // PHY payload of the uplink in flight
+    uint8_t rate;
+    uint8_t power;
+    uint16_t dev_nonce;
+};
+
+void LDL_MAC_init(struct ldl_mac *self, enum ldl_region region, const struct ldl_mac_init_arg *arg);
+
+void LDL_MAC_process(struct ldl_mac *self);
+
+uint32_t LDL_MAC_ticksUntilNextEvent(const struct ldl_mac *self);
+
+bool LDL_MAC_ready(const struct ldl_mac *self);
+
+bool LDL_MAC_joined(const struct ldl_mac *self);
+
+enum ldl_mac_status LDL_MAC_otaa(struct ldl_mac *self);
+
+void LDL_MAC_cancel(struct ldl_mac *self);
+
+enum ldl_mac_status LDL_MAC_unconfirmedData(struct ldl_mac *self, uint8_t port, const void *data, uint8_t len,
+        const struct ldl_mac_data_opts *opts);
+
+enum ldl_mac_status LDL_MAC_confirmedData(struct ldl_mac *self, uint8_t port, const void *data, uint8_t len,
+        const struct ldl_mac_data_opts *opts);
+
+uint8_t LDL_MAC_mtu(const struct ldl_mac *self);
+
+enum ldl_mac_status LDL_MAC_setRate(struct ldl_mac *self, uint8_t rate);
+
+uint8_t LDL_MAC_getRate(const struct ldl_mac *self);
+
+enum ldl_mac_status LDL_MAC_setPower(struct ldl_mac *self, uint8_t power);
+
+void LDL_MAC_enableADR(struct ldl_mac *self);
+
+void LDL_MAC_disableADR(struct ldl_mac *self);
+
+void LDL_MAC_setMaxDCycle(struct ldl_mac *self, uint8_t maxDCycle);
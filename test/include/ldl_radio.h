@@ -0,0 +1,27 @@
+// Host stand-in for the radio driver API of lora_device_lib, the fake MAC talks to the chip itself
+#pragma once
+
+#include <stdint.h>
+
+enum ldl_radio_type
+{
+    LDL_RADIO_NONE, LDL_RADIO_SX1272, LDL_RADIO_SX1276
+};
+
+enum ldl_radio_pa
+{
+    LDL_RADIO_PA_AUTO, LDL_RADIO_PA_RFO, LDL_RADIO_PA_BOOST
+};
+
+struct ldl_radio
+{
+    void *board;
+    enum ldl_radio_type type;
+    enum ldl_radio_pa pa;
+};
+
+void LDL_Radio_init(struct ldl_radio *self, enum ldl_radio_type type, void *board);
+
+void LDL_Radio_setPA(struct ldl_radio *self, enum ldl_radio_pa pa);
+
+void LDL_Radio_interrupt(struct ldl_radio *self, uint8_t n);
@@ -0,0 +1,16 @@
+// Host stand-in for the default security module of lora_device_lib
+#pragma once
+
+#include <stdint.h>
+
+struct ldl_key
+{
+    uint8_t value[16U];
+};
+
+struct ldl_sm
+{
+    struct ldl_key keys[6];
+};
+
+void LDL_SM_init(struct ldl_sm *self, const void *appKey, const void *nwkKey);
@@ -0,0 +1,19 @@
+// Host stand-in for the system and chip interface of lora_device_lib, implemented by the firmware
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+uint32_t LDL_System_ticks(void *app);
+
+uint32_t LDL_System_tps(void);
+
+uint32_t LDL_System_eps(void);
+
+uint8_t LDL_System_getBatteryLevel(void *app);
+
+void LDL_Chip_reset(void *self, bool state);
+
+void LDL_Chip_write(void *self, uint8_t addr, const uint8_t *data, uint8_t len);
+
+void LDL_Chip_read(void *self, uint8_t addr, uint8_t *data, uint8_t len);
@@ -0,0 +1,4 @@
+// Host build configuration, the default profile with the I2C sensors
+#pragma once
+#define CONFIG_SENSOR_I2C 1
+#define CONFIG_SENSOR_PROFILE_DEFAULT 1
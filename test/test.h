@@ -0,0 +1,39 @@
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(a, b) do { \
+        long long _a = (a), _b = (b); \
+        if (_a != _b) { \
+            printf("%s:%d: %s == %s failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tol) do { \
+        double _a = (a), _b = (b); \
+        if (_a - _b > (tol) || _b - _a > (tol)) { \
+            printf("%s:%d: %s ~ %s failed: %g != %g (tol %g)\n", __FILE__, __LINE__, #a, #b, _a, _b, (double) (tol)); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define RUN(test) do { \
+        int _before = test_failures; \
+        test(); \
+        printf("%s %s\n", _before == test_failures ? "PASS" : "FAIL", #test); \
+    } while (0)
+
+#define TEST_RESULT() (test_failures ? 1 : 0)
+
+#endif /* TEST_H_ */
@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "codec.h"
+
+#define NATIVE_SAMPLE_LEN   5   // same as sizeof(native_payload_t) of the default profile
+#define LPP_SAMPLE_LEN      11  // same as SCHEMA_LPP_LEN(SCHEMA_DEFAULT)
+
+static const uint8_t mtus[] = { 51, 115, 222 }; // EU868 DR0-2, DR3, DR4-5
+
+static uint32_t rand_state = 1;
+
+static uint32_t rand_next()
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static int varint_get(const uint8_t *buf, size_t len, size_t *pos, uint32_t *val)
+{
+    *val = 0;
+    for (int shift = 0; shift < 32; shift += 7) {
+        if (*pos >= len) {
+            return -1;
+        }
+        uint8_t byte = buf[(*pos)++];
+        *val |= (uint32_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int32_t unzigzag(uint32_t val)
+{
+    return (int32_t) (val >> 1) ^ -(int32_t) (val & 1);
+}
+
+// reference decoder of the delta format for backends, returns the sample count or -1 when malformed
+static int codec_delta_decode(const uint8_t *buf, size_t len, sample_t *samples, size_t max)
+{
+    if (len < CODEC_DELTA_HEADER_LEN + CODEC_DELTA_BASE_LEN || buf[0] == 0 || buf[0] > max) {
+        return -1;
+    }
+    int count = buf[0];
+    size_t pos = CODEC_DELTA_HEADER_LEN;
+    memset(samples, 0, count * sizeof(sample_t));
+    samples[0].humidity = buf[pos] | buf[pos + 1] << 8;
+    samples[0].temperature = (int16_t) (buf[pos + 2] | buf[pos + 3] << 8);
+    samples[0].battery = buf[pos + 4];
+    pos += CODEC_DELTA_BASE_LEN;
+
+    for (int i = 1; i < count; i++) {
+        uint32_t d_humidity, d_temperature, d_battery;
+        if (varint_get(buf, len, &pos, &d_humidity) || varint_get(buf, len, &pos, &d_temperature)
+                || varint_get(buf, len, &pos, &d_battery)) {
+            return -1;
+        }
+        samples[i].humidity = samples[i - 1].humidity + unzigzag(d_humidity);
+        samples[i].temperature = samples[i - 1].temperature + unzigzag(d_temperature);
+        samples[i].battery = samples[i - 1].battery + unzigzag(d_battery);
+    }
+    return pos == len ? count : -1;
+}
+
+// encodes as many samples as fit, checks they decode back unchanged, returns the count
+static int round_trip(const sample_t *samples, int count, size_t mtu, size_t *len)
+{
+    uint8_t buf[UINT8_MAX];
+    sample_t decoded[BATCH_SIZE_MAX];
+    codec_delta_t codec;
+    int encoded = 0;
+    codec_delta_init(&codec, buf, mtu);
+    while (encoded < count && codec_delta_add(&codec, &samples[encoded])) {
+        encoded++;
+    }
+    CHECK_EQ(codec.count, encoded);
+    *len = codec.len;
+    if (!encoded) {
+        return 0;
+    }
+    CHECK(codec.len <= mtu);
+    CHECK_EQ(codec_delta_decode(buf, codec.len, decoded, BATCH_SIZE_MAX), encoded);
+    for (int i = 0; i < encoded; i++) {
+        CHECK_EQ(decoded[i].humidity, samples[i].humidity);
+        CHECK_EQ(decoded[i].temperature, samples[i].temperature);
+        CHECK_EQ(decoded[i].battery, samples[i].battery);
+    }
+    return encoded;
+}
+
+static void test_round_trip()
+{
+    sample_t samples[BATCH_SIZE_MAX];
+    size_t len;
+    for (int run = 0; run < 1000; run++) {
+        for (int i = 0; i < BATCH_SIZE_MAX; i++) {
+            samples[i].humidity = rand_next();
+            samples[i].temperature = rand_next();
+            samples[i].battery = rand_next();
+        }
+        size_t mtu = CODEC_DELTA_HEADER_LEN + CODEC_DELTA_BASE_LEN + rand_next() % (UINT8_MAX - 5);
+        int encoded = round_trip(samples, BATCH_SIZE_MAX, mtu, &len);
+        // the batching decision relies on the worst case length
+        CHECK(encoded == BATCH_SIZE_MAX || len + CODEC_DELTA_SAMPLE_MAX_LEN > mtu);
+    }
+}
+
+static void test_limits()
+{
+    size_t len;
+
+    // full range swings take the worst case varint length
+    const sample_t swing[] = {
+        { .humidity = 0, .temperature = INT16_MIN, .battery = 0 },
+        { .humidity = UINT16_MAX, .temperature = INT16_MAX, .battery = UINT8_MAX },
+        { .humidity = 0, .temperature = INT16_MIN, .battery = 0 },
+    };
+    CHECK_EQ(round_trip(swing, 3, UINT8_MAX, &len), 3);
+    CHECK_EQ(len, CODEC_DELTA_HEADER_LEN + CODEC_DELTA_BASE_LEN + 2 * CODEC_DELTA_SAMPLE_MAX_LEN);
+
+    // no change costs a byte per field
+    const sample_t steady[] = { { 4500, 2150, 80 }, { 4500, 2150, 80 } };
+    CHECK_EQ(round_trip(steady, 2, UINT8_MAX, &len), 2);
+    CHECK_EQ(len, CODEC_DELTA_HEADER_LEN + CODEC_DELTA_BASE_LEN + 3);
+
+    // the first sample exactly fits, one byte less and nothing is encoded
+    CHECK_EQ(round_trip(steady, 2, CODEC_DELTA_HEADER_LEN + CODEC_DELTA_BASE_LEN, &len), 1);
+    CHECK_EQ(round_trip(steady, 2, CODEC_DELTA_HEADER_LEN + CODEC_DELTA_BASE_LEN - 1, &len), 0);
+    CHECK_EQ(round_trip(steady, 2, 0, &len), 0);
+}
+
+static void test_malformed()
+{
+    sample_t decoded[BATCH_SIZE_MAX];
+    const uint8_t empty[] = { 0, 0x94, 0x11, 0x66, 0x08, 80 };
+    CHECK_EQ(codec_delta_decode(empty, sizeof(empty), decoded, BATCH_SIZE_MAX), -1);
+    const uint8_t truncated[] = { 2, 0x94, 0x11, 0x66, 0x08, 80, 0x00, 0x80 };
+    CHECK_EQ(codec_delta_decode(truncated, sizeof(truncated), decoded, BATCH_SIZE_MAX), -1);
+    const uint8_t trailing[] = { 1, 0x94, 0x11, 0x66, 0x08, 80, 0x00 };
+    CHECK_EQ(codec_delta_decode(trailing, sizeof(trailing), decoded, BATCH_SIZE_MAX), -1);
+    const uint8_t valid[] = { 2, 0x94, 0x11, 0x66, 0x08, 80, 0x00, 0x01, 0x00 };
+    CHECK_EQ(codec_delta_decode(valid, sizeof(valid), decoded, BATCH_SIZE_MAX), 2);
+    CHECK_EQ(decoded[1].temperature, 2149);
+}
+
+typedef void (*series_fn)(sample_t *samples, int count);
+
+// synthetic series, not recorded data
+static void series_indoor(sample_t *samples, int count)
+{
+    // 21.5 °C and 45 % with sensor noise of a few hundredths
+    for (int i = 0; i < count; i++) {
+        samples[i].humidity = 4500 + (int) (rand_next() % 21) - 10;
+        samples[i].temperature = 2150 + (int) (rand_next() % 7) - 3;
+        samples[i].battery = 80;
+    }
+}
+
+static void series_outdoor(sample_t *samples, int count)
+{
+    // morning warm-up, +0.4 °C and -1.2 % per sample
+    for (int i = 0; i < count; i++) {
+        samples[i].humidity = 8000 - 120 * i + (int) (rand_next() % 21) - 10;
+        samples[i].temperature = 500 + 40 * i + (int) (rand_next() % 7) - 3;
+        samples[i].battery = 80 - i / 8;
+    }
+}
+
+static void series_worst(sample_t *samples, int count)
+{
+    for (int i = 0; i < count; i++) {
+        samples[i].humidity = i % 2 ? UINT16_MAX : 0;
+        samples[i].temperature = i % 2 ? INT16_MAX : INT16_MIN;
+        samples[i].battery = i % 2 ? UINT8_MAX : 0;
+    }
+}
+
+static void bench_series(const char *name, series_fn series)
+{
+    sample_t samples[BATCH_SIZE_MAX];
+    size_t len;
+    series(samples, BATCH_SIZE_MAX);
+    round_trip(samples, BATCH_SIZE_MAX, UINT8_MAX, &len);
+    printf("%-8s %2d samples: delta %3zu B (%4.1f B/sample), native %3d B, LPP %3d B; samples per frame",
+            name, BATCH_SIZE_MAX, len, (double) len / BATCH_SIZE_MAX, BATCH_SIZE_MAX * NATIVE_SAMPLE_LEN,
+            BATCH_SIZE_MAX * LPP_SAMPLE_LEN);
+    for (int i = 0; i < sizeof(mtus); i++) {
+        printf(" %d@%dB", round_trip(samples, BATCH_SIZE_MAX, mtus[i], &len), mtus[i]);
+    }
+    printf("\n");
+}
+
+static void bench_size()
+{
+    bench_series("indoor", series_indoor);
+    bench_series("outdoor", series_outdoor);
+    bench_series("worst", series_worst);
+}
+
+int main()
+{
+    RUN(test_round_trip);
+    RUN(test_limits);
+    RUN(test_malformed);
+    RUN(bench_size);
+    return TEST_RESULT();
+}
@@ -0,0 +1,209 @@
+#include <string.h>
+
+#include "test.h"
+#include "command.h"
+#include "settings.h"
+#include "budget.h"
+#include "batch.h"
+#include "period.h"
+
+// fake settings: every setter counts and stores into one snapshot
+static settings_t settings;
+static int applied = 0;
+
+const settings_t* settings_get()
+{
+    return &settings;
+}
+
+void settings_set_period(uint16_t period)
+{
+    settings.period = period;
+    applied++;
+}
+
+void settings_set_payl_fmt(uint8_t payl_fmt)
+{
+    settings.payl_fmt = payl_fmt;
+    applied++;
+}
+
+void settings_set_confm(uint8_t confm, uint8_t confm_param)
+{
+    settings.confm = confm;
+    settings.confm_param = confm_param;
+    applied++;
+}
+
+void settings_set_batch(uint8_t batch)
+{
+    settings.batch = batch;
+    applied++;
+}
+
+void settings_set_deadband(uint16_t deadband_hum, uint16_t deadband_temp, uint16_t heartbeat)
+{
+    settings.deadband_hum = deadband_hum;
+    settings.deadband_temp = deadband_temp;
+    settings.heartbeat = heartbeat;
+    applied++;
+}
+
+void settings_set_period_breakpoints(const period_breakpoint_t *breakpoints)
+{
+    memcpy(settings.period_breakpoints, breakpoints, sizeof(settings.period_breakpoints));
+    applied++;
+}
+
+void settings_set_link_adapt(uint8_t link_adapt)
+{
+    settings.link_adapt = link_adapt;
+    applied++;
+}
+
+bool budget_set(uint16_t capacity, uint16_t lifetime)
+{
+    settings.capacity = capacity;
+    settings.lifetime = lifetime;
+    applied++;
+    return true;
+}
+
+static budget_status_t budget = { 0 };
+
+const budget_status_t* budget_get()
+{
+    return &budget;
+}
+
+static uint8_t process(const uint8_t *frame, uint8_t len)
+{
+    uint8_t ack[COMMAND_ACK_LEN];
+    memset(&settings, 0, sizeof(settings));
+    applied = 0;
+    command_process(frame, len);
+    CHECK(command_ack_pending());
+    command_ack(ack);
+    CHECK(!command_ack_pending());
+    CHECK_EQ(ack[0], frame[0]);
+    return ack[1];
+}
+
+static void test_apply_in_order()
+{
+    // period 600 s, Cayenne LPP, batch 4, budget 2400 mAh for 730 days
+    const uint8_t frame[] = { 0x2A, 0x01, 0x58, 0x02, 0x02, 0x01, 0x04, 0x04, 0x08, 0x60, 0x09, 0xDA, 0x02 };
+    CHECK_EQ(process(frame, sizeof(frame)), 0);
+    CHECK_EQ(applied, 4);
+    CHECK_EQ(settings.period, 600);
+    CHECK_EQ(settings.payl_fmt, PAYL_FMT_CAYENNE);
+    CHECK_EQ(settings.batch, 4);
+    CHECK_EQ(settings.capacity, 2400);
+    CHECK_EQ(settings.lifetime, 730);
+}
+
+static void test_stop_at_invalid()
+{
+    // second command is rejected, the first stays applied and the third is not reached
+    const uint8_t frame[] = { 0x01, 0x01, 0x3C, 0x00, 0x04, BATCH_SIZE_MAX + 1, 0x07, 0x01 };
+    CHECK_EQ(process(frame, sizeof(frame)), 2);
+    CHECK_EQ(applied, 1);
+    CHECK_EQ(settings.period, 60);
+    CHECK_EQ(settings.link_adapt, 0);
+}
+
+static void test_value_ranges()
+{
+    const uint8_t zero_period[] = { 0x02, 0x01, 0x00, 0x00 };
+    CHECK_EQ(process(zero_period, sizeof(zero_period)), 1);
+    const uint8_t zero_batch[] = { 0x03, 0x04, 0x00 };
+    CHECK_EQ(process(zero_batch, sizeof(zero_batch)), 1);
+    const uint8_t max_batch[] = { 0x04, 0x04, BATCH_SIZE_MAX };
+    CHECK_EQ(process(max_batch, sizeof(max_batch)), 0);
+    const uint8_t bad_format[] = { 0x05, 0x02, PAYL_FMT_DELTA + 1 };
+    CHECK_EQ(process(bad_format, sizeof(bad_format)), 1);
+    const uint8_t bad_confm[] = { 0x06, 0x03, CONFM_ALARM + 1, 0x00 };
+    CHECK_EQ(process(bad_confm, sizeof(bad_confm)), 1);
+    const uint8_t bad_link_adapt[] = { 0x07, 0x07, 0x02 };
+    CHECK_EQ(process(bad_link_adapt, sizeof(bad_link_adapt)), 1);
+
+    // budget with capacity but no lifetime would divide by zero days, both zero disables it
+    const uint8_t no_lifetime[] = { 0x08, 0x08, 0x60, 0x09, 0x00, 0x00 };
+    CHECK_EQ(process(no_lifetime, sizeof(no_lifetime)), 1);
+    const uint8_t no_capacity[] = { 0x09, 0x08, 0x00, 0x00, 0xDA, 0x02 };
+    CHECK_EQ(process(no_capacity, sizeof(no_capacity)), 1);
+    const uint8_t disabled[] = { 0x0A, 0x08, 0x00, 0x00, 0x00, 0x00 };
+    CHECK_EQ(process(disabled, sizeof(disabled)), 0);
+}
+
+static void test_breakpoints()
+{
+    // 50 % doubles the period, 20 % five times, rest unused
+    const uint8_t valid[] = { 0x10, 0x06, 50, 20, 20, 50, 0, 0, 0, 0 };
+    CHECK_EQ(process(valid, sizeof(valid)), 0);
+    CHECK_EQ(settings.period_breakpoints[1].factor, 50);
+    const uint8_t unused[] = { 0x11, 0x06, 0, 0, 0, 0, 0, 0, 0, 0 };
+    CHECK_EQ(process(unused, sizeof(unused)), 0);
+
+    const uint8_t ascending[] = { 0x12, 0x06, 20, 20, 50, 50, 0, 0, 0, 0 };
+    CHECK_EQ(process(ascending, sizeof(ascending)), 1);
+    const uint8_t over_full[] = { 0x13, 0x06, 101, 20, 0, 0, 0, 0, 0, 0 };
+    CHECK_EQ(process(over_full, sizeof(over_full)), 1);
+    const uint8_t shortening[] = { 0x14, 0x06, 50, 5, 0, 0, 0, 0, 0, 0 };
+    CHECK_EQ(process(shortening, sizeof(shortening)), 1);
+    const uint8_t gap[] = { 0x15, 0x06, 50, 20, 0, 0, 20, 50, 0, 0 };
+    CHECK_EQ(process(gap, sizeof(gap)), 1);
+}
+
+static void test_period_trailer()
+{
+    uint8_t buf[PERIOD_TRAILER_MAX];
+    memset(&settings, 0, sizeof(settings));
+    settings.period = 600;
+
+    // configured period is known to the application server, nothing appended
+    CHECK_EQ(period_trailer_len(PAYL_FMT_CAYENNE, 600), 0);
+    CHECK_EQ(period_trailer_encode(buf, PAYL_FMT_CAYENNE, 600), 0);
+
+    // 1800 s is 0.5 h, 50 in 0.01 h
+    CHECK_EQ(period_trailer_len(PAYL_FMT_CAYENNE, 1800), PERIOD_TRAILER_MAX);
+    CHECK_EQ(period_trailer_encode(buf, PAYL_FMT_CAYENNE, 1800), PERIOD_TRAILER_MAX);
+    CHECK_EQ(buf[0], PERIOD_LPP_CHANNEL);
+    CHECK_EQ(buf[2], 0);
+    CHECK_EQ(buf[3], 50);
+
+    CHECK_EQ(period_trailer_len(PAYL_FMT_NATIVE, 1800), 2);
+    CHECK_EQ(period_trailer_encode(buf, PAYL_FMT_NATIVE, 1800), 2);
+    CHECK_EQ(buf[0] | buf[1] << 8, 1800);
+}
+
+static void test_malformed()
+{
+    const uint8_t unknown[] = { 0x20, 0x01, 0x3C, 0x00, 0x7F, 0x01 };
+    CHECK_EQ(process(unknown, sizeof(unknown)), 2);
+    CHECK_EQ(applied, 1);
+
+    // truncated value is not read past the end of the frame
+    const uint8_t truncated[] = { 0x21, 0x05, 0x10, 0x00, 0x20 };
+    CHECK_EQ(process(truncated, sizeof(truncated)), 1);
+    CHECK_EQ(applied, 0);
+
+    const uint8_t seq_only[] = { 0x22 };
+    CHECK_EQ(process(seq_only, sizeof(seq_only)), 0);
+    CHECK_EQ(applied, 0);
+
+    // empty frame carries no sequence number, nothing to acknowledge
+    command_process(seq_only, 0);
+    CHECK(!command_ack_pending());
+}
+
+int main()
+{
+    RUN(test_apply_in_order);
+    RUN(test_stop_at_invalid);
+    RUN(test_value_ranges);
+    RUN(test_breakpoints);
+    RUN(test_period_trailer);
+    RUN(test_malformed);
+    return TEST_RESULT();
+}
@@ -0,0 +1,179 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "test.h"
+#include "dht.h"
+
+#define RESPONSE        80  // us, sensor response low and high
+#define BIT_LOW         50  // us, bit start
+#define BIT_ZERO        27  // us, high of a 0
+#define BIT_ONE         70  // us, high of a 1
+#define BIT_THRESHOLD   48  // us, same as in dht.c
+
+// datasheet example: 65.2 %RH, 35.1 °C
+static const uint8_t example[DHT_DATA_BYTES] = { 0x02, 0x8C, 0x01, 0x5F, 0xEE };
+
+typedef struct
+{
+    dht_pulse_t pulses[DHT_DATA_BITS + 4];
+    size_t count;
+} frame_t;
+
+// host release, sensor response and 40 bits as captured by the RMT
+static void frame_build(frame_t *frame, const uint8_t data[DHT_DATA_BYTES])
+{
+    size_t i = 0;
+    frame->pulses[i++] = (dht_pulse_t ) { .low = 1100, .high = 30 };
+    frame->pulses[i++] = (dht_pulse_t ) { .low = RESPONSE, .high = RESPONSE };
+    for (int bit = 0; bit < DHT_DATA_BITS; bit++) {
+        bool one = data[bit / 8] & (0x80 >> (bit % 8));
+        frame->pulses[i++] = (dht_pulse_t ) { .low = BIT_LOW, .high = one ? BIT_ONE : BIT_ZERO };
+    }
+    frame->count = i;
+}
+
+// pulse of a data bit, counted from the first one
+static dht_pulse_t* frame_bit(frame_t *frame, int bit)
+{
+    return &frame->pulses[2 + bit];
+}
+
+static void test_decode()
+{
+    frame_t frame;
+    uint8_t data[DHT_DATA_BYTES];
+    frame_build(&frame, example);
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_OK);
+    CHECK(memcmp(data, example, DHT_DATA_BYTES) == 0);
+
+    // checksum is the sum of the four bytes modulo 256
+    const uint8_t wrap[DHT_DATA_BYTES] = { 0xFF, 0xFF, 0x80, 0x03, 0x81 };
+    frame_build(&frame, wrap);
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_OK);
+    CHECK(memcmp(data, wrap, DHT_DATA_BYTES) == 0);
+
+    // trailing pulse after the last bit (line pulled back up) is ignored
+    frame_build(&frame, example);
+    frame.pulses[frame.count++] = (dht_pulse_t ) { .low = BIT_LOW, .high = 0 };
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_OK);
+}
+
+static void test_bit_threshold()
+{
+    frame_t frame;
+    uint8_t data[DHT_DATA_BYTES];
+    const uint8_t zero[DHT_DATA_BYTES] = { 0 };
+
+    // a 0 stretched up to the threshold is still 0, one us more reads as 1 (and breaks the checksum)
+    frame_build(&frame, zero);
+    frame_bit(&frame, 0)->high = BIT_THRESHOLD;
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_OK);
+    CHECK_EQ(data[0], 0x00);
+    frame_bit(&frame, 0)->high = BIT_THRESHOLD + 1;
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_ERR_CHECKSUM);
+    CHECK_EQ(data[0], 0x80);
+}
+
+static dht_status_t decode_bit(int bit, uint16_t low, uint16_t high)
+{
+    frame_t frame;
+    uint8_t data[DHT_DATA_BYTES];
+    frame_build(&frame, example);
+    frame_bit(&frame, bit)->low = low;
+    frame_bit(&frame, bit)->high = high;
+    return dht_decode(frame.pulses, frame.count, data);
+}
+
+static void test_bit_timing()
+{
+    // bit 6 of the example is 1, bit 7 is 0, last bit is 0
+    CHECK_EQ(decode_bit(6, 30, BIT_ONE), DHT_OK);
+    CHECK_EQ(decode_bit(6, 90, BIT_ONE), DHT_OK);
+    CHECK_EQ(decode_bit(6, 29, BIT_ONE), DHT_ERR_TIMING);
+    CHECK_EQ(decode_bit(6, 91, BIT_ONE), DHT_ERR_TIMING);
+    CHECK_EQ(decode_bit(6, BIT_LOW, 100), DHT_OK);
+    CHECK_EQ(decode_bit(6, BIT_LOW, 101), DHT_ERR_TIMING);
+    CHECK_EQ(decode_bit(7, BIT_LOW, 10), DHT_OK);
+    CHECK_EQ(decode_bit(7, BIT_LOW, 9), DHT_ERR_TIMING);
+    CHECK_EQ(decode_bit(DHT_DATA_BITS - 1, BIT_LOW, 9), DHT_ERR_TIMING);
+
+    // line stuck during a bit
+    CHECK_EQ(decode_bit(20, 0, 0), DHT_ERR_TIMING);
+    CHECK_EQ(decode_bit(20, BIT_LOW, 0), DHT_ERR_TIMING);
+}
+
+static void test_missing_start()
+{
+    frame_t frame;
+    uint8_t data[DHT_DATA_BYTES];
+
+    // nothing captured
+    CHECK_EQ(dht_decode(NULL, 0, data), DHT_ERR_NO_RESPONSE);
+
+    // response pulse cut out, none of the data bits looks like one
+    frame_build(&frame, example);
+    memmove(&frame.pulses[1], &frame.pulses[2], (frame.count - 2) * sizeof(dht_pulse_t));
+    frame.count--;
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_ERR_NO_RESPONSE);
+
+    // response just out of range on either edge
+    frame_build(&frame, example);
+    frame.pulses[1].low = 59;
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_ERR_NO_RESPONSE);
+    frame.pulses[1].low = 121;
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_ERR_NO_RESPONSE);
+    frame.pulses[1].low = RESPONSE;
+    frame.pulses[1].high = 59;
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_ERR_NO_RESPONSE);
+
+    // response on the range limits, without the host release in front
+    frame_build(&frame, example);
+    frame.pulses[1] = (dht_pulse_t ) { .low = 60, .high = 120 };
+    CHECK_EQ(dht_decode(&frame.pulses[1], frame.count - 1, data), DHT_OK);
+}
+
+static void test_short_frame()
+{
+    frame_t frame;
+    uint8_t data[DHT_DATA_BYTES];
+
+    // capture buffer or timeout cut the last bit
+    frame_build(&frame, example);
+    CHECK_EQ(dht_decode(frame.pulses, frame.count - 1, data), DHT_ERR_LENGTH);
+
+    // response only
+    CHECK_EQ(dht_decode(frame.pulses, 2, data), DHT_ERR_LENGTH);
+}
+
+static void test_checksum()
+{
+    frame_t frame;
+    uint8_t data[DHT_DATA_BYTES];
+
+    // single flipped bit in the humidity, in the checksum itself
+    uint8_t corrupt[DHT_DATA_BYTES];
+    memcpy(corrupt, example, DHT_DATA_BYTES);
+    corrupt[1] ^= 0x01;
+    frame_build(&frame, corrupt);
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_ERR_CHECKSUM);
+    memcpy(corrupt, example, DHT_DATA_BYTES);
+    corrupt[4] ^= 0x80;
+    frame_build(&frame, corrupt);
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_ERR_CHECKSUM);
+
+    // sum without the modulo does not match
+    const uint8_t no_wrap[DHT_DATA_BYTES] = { 0xFF, 0xFF, 0x80, 0x03, 0xFF };
+    frame_build(&frame, no_wrap);
+    CHECK_EQ(dht_decode(frame.pulses, frame.count, data), DHT_ERR_CHECKSUM);
+}
+
+int main()
+{
+    RUN(test_decode);
+    RUN(test_bit_threshold);
+    RUN(test_bit_timing);
+    RUN(test_missing_start);
+    RUN(test_short_frame);
+    RUN(test_checksum);
+    return TEST_RESULT();
+}
@@ -0,0 +1,74 @@
+// GATT writes of settings take the same value ranges as the downlink commands
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "test.h"
+#include "ble.h"
+#include "ble_gatt.h"
+#include "budget.h"
+#include "settings.h"
+
+// energy budget is not part of the settings, only ble_gatt.c and settings.c refer to it
+void budget_update()
+{
+}
+
+bool budget_set(uint16_t capacity, uint16_t lifetime)
+{
+    return !capacity == !lifetime;
+}
+
+static budget_status_t budget = { 0 };
+
+const budget_status_t* budget_get()
+{
+    return &budget;
+}
+
+static bool write_u8(ble_char_t chr, uint8_t value)
+{
+    uint8_t data[2] = { value, 0 };
+    return ble_gatt_write(chr, data, sizeof(data));
+}
+
+static bool write_u16(ble_char_t chr, uint16_t value)
+{
+    return ble_gatt_write(chr, (const uint8_t*) &value, sizeof(value));
+}
+
+static void test_period()
+{
+    CHECK(write_u16(BLE_CHAR_PERIOD, 120));
+    CHECK(!write_u16(BLE_CHAR_PERIOD, 0));
+    CHECK_EQ(settings_get()->period, 120);
+}
+
+static void test_ranges()
+{
+    CHECK(write_u8(BLE_CHAR_PAYL_FMT, PAYL_FMT_DELTA));
+    CHECK(!write_u8(BLE_CHAR_PAYL_FMT, PAYL_FMT_DELTA + 1));
+    CHECK_EQ(settings_get()->payl_fmt, PAYL_FMT_DELTA);
+
+    CHECK(write_u8(BLE_CHAR_CONFM, CONFM_ALARM));
+    CHECK(!write_u8(BLE_CHAR_CONFM, CONFM_ALARM + 1));
+    CHECK_EQ(settings_get()->confm, CONFM_ALARM);
+
+    CHECK(write_u8(BLE_CHAR_BATCH, BATCH_SIZE_MAX));
+    CHECK(!write_u8(BLE_CHAR_BATCH, 0));
+    CHECK(!write_u8(BLE_CHAR_BATCH, BATCH_SIZE_MAX + 1));
+    CHECK_EQ(settings_get()->batch, BATCH_SIZE_MAX);
+
+    CHECK(write_u8(BLE_CHAR_LINK_ADAPT, 1));
+    CHECK(!write_u8(BLE_CHAR_LINK_ADAPT, 2));
+    CHECK_EQ(settings_get()->link_adapt, 1);
+}
+
+int main()
+{
+    ble_event_queue = xQueueCreate(16, sizeof(ble_event_t));
+    settings_init();
+    RUN(test_period);
+    RUN(test_ranges);
+    return TEST_RESULT();
+}
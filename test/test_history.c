@@ -0,0 +1,228 @@
+#include <string.h>
+
+#include "test.h"
+#include "esp_sleep.h"
+#include "fake_driver.h"
+#include "ble_gatt.h"
+#include "budget.h"
+#include "history.h"
+
+#define PERIOD      60  // s between records
+#define CHUNK_MAX   244 // notification payload with a common phone MTU of 247
+#define RECORDS_MAX (HISTORY_BLOCKS * HISTORY_BLOCK_RECORDS + HISTORY_BLOCK_RECORDS)
+
+static uint32_t added = 0;
+
+// energy budget is not part of the history, only ble_gatt.c and settings.c refer to it
+void budget_update()
+{
+}
+
+bool budget_set(uint16_t capacity, uint16_t lifetime)
+{
+    return true;
+}
+
+static budget_status_t budget = { 0 };
+
+const budget_status_t* budget_get()
+{
+    return &budget;
+}
+
+// record i has time i * PERIOD and values derived from i
+static void add(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++, added++) {
+        fake_sleep_boot(ESP_SLEEP_WAKEUP_TIMER, (int64_t) added * PERIOD * 1000000);
+        history_add(20.0f + added % 1000 / 100.0f, (added % 500) / 10.0f - 20.0f, added % 101);
+    }
+}
+
+static bool record_valid(uint32_t index, const history_record_t *record)
+{
+    return record->time == index * PERIOD && record->humidity == (uint16_t) ((20.0f + index % 1000 / 100.0f) * 100)
+            && record->temperature == (int16_t) (((index % 500) / 10.0f - 20.0f) * 100) && record->battery == index % 101;
+}
+
+// client side, records reassembled by their index from notification headers
+typedef struct
+{
+    uint32_t first;
+    uint32_t next;
+    history_record_t records[RECORDS_MAX];
+    bool received[RECORDS_MAX];
+    int notifications;
+    bool done;
+} client_t;
+
+static client_t client;
+
+static void client_info(uint32_t *first, uint32_t *next)
+{
+    uint8_t value[BLE_GATT_VALUE_MAX];
+    CHECK_EQ(ble_gatt_read(BLE_CHAR_HISTORY, value), 13);
+    memcpy(first, &value[0], sizeof(uint32_t));
+    memcpy(next, &value[4], sizeof(uint32_t));
+    CHECK_EQ(value[12], sizeof(history_record_t));
+}
+
+static void client_start(uint32_t index)
+{
+    memset(&client, 0, sizeof(client));
+    client_info(&client.first, &client.next);
+    CHECK(ble_gatt_write(BLE_CHAR_HISTORY, (const uint8_t*) &index, sizeof(index)));
+}
+
+static void client_resume()
+{
+    // next missing record after the ones already received
+    uint32_t index = client.first;
+    while (index < client.next && client.received[index - client.first]) {
+        index++;
+    }
+    client.done = false;
+    CHECK(ble_gatt_write(BLE_CHAR_HISTORY, (const uint8_t*) &index, sizeof(index)));
+}
+
+// what the BLE stacks do on every sent notification, at most limit of them (link loss)
+static void stream(uint16_t max, int limit)
+{
+    uint8_t value[BLE_HISTORY_CHUNK_MAX];
+    uint16_t records;
+    for (int i = 0; i < limit && !client.done; i++) {
+        uint16_t len = ble_gatt_history_chunk(value, max, &records);
+        if (len == 0) {
+            break;
+        }
+        ble_gatt_history_sent(records);
+        client.notifications++;
+
+        CHECK(len <= max);
+        CHECK_EQ(len, sizeof(uint32_t) + records * sizeof(history_record_t));
+        uint32_t index;
+        memcpy(&index, value, sizeof(uint32_t));
+        if (records == 0) {
+            client.done = true;
+            break;
+        }
+        CHECK(index >= client.first && index + records <= client.next);
+        for (uint16_t r = 0; r < records; r++) {
+            memcpy(&client.records[index + r - client.first], &value[sizeof(uint32_t) + r * sizeof(history_record_t)],
+                    sizeof(history_record_t));
+            client.received[index + r - client.first] = true;
+        }
+    }
+    if (!client.done) {
+        ble_gatt_history_stop(); // disconnected
+    }
+}
+
+static void check_complete()
+{
+    CHECK(client.done);
+    for (uint32_t index = client.first; index < client.next; index++) {
+        if (!client.received[index - client.first] || !record_valid(index, &client.records[index - client.first])) {
+            printf("record %d missing or wrong\n", index);
+            test_failures++;
+            break;
+        }
+    }
+}
+
+static void test_full_stream()
+{
+    // two full blocks in flash, part of the third staged in RTC memory
+    add(2 * HISTORY_BLOCK_RECORDS + 5);
+    client_start(0);
+    CHECK_EQ(client.first, 0);
+    CHECK_EQ(client.next, added);
+    stream(CHUNK_MAX, 1000);
+    check_complete();
+    // 26 records per notification, then the end marker
+    int per_chunk = (CHUNK_MAX - sizeof(uint32_t)) / sizeof(history_record_t);
+    CHECK_EQ(client.notifications, (added + per_chunk - 1) / per_chunk + 1);
+
+    // largest notification
+    client_start(0);
+    stream(BLE_HISTORY_CHUNK_MAX, 1000);
+    check_complete();
+}
+
+static void test_resume()
+{
+    // link lost after three notifications, then after one more, then resumed to the end
+    client_start(0);
+    stream(CHUNK_MAX, 3);
+    CHECK(!client.done);
+    client_resume();
+    stream(CHUNK_MAX, 1);
+    client_resume();
+    stream(CHUNK_MAX, 1000);
+    check_complete();
+
+    // starting from an offset in the middle of a block sends nothing before it
+    client_start(HISTORY_BLOCK_RECORDS + 7);
+    stream(CHUNK_MAX, 1000);
+    CHECK(client.done);
+    CHECK(!client.received[HISTORY_BLOCK_RECORDS + 6]);
+    CHECK(client.received[HISTORY_BLOCK_RECORDS + 7]);
+    CHECK(record_valid(added - 1, &client.records[added - 1]));
+
+    // past the end, only the end marker
+    client_start(added + 10);
+    stream(CHUNK_MAX, 1000);
+    CHECK(client.done);
+    CHECK_EQ(client.notifications, 1);
+}
+
+static void test_wrap()
+{
+    // oldest blocks overwritten, a request older than stored starts from the first kept record
+    add(HISTORY_BLOCKS * HISTORY_BLOCK_RECORDS);
+    uint32_t first, next;
+    client_info(&first, &next);
+    CHECK_EQ(next, added);
+    CHECK_EQ(first, (added / HISTORY_BLOCK_RECORDS - HISTORY_BLOCKS) * HISTORY_BLOCK_RECORDS);
+
+    client_start(0);
+    stream(CHUNK_MAX, 1000);
+    CHECK(client.received[0]);
+    check_complete();
+}
+
+static void test_save_failure()
+{
+    // flash write of a block fails: logged, no abort, recording goes on
+    uint32_t failed = added - added % HISTORY_BLOCK_RECORDS;
+    fake_nvs_fail_writes(1);
+    add(HISTORY_BLOCK_RECORDS - added % HISTORY_BLOCK_RECORDS + 3);
+    uint32_t first, next;
+    client_info(&first, &next);
+    CHECK_EQ(next, added);
+
+    // stream stops at the lost block, the older block left in its slot is not sent in its place
+    client_start(failed - 5);
+    stream(CHUNK_MAX, 1000);
+    CHECK(client.done);
+    for (uint32_t index = client.first; index < client.next; index++) {
+        CHECK(!client.received[index - client.first] || (index < failed && record_valid(index, &client.records[index - client.first])));
+    }
+    CHECK(client.received[failed - 1 - client.first]);
+
+    // records after it are still there
+    client_start(failed + HISTORY_BLOCK_RECORDS);
+    stream(CHUNK_MAX, 1000);
+    CHECK(client.done);
+    CHECK(client.received[added - 1 - client.first]);
+    CHECK(record_valid(added - 1, &client.records[added - 1 - client.first]));
+}
+
+int main()
+{
+    RUN(test_full_stream);
+    RUN(test_resume);
+    RUN(test_wrap);
+    RUN(test_save_failure);
+    return TEST_RESULT();
+}
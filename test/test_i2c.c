@@ -0,0 +1,198 @@
+// I2C batch layer on the simulated bus, and bus time of one read of each sensor driver
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "test.h"
+#include "fake_driver.h"
+#include "fake_sensors.h"
+#include "sim.h"
+#include "peripherals.h"
+#include "sensor.h"
+#include "sensor_driver.h"
+
+static uint8_t log_data[32];
+static int log_len = 0;
+
+static bool log_write(fake_i2c_device_t *device, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len && log_len < sizeof(log_data); i++) {
+        log_data[log_len++] = data[i];
+    }
+    return true;
+}
+
+static bool log_read(fake_i2c_device_t *device, uint8_t *data, size_t len)
+{
+    memset(data, 0x5a, len);
+    return true;
+}
+
+static fake_i2c_device_t log_device = { .address = 0x10, .write = log_write, .read = log_read };
+
+static void test_batch_limit()
+{
+    fake_i2c_detach_all();
+    fake_i2c_attach(&log_device);
+    fake_i2c_stats_reset();
+
+    uint8_t value = 1;
+    i2c_batch_begin();
+    for (int i = 0; i < I2C_BATCH_MAX; i++) {
+        i2c_batch_write(0x10, i, &value, 1);
+    }
+    CHECK_EQ(i2c_batch_execute(), 0);
+    CHECK_EQ(fake_i2c_stats().transactions, 1);
+
+    // one more operation than the command buffer is sized for fails as a whole
+    i2c_batch_begin();
+    for (int i = 0; i <= I2C_BATCH_MAX; i++) {
+        i2c_batch_write(0x10, i, &value, 1);
+    }
+    CHECK_EQ(i2c_batch_execute(), -1);
+    CHECK_EQ(fake_i2c_stats().transactions, 1);
+}
+
+static void test_zero_length()
+{
+    uint8_t data[2];
+    i2c_batch_begin();
+    i2c_batch_read(0x10, 0x00, data, 0);
+    CHECK_EQ(i2c_batch_execute(), -1);
+
+    i2c_batch_begin();
+    i2c_batch_receive(0x10, data, 0);
+    CHECK_EQ(i2c_batch_execute(), -1);
+
+    // layer is usable again after a rejected batch
+    CHECK_EQ(i2c_read(0x10, 0x00, data, sizeof(data)), 0);
+    CHECK_EQ(data[1], 0x5a);
+}
+
+static void test_missing_device()
+{
+    uint8_t data = 0;
+    CHECK_EQ(i2c_receive(0x11, &data, 1), -1);
+    CHECK_EQ(i2c_write(0x11, 0x00, NULL, 0), -1);
+}
+
+static void other_task(void *arg)
+{
+    uint8_t value = 0xbb;
+    i2c_write(0x10, 0xb0, &value, 1);
+    vTaskDelete(NULL);
+}
+
+static void test_concurrent_batch()
+{
+    log_len = 0;
+    uint8_t value = 0xaa;
+
+    // other task wants the bus while this one is still building its batch
+    i2c_batch_begin();
+    i2c_batch_write(0x10, 0xa0, &value, 1);
+    xTaskCreate(other_task, "other", 2048, NULL, 5, NULL);
+    i2c_batch_write(0x10, 0xa1, &value, 1);
+    CHECK_EQ(i2c_batch_execute(), 0);
+    vTaskDelay(1);
+
+    // @formatter:off
+    const uint8_t expected[] = { 0xa0, 0xaa, 0xa1, 0xaa, 0xb0, 0xbb };
+    // @formatter:on
+    CHECK_EQ(log_len, sizeof(expected));
+    CHECK(!memcmp(log_data, expected, sizeof(expected)));
+}
+
+static void bench_driver(const sensor_driver_t *driver, unsigned fake)
+{
+    fake_sensors_attach(fake);
+    CHECK(driver->probe());
+    if (driver->init) {
+        driver->init();
+    }
+
+    // one wake: conversion command in a batch, polling, then the result
+    fake_i2c_stats_reset();
+    int64_t start = sim_time();
+    i2c_batch_begin();
+    driver->start();
+    CHECK_EQ(i2c_batch_execute(), 0);
+    while (!driver->poll()) {
+        vTaskDelay(SENSOR_POLL_INTERVAL / portTICK_PERIOD_MS);
+    }
+    sensor_data_t data = { .pressure = NAN };
+    CHECK(driver->complete(&data));
+
+    fake_i2c_stats_t stats = fake_i2c_stats();
+    printf("%-7s %2u transactions %3u bytes %4lld us bus, %6lld us until result, %.2f °C %.2f %%\n", driver->name,
+            stats.transactions, stats.bytes, (long long) stats.bus_time, (long long) (sim_time() - start), data.temperature,
+            data.humidity);
+    // at 400 kHz a read must stay well below a millisecond of bus time
+    CHECK(stats.bus_time < 1000);
+    CHECK(data.humidity > 0 && data.humidity <= 100);
+}
+
+static void bench_sensors()
+{
+    fake_sensors_set(21.5f, 45.0f);
+    bench_driver(&sensor_sht3x, FAKE_SHT3X);
+    bench_driver(&sensor_dht10, FAKE_DHT10);
+    bench_driver(&sensor_bme280, FAKE_BME280);
+}
+
+// drives one read through start, poll and complete, returns what complete reported
+static bool read_driver(const sensor_driver_t *driver)
+{
+    i2c_batch_begin();
+    driver->start();
+    i2c_batch_execute();
+    int64_t start = sim_time();
+    while (!driver->poll()) {
+        vTaskDelay(SENSOR_POLL_INTERVAL / portTICK_PERIOD_MS);
+        if (sim_time() - start > 1000000) {
+            printf("%s poll never ends\n", driver->name);
+            test_failures++;
+            break;
+        }
+    }
+    sensor_data_t data = { .pressure = NAN };
+    return driver->complete(&data);
+}
+
+static void test_sensor_faults()
+{
+    // a fault fails the read without an abort, the next read is fine again
+    fake_sensors_attach(FAKE_SHT3X);
+    fake_sensors_fault.sht3x_bad_crc = true;
+    CHECK(!read_driver(&sensor_sht3x));
+    fake_sensors_fault.sht3x_bad_crc = false;
+    CHECK(read_driver(&sensor_sht3x));
+
+    fake_sensors_fault.sht3x_nack = true;
+    CHECK(!read_driver(&sensor_sht3x));
+    fake_sensors_fault.sht3x_nack = false;
+    CHECK(read_driver(&sensor_sht3x));
+
+    fake_sensors_attach(FAKE_DHT10);
+    fake_sensors_fault.dht10_stuck_busy = true;
+    CHECK(!read_driver(&sensor_dht10));
+    fake_sensors_fault.dht10_stuck_busy = false;
+    CHECK(read_driver(&sensor_dht10));
+
+    // sensor gone after the probe
+    fake_sensors_attach(0);
+    CHECK(!read_driver(&sensor_dht10));
+    CHECK(!read_driver(&sensor_bme280));
+}
+
+int main()
+{
+    i2c_init();
+    RUN(test_batch_limit);
+    RUN(test_zero_length);
+    RUN(test_missing_device);
+    RUN(test_concurrent_batch);
+    RUN(bench_sensors);
+    RUN(test_sensor_faults);
+    return TEST_RESULT();
+}
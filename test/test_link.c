@@ -0,0 +1,59 @@
+#include "test.h"
+#include "link.h"
+
+static void test_margin_clamp()
+{
+    uint8_t rate, power;
+
+    // LinkCheck margin goes up to 254 dB, must not wrap to a negative margin
+    link_record_margin(200);
+    link_select(&rate, &power);
+    CHECK_EQ(rate, 5);
+    CHECK_EQ(power, 7);
+}
+
+static void test_downlink_not_power_normalized()
+{
+    uint8_t rate, power;
+
+    // 15 dB above the SF12 floor received at DR0, while the uplinks run at DR5 with reduced power
+    for (int i = 0; i < 8; i++) {
+        link_record_snr(-5, 0);
+    }
+    link_select(&rate, &power);
+    CHECK_EQ(rate, 2);
+    CHECK_EQ(power, 0);
+}
+
+static void test_downlink_rate()
+{
+    uint8_t rate, power;
+
+    // 15 dB above the SF9 floor is 7.5 dB better than the same margin at SF12
+    for (int i = 0; i < 8; i++) {
+        link_record_snr(3, 3);
+    }
+    link_select(&rate, &power);
+    CHECK_EQ(rate, 5);
+    CHECK_EQ(power, 0);
+}
+
+static void test_link_lost()
+{
+    uint8_t rate, power;
+    for (int i = 0; i < 32; i++) {
+        link_uplink();
+    }
+    link_select(&rate, &power);
+    CHECK_EQ(rate, 4);
+    CHECK(link_check_due());
+}
+
+int main()
+{
+    RUN(test_margin_clamp);
+    RUN(test_downlink_not_power_normalized);
+    RUN(test_downlink_rate);
+    RUN(test_link_lost);
+    return TEST_RESULT();
+}
@@ -0,0 +1,126 @@
+// Encoders expanded from SCHEMA_DEFAULT compared with the hand-written ones of the default profile they
+// replaced, copied unchanged from main/profile_default.c before the schema. The profile source is included
+// to reach its static encoders.
+#include "test.h"
+#include "profile_default.c"
+
+typedef struct
+{
+    uint16_t humidity;
+    int16_t temperature;
+    uint8_t battery;
+} __attribute__((packed)) old_native_payload_t;
+
+#define OLD_LPP_SAMPLE_LEN      11
+#define OLD_LPP_SAMPLE_CHANNELS 3
+
+static size_t old_encode_lpp(uint8_t *buf, const sample_t *sample, uint8_t channel)
+{
+    uint8_t humidity_val = sample->humidity / 50;
+    int16_t temperature_val = sample->temperature / 10;
+    int16_t battery_val = sample->battery_voltage / 10;
+
+    uint8_t len = 0;
+    buf[len++] = channel + 1;
+    buf[len++] = CAYENNE_LPP_RELATIVE_HUMIDITY;
+    buf[len++] = humidity_val;
+    buf[len++] = channel + 2;
+    buf[len++] = CAYENNE_LPP_TEMPERATURE;
+    buf[len++] = temperature_val >> 8;
+    buf[len++] = temperature_val;
+    buf[len++] = channel + 3;
+    buf[len++] = CAYENNE_LPP_ANALOG_INPUT;
+    buf[len++] = battery_val >> 8;
+    buf[len++] = battery_val;
+
+    return len;
+}
+
+static size_t old_encode_native(uint8_t *buf, const sample_t *sample)
+{
+    old_native_payload_t native_payload;
+    native_payload.humidity = sample->humidity;
+    native_payload.temperature = sample->temperature;
+    native_payload.battery = sample->battery;
+
+    memcpy(buf, &native_payload, sizeof(old_native_payload_t));
+    return sizeof(old_native_payload_t);
+}
+
+static uint32_t rand_state = 1;
+
+static uint32_t rand_next()
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static int compare(const sample_t *sample, uint8_t index)
+{
+    uint8_t expected[UINT8_MAX];
+    uint8_t actual[UINT8_MAX];
+    int failures = 0;
+
+    memset(expected, 0xAA, sizeof(expected));
+    memset(actual, 0xAA, sizeof(actual));
+    size_t expected_len = old_encode_native(expected, sample);
+    size_t actual_len = sample_encode_native(actual, sample);
+    failures += expected_len != actual_len || memcmp(expected, actual, sizeof(expected)) != 0;
+
+    memset(expected, 0xAA, sizeof(expected));
+    memset(actual, 0xAA, sizeof(actual));
+    expected_len = old_encode_lpp(expected, sample, index * OLD_LPP_SAMPLE_CHANNELS);
+    actual_len = sample_encode_lpp(actual, sample, index * LPP_SAMPLE_CHANNELS);
+    failures += expected_len != actual_len || memcmp(expected, actual, sizeof(expected)) != 0;
+
+    if (failures) {
+        printf("sample %u %d %u %u at %d differs\n", sample->humidity, sample->temperature, sample->battery,
+                sample->battery_voltage, index);
+    }
+    return failures;
+}
+
+static void test_layout()
+{
+    CHECK_EQ(sizeof(native_payload_t), sizeof(old_native_payload_t));
+    CHECK_EQ(LPP_SAMPLE_LEN, OLD_LPP_SAMPLE_LEN);
+    CHECK_EQ(LPP_SAMPLE_CHANNELS, OLD_LPP_SAMPLE_CHANNELS);
+}
+
+static void test_limits()
+{
+    const uint16_t humidities[] = { 0, 49, 50, 4500, 10000, 12799, 12800, UINT16_MAX };
+    const int16_t temperatures[] = { INT16_MIN, -4000, -11, -10, -9, 0, 9, 10, 2150, 8500, INT16_MAX };
+    const uint8_t batteries[] = { 0, 1, 100, UINT8_MAX };
+    const uint16_t voltages[] = { 0, 9, 10, 3300, 4200, 32767, 32768, UINT16_MAX };
+
+    for (int h = 0; h < sizeof(humidities) / sizeof(humidities[0]); h++) {
+        for (int t = 0; t < sizeof(temperatures) / sizeof(temperatures[0]); t++) {
+            for (int b = 0; b < sizeof(batteries); b++) {
+                for (int v = 0; v < sizeof(voltages) / sizeof(voltages[0]); v++) {
+                    sample_t sample = { humidities[h], temperatures[t], batteries[b], voltages[v] };
+                    test_failures += compare(&sample, 0);
+                }
+            }
+        }
+    }
+}
+
+static void test_random()
+{
+    // every position of a full batch, channels follow the sample index
+    for (int run = 0; run < 100000; run++) {
+        sample_t sample = { rand_next(), rand_next(), rand_next(), rand_next() };
+        test_failures += compare(&sample, run % BATCH_SIZE_MAX);
+    }
+}
+
+int main()
+{
+    RUN(test_layout);
+    RUN(test_limits);
+    RUN(test_random);
+    return TEST_RESULT();
+}
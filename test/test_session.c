@@ -0,0 +1,140 @@
+#include <string.h>
+
+#include "test.h"
+#include "session.h"
+#include "settings.h"
+
+// fake NVS: one blob, writes counted, failure injectable
+static uint8_t stored[256];
+static size_t stored_len = 0;
+static int save_count = 0;
+static int save_fail = 0;
+
+bool settings_load_session(void *session, size_t len)
+{
+    if (stored_len != len) {
+        return false;
+    }
+    memcpy(session, stored, len);
+    return true;
+}
+
+bool settings_save_session(const void *session, size_t len)
+{
+    if (save_fail) {
+        return false;
+    }
+    memcpy(stored, session, len);
+    stored_len = len;
+    save_count++;
+    return true;
+}
+
+void settings_erase_session()
+{
+    stored_len = 0;
+}
+
+static void join(struct ldl_mac_session *session, struct ldl_sm *sm)
+{
+    memset(session, 0, sizeof(struct ldl_mac_session));
+    memset(sm, 0, sizeof(struct ldl_sm));
+    session->joined = true;
+    session->devAddr = 0x26011234;
+    memset(sm->keys[2].value, 0xA5, sizeof(sm->keys[2].value)); // derived session key
+}
+
+static void test_write_amplification()
+{
+    struct ldl_mac_session session;
+    struct ldl_sm sm;
+    save_count = 0;
+    join(&session, &sm);
+    session_checkpoint(&session, &sm);
+    CHECK_EQ(save_count, 1);
+
+    // counters alone write once per reserved block
+    for (int i = 0; i < 10000; i++) {
+        session.up++;
+        session.appDown += i % 3 == 0;
+        session_checkpoint(&session, &sm);
+    }
+    printf("10000 uplinks, %d flash writes\n", save_count);
+    CHECK_EQ(save_count, 1 + 10000 / SESSION_FCNT_BLOCK);
+
+    // any other change is written right away
+    int before = save_count;
+    session.rate = 3;
+    session_checkpoint(&session, &sm);
+    CHECK_EQ(save_count, before + 1);
+    session_checkpoint(&session, &sm);
+    CHECK_EQ(save_count, before + 1);
+}
+
+static void test_restore_after_power_loss()
+{
+    struct ldl_mac_session session;
+    struct ldl_sm sm;
+    join(&session, &sm);
+    session_checkpoint(&session, &sm);
+    for (int i = 0; i < 100; i++) {
+        session.up++;
+        session_checkpoint(&session, &sm);
+    }
+    uint32_t last_up = session.up;
+
+    // power loss clears RTC memory, mac_init starts from root keys only
+    struct ldl_mac_session restored;
+    struct ldl_sm restored_sm;
+    memset(&restored, 0, sizeof(restored));
+    memset(&restored_sm, 0, sizeof(restored_sm));
+    CHECK(session_restore(&restored, &restored_sm));
+    CHECK(restored.joined);
+    CHECK(restored.up > last_up);
+    CHECK_EQ(restored.devAddr, session.devAddr);
+    CHECK(!memcmp(&restored_sm, &sm, sizeof(struct ldl_sm)));
+}
+
+static void test_save_failure()
+{
+    struct ldl_mac_session session;
+    struct ldl_sm sm;
+    join(&session, &sm);
+    session.devAddr++;
+    save_count = 0;
+
+    // a failed write leaves the old checkpoint, every update retries until flash accepts it
+    save_fail = 1;
+    session_checkpoint(&session, &sm);
+    session.up++;
+    session_checkpoint(&session, &sm);
+    CHECK_EQ(save_count, 0);
+    save_fail = 0;
+    session.up++;
+    session_checkpoint(&session, &sm);
+    CHECK_EQ(save_count, 1);
+    CHECK_EQ(((struct ldl_mac_session*) stored)->up, session.up + SESSION_FCNT_BLOCK);
+}
+
+static void test_leave()
+{
+    struct ldl_mac_session session;
+    struct ldl_sm sm;
+    join(&session, &sm);
+    session_checkpoint(&session, &sm);
+    CHECK(stored_len > 0);
+
+    session.joined = false;
+    session_checkpoint(&session, &sm);
+    CHECK_EQ(stored_len, 0);
+    CHECK(!session_restore(&session, &sm));
+}
+
+int main()
+{
+    RUN(test_write_amplification);
+    RUN(test_restore_after_power_loss);
+    RUN(test_save_failure);
+    RUN(test_leave);
+    return TEST_RESULT();
+}
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "soc.h"
+
+#define CURRENT_ACTIVE  40  // mA, same as BATTERY_CURRENT_ACTIVE
+#define CURRENT_TX      120 // mA, same as BATTERY_CURRENT_TX
+
+typedef struct
+{
+    int soc;
+    int rest;
+    int loaded;
+    int resistance;
+} trace_row_t;
+
+static int trace_load(const char *path, trace_row_t *rows, int max)
+{
+    FILE *f = fopen(path, "r");
+    char line[128];
+    int n = 0;
+    if (!f) {
+        printf("can't open %s\n", path);
+        return 0;
+    }
+    while (n < max && fgets(line, sizeof(line), f)) {
+        int hours;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%d,%d,%d,%d,%d", &hours, &rows[n].soc, &rows[n].rest, &rows[n].loaded, &rows[n].resistance) == 5) {
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+static void test_ocv_curve()
+{
+    CHECK_EQ(soc_from_ocv(2500), 0);
+    CHECK_EQ(soc_from_ocv(3000), 0);
+    CHECK_EQ(soc_from_ocv(3750), 3000);
+    CHECK_EQ(soc_from_ocv(3725), 2500);
+    CHECK_EQ(soc_from_ocv(4200), 10000);
+    CHECK_EQ(soc_from_ocv(4400), 10000);
+
+    // monotonic over the whole range
+    uint16_t last = 0;
+    for (uint16_t mv = 2900; mv <= 4300; mv++) {
+        uint16_t soc = soc_from_ocv(mv);
+        CHECK(soc >= last);
+        last = soc;
+    }
+}
+
+static void test_resistance()
+{
+    soc_state_t state = { 0 };
+
+    // no sag or no current keeps the default
+    soc_update_resistance(&state, 4000, 4000, CURRENT_TX);
+    CHECK_EQ(state.resistance, 150);
+    soc_update_resistance(&state, 4000, 3950, 0);
+    CHECK_EQ(state.resistance, 150);
+
+    // 36 mV at 120 mA is 300 mOhm, filter converges to it
+    for (int i = 0; i < 64; i++) {
+        soc_update_resistance(&state, 4000, 3964, CURRENT_TX);
+    }
+    CHECK_NEAR(state.resistance, 300, 10);
+
+    // absurd sag is clamped
+    for (int i = 0; i < 128; i++) {
+        soc_update_resistance(&state, 4000, 3000, CURRENT_TX);
+    }
+    CHECK(state.resistance <= 2000);
+}
+
+static void test_replaced_battery()
+{
+    soc_state_t state = { 0 };
+    for (int i = 0; i < 32; i++) {
+        soc_update(&state, 3650, CURRENT_ACTIVE);
+    }
+    CHECK(state.soc < 2500);
+
+    // fresh cell is taken over at once instead of being filtered
+    soc_update(&state, 4150, CURRENT_ACTIVE);
+    CHECK(state.soc > 9000);
+}
+
+static void test_discharge_trace()
+{
+    static trace_row_t rows[1024];
+    int n = trace_load("data/discharge_synthetic.csv", rows, 1024);
+    CHECK(n > 100);
+
+    soc_state_t state = { 0 };
+    int max_error = 0;
+    for (int i = 0; i < n; i++) {
+        soc_update_resistance(&state, rows[i].rest, rows[i].loaded, CURRENT_TX - CURRENT_ACTIVE);
+        uint16_t soc = soc_update(&state, rows[i].rest, CURRENT_ACTIVE);
+
+        // flat middle of the curve amplifies the noise, 5 % is what the period policy needs
+        int error = abs((int) soc - rows[i].soc);
+        if (i > 16 && error > max_error) {
+            max_error = error;
+        }
+        if (i > 16 && i % 50 == 0) {
+            CHECK_NEAR(state.resistance, rows[i].resistance, rows[i].resistance * 0.4);
+        }
+    }
+    printf("discharge trace: %d rows, max error %d.%02d %%, resistance %d mOhm\n", n, max_error / 100, max_error % 100,
+            state.resistance);
+    CHECK(max_error < 500);
+    CHECK(state.soc < 1000);
+}
+
+int main()
+{
+    RUN(test_ocv_curve);
+    RUN(test_resistance);
+    RUN(test_replaced_battery);
+    RUN(test_discharge_trace);
+    return TEST_RESULT();
+}
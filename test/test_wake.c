@@ -0,0 +1,388 @@
+// Whole wake cycle: app_main() from boot to esp_deep_sleep_start(), repeated over simulated deep sleep.
+// Every wake runs in a forked process, so only RTC memory and flash carry state from one wake to the
+// next like on the target. The MAC is the behavioural fake, times are virtual and host independent.
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "esp_sleep.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sim.h"
+#include "fake_driver.h"
+#include "fake_sensors.h"
+#include "fake_ldl.h"
+#include "command.h"
+#include "settings.h"
+#include "session.h"
+#include "storage_key.h"
+
+#define PERIOD          (60 * 1000000LL)    // us, default measurement period
+#define BATTERY_VOLTAGE 3900                // mV
+#define AWAKE_MAX       2500000             // us, bound of a timer wake on the simulated clock, RX1 and RX2 take 2 s of it
+
+extern uint8_t __start_rtc_data[], __stop_rtc_data[];
+extern uint8_t __start_fake_flash[], __stop_fake_flash[];
+
+void app_main();
+
+// survives the forked wakes
+typedef struct
+{
+    int64_t rtc_time;           // us since power on
+    int cause;
+    fake_ldl_network_t network;
+    uint8_t downlink[LDL_MAX_PACKET];
+    uint8_t downlink_len;
+    // result of the last wake
+    bool slept;
+    int64_t awake;              // us
+    uint64_t timer;             // us, deep sleep timer wakeup, 0 = none
+    int64_t tx_time;            // us, RTC time of the last uplink
+    fake_ldl_stats_t ldl;
+    uint32_t nvs_writes;
+} shared_t;
+
+static shared_t *shared;
+static uint8_t *rtc;
+static uint8_t *flash;
+static uint8_t *rtc_power_on;
+static uint32_t nvs_writes_boot;    // writes before the wake, inherited from the parent
+
+#define RTC_LEN     ((size_t) (__stop_rtc_data - __start_rtc_data))
+#define FLASH_LEN   ((size_t) (__stop_fake_flash - __start_fake_flash))
+
+static int battery_source(int channel, void *arg)
+{
+    return BATTERY_VOLTAGE / 2; // divider
+}
+
+void fake_deep_sleep(uint64_t timer)
+{
+    memcpy(rtc, __start_rtc_data, RTC_LEN);
+    memcpy(flash, __start_fake_flash, FLASH_LEN);
+    shared->slept = true;
+    shared->awake = sim_time();
+    shared->timer = timer;
+    shared->ldl = fake_ldl_stats();
+    shared->tx_time = shared->ldl.uplinks ? shared->rtc_time + shared->ldl.tx_time : 0;
+    shared->nvs_writes = fake_nvs_writes() - nvs_writes_boot;
+    fflush(stdout);
+    fflush(stderr);
+    _exit(0);
+}
+
+static void boot()
+{
+    memcpy(__start_rtc_data, rtc, RTC_LEN);
+    memcpy(__start_fake_flash, flash, FLASH_LEN);
+    nvs_writes_boot = fake_nvs_writes();
+    fake_sleep_boot(shared->cause, shared->rtc_time);
+    fake_sensors_attach(FAKE_SHT3X);
+    fake_sensors_set(21.5f, 45.0f);
+    fake_adc_source(battery_source, NULL);
+    fake_ldl_network(&shared->network);
+    if (shared->downlink_len) {
+        fake_ldl_downlink(COMMAND_PORT, shared->downlink, shared->downlink_len);
+    }
+    app_main();
+    _exit(1); // app_main never returns on the target
+}
+
+static bool wake()
+{
+    shared->slept = false;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        boot();
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    shared->downlink_len = 0;
+
+    printf("wake cause %d: awake %7.1f ms, sleep %7.1f s, joins %d, uplinks %d, airtime %6.1f ms, NVS writes %d\n",
+            shared->cause, shared->awake / 1000.0, shared->timer / 1000000.0, shared->ldl.joins, shared->ldl.uplinks,
+            shared->ldl.airtime / 1000.0, shared->nvs_writes);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !shared->slept) {
+        printf("wake did not end in deep sleep\n");
+        return false;
+    }
+    shared->rtc_time += shared->awake + shared->timer;
+    shared->cause = ESP_SLEEP_WAKEUP_TIMER;
+    return true;
+}
+
+static void power_on()
+{
+    // factory state: RTC memory as after reset, flash holds only the credentials
+    static const uint8_t eui[SETTINGS_EUI_LEN] = { 0x70, 0xB3, 0xD5, 0x7E, 0xD0, 0x00, 0x00, 0x01 };
+    static const uint8_t key[SETTINGS_KEY_LEN] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+    nvs_handle storage;
+    nvs_flash_erase();
+    nvs_open(STORAGE_NAME, NVS_READWRITE, &storage);
+    nvs_set_blob(storage, STORAGE_KEY_LORA_JOIN_EUI, eui, sizeof(eui));
+    nvs_set_blob(storage, STORAGE_KEY_LORA_DEV_EUI, eui, sizeof(eui));
+    nvs_set_blob(storage, STORAGE_KEY_LORA_APP_KEY, key, sizeof(key));
+    nvs_set_blob(storage, STORAGE_KEY_LORA_NWK_KEY, key, sizeof(key));
+    memcpy(flash, __start_fake_flash, FLASH_LEN);
+
+    memset(shared, 0, sizeof(shared_t));
+    shared->network = (fake_ldl_network_t ) { .snr = 5, .rssi = -90, .margin = 10, .gw_count = 1 };
+    memcpy(rtc, rtc_power_on, RTC_LEN);
+}
+
+static void power_loss()
+{
+    // battery swap: RTC memory and clock start over, flash stays
+    memcpy(rtc, rtc_power_on, RTC_LEN);
+    shared->rtc_time = 0;
+    shared->cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+static void reset()
+{
+    // software or panic reset: RTC memory starts over, the RTC time keeps running
+    memcpy(rtc, rtc_power_on, RTC_LEN);
+    shared->cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+static uint32_t budget_elapsed()
+{
+    uint32_t elapsed = 0;
+    nvs_handle storage;
+    memcpy(__start_fake_flash, flash, FLASH_LEN);
+    nvs_open(STORAGE_NAME, NVS_READWRITE, &storage);
+    nvs_get_u32(storage, STORAGE_KEY_BUDGET_ELAPSED, &elapsed);
+    return elapsed;
+}
+
+static void test_periodic()
+{
+    power_on();
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.joins, 1);
+    CHECK_EQ(shared->ldl.uplinks, 1);
+
+    // every timer wake sends one uplink, one period after the previous one
+    int64_t awake = 0;
+    int64_t tx_time = shared->tx_time;
+    uint32_t nvs_writes = 0;
+    const int wakes = 100;
+    for (int i = 0; i < wakes; i++) {
+        CHECK(wake());
+        CHECK_EQ(shared->ldl.joins, 0);
+        CHECK_EQ(shared->ldl.uplinks, 1);
+        CHECK_NEAR(shared->tx_time - tx_time, PERIOD, 20000);
+        CHECK(shared->awake < AWAKE_MAX);
+        tx_time = shared->tx_time;
+        awake += shared->awake;
+        nvs_writes += shared->nvs_writes;
+    }
+    printf("mean awake %.1f ms per timer wake, %d NVS writes in %d wakes\n", awake / 1000.0 / wakes, nvs_writes, wakes);
+    // session is checkpointed once per reserved counter block, history once per flash block
+    CHECK(nvs_writes <= 2 * (wakes / SESSION_FCNT_BLOCK + 1) + 2 * (wakes / 32 + 1));
+}
+
+static void test_downlink_command()
+{
+    power_on();
+    CHECK(wake());
+
+    // period 120 s, applied after the uplink that received it
+    const uint8_t frame[] = { 0x07, 0x01, 120, 0 };
+    memcpy(shared->downlink, frame, sizeof(frame));
+    shared->downlink_len = sizeof(frame);
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.downlinks, 1);
+    int64_t tx_time = shared->tx_time;
+
+    for (int i = 0; i < 3; i++) {
+        CHECK(wake());
+        CHECK_EQ(shared->ldl.uplinks, 1);
+        CHECK_NEAR(shared->tx_time - tx_time, 2 * PERIOD, 20000);
+        tx_time = shared->tx_time;
+    }
+
+    // lowered to 30 s, the wake that received it already sleeps the shorter period
+    const uint8_t lower[] = { 0x08, 0x01, 30, 0 };
+    memcpy(shared->downlink, lower, sizeof(lower));
+    shared->downlink_len = sizeof(lower);
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.downlinks, 1);
+    tx_time = shared->tx_time;
+    for (int i = 0; i < 3; i++) {
+        CHECK(wake());
+        CHECK_EQ(shared->ldl.uplinks, 1);
+        CHECK_NEAR(shared->tx_time - tx_time, PERIOD / 2, 20000);
+        tx_time = shared->tx_time;
+    }
+}
+
+static void test_heartbeat_batch()
+{
+    power_on();
+    CHECK(wake());
+
+    // batch 4, deadband 1 % and 0.5 °C, heartbeat 2 min; the sensor value does not change
+    const uint8_t frame[] = { 0x0A, 0x04, 4, 0x05, 100, 0, 50, 0, 2, 0 };
+    memcpy(shared->downlink, frame, sizeof(frame));
+    shared->downlink_len = sizeof(frame);
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.downlinks, 1);
+    int64_t tx_time = shared->tx_time;
+
+    // heartbeat is sent on its own once due, not after four of them are batched
+    for (int i = 0; i < 3; i++) {
+        CHECK(wake());
+        CHECK_EQ(shared->ldl.uplinks, 0);
+        CHECK(wake());
+        CHECK_EQ(shared->ldl.uplinks, 1);
+        CHECK_NEAR(shared->tx_time - tx_time, 2 * PERIOD, 20000);
+        tx_time = shared->tx_time;
+    }
+}
+
+static void test_duty_cycle()
+{
+    power_on();
+    CHECK(wake());
+
+    // period 5 s is shorter than the off time after an uplink, 128 times its airtime
+    const uint8_t frame[] = { 0x0B, 0x01, 5, 0 };
+    memcpy(shared->downlink, frame, sizeof(frame));
+    shared->downlink_len = sizeof(frame);
+    CHECK(wake());
+    int64_t tx_time = shared->tx_time;
+    int64_t airtime = shared->ldl.airtime;
+
+    // the MAC starts over on every wake, the wakeup itself keeps the duty cycle
+    for (int i = 0; i < 5; i++) {
+        CHECK(wake());
+        CHECK_EQ(shared->ldl.uplinks, 1);
+        CHECK(shared->tx_time - tx_time >= airtime * 128);
+        CHECK(shared->tx_time - tx_time < airtime * 128 + 1000000);
+        tx_time = shared->tx_time;
+        airtime = shared->ldl.airtime;
+    }
+}
+
+static void test_join_backoff()
+{
+    power_on();
+    shared->network.join_reject = 2;
+
+    // rejected attempts sleep for the backoff, 15 s then 30 s, nothing is sent until joined
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.joins, 1);
+    CHECK_EQ(shared->ldl.uplinks, 0);
+    int64_t attempt = shared->rtc_time;
+
+    // woken just before the backoff ends: attempt postponed, what is left of the backoff is too short to sleep
+    shared->rtc_time -= 100000;
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.joins, 0);
+    CHECK(shared->timer >= 1000000);
+    shared->network.join_reject = 1;
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.joins, 1);
+    CHECK_EQ(shared->ldl.uplinks, 0);
+    CHECK(shared->rtc_time - attempt >= 30000000);
+    shared->network.join_reject = 0;
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.joins, 1);
+    CHECK_EQ(shared->ldl.uplinks, 1);
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.joins, 0);
+    CHECK_EQ(shared->ldl.uplinks, 1);
+}
+
+static void test_power_loss()
+{
+    power_on();
+    for (int i = 0; i < 10; i++) {
+        CHECK(wake());
+    }
+    uint32_t up = shared->ldl.up;
+
+    // session comes back from flash, no new join, frame counter does not repeat
+    power_loss();
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.joins, 0);
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.joins, 0);
+    CHECK_EQ(shared->ldl.uplinks, 1);
+    CHECK(shared->ldl.up > up);
+}
+
+static void test_sensor_fault()
+{
+    // no sensor answers at cold boot: joined, nothing sent, probed again on the next wake
+    power_on();
+    fake_sensors_fault.sht3x_nack = true;
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.joins, 1);
+    CHECK_EQ(shared->ldl.uplinks, 0);
+    fake_sensors_fault.sht3x_nack = false;
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.uplinks, 1);
+
+    // failed read skips the sample, the wake still ends in deep sleep until the next period
+    fake_sensors_fault.sht3x_nack = true;
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.uplinks, 0);
+    CHECK_NEAR(shared->timer, PERIOD, 1000000);
+    fake_sensors_fault.sht3x_nack = false;
+    fake_sensors_fault.sht3x_bad_crc = true;
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.uplinks, 0);
+    fake_sensors_fault.sht3x_bad_crc = false;
+    CHECK(wake());
+    CHECK_EQ(shared->ldl.uplinks, 1);
+}
+
+static void test_budget_reset()
+{
+    // budget 65535 mAh for 30 days keeps the period, saved usage counts from here
+    power_on();
+    CHECK(wake());
+    const uint8_t frame[] = { 0x09, 0x08, 0xFF, 0xFF, 30, 0 };
+    memcpy(shared->downlink, frame, sizeof(frame));
+    shared->downlink_len = sizeof(frame);
+    CHECK(wake());
+    CHECK_EQ(budget_elapsed(), 0);
+
+    // 7 hours later the usage is saved, the reset right after it must not count them again
+    shared->rtc_time += 7 * 3600 * 1000000LL;
+    CHECK(wake());
+    uint32_t elapsed = budget_elapsed();
+    CHECK(elapsed >= 7 * 3600 && elapsed < 8 * 3600);
+    reset();
+    CHECK(wake());
+    CHECK_EQ(budget_elapsed(), elapsed);
+    shared->rtc_time += 6 * 3600 * 1000000LL;
+    CHECK(wake());
+    CHECK(budget_elapsed() >= elapsed + 6 * 3600 && budget_elapsed() < elapsed + 7 * 3600);
+}
+
+int main()
+{
+    shared = mmap(NULL, sizeof(shared_t) + 2 * RTC_LEN + FLASH_LEN, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    rtc = (uint8_t*) (shared + 1);
+    rtc_power_on = rtc + RTC_LEN;
+    flash = rtc_power_on + RTC_LEN;
+    memcpy(rtc_power_on, __start_rtc_data, RTC_LEN);
+
+    RUN(test_periodic);
+    RUN(test_downlink_command);
+    RUN(test_heartbeat_batch);
+    RUN(test_duty_cycle);
+    RUN(test_join_backoff);
+    RUN(test_power_loss);
+    RUN(test_sensor_fault);
+    RUN(test_budget_reset);
+    return TEST_RESULT();
+}